@@ -21,6 +21,19 @@ private:
   class impl;
   std::unique_ptr<impl> pImpl;
 };
+
+// Instruments the memory accesses of CPU leaf nodes with calls to the trace
+// API of hpvm-rt. Runs before DFG2LLVM_CPU, and after Spandex if both run.
+class SpandexTrace : public llvm::ModulePass {
+public:
+  static char ID;
+
+  SpandexTrace() : ModulePass{ID} {}
+
+  void getAnalysisUsage(AnalysisUsage &AU) const;
+
+  virtual bool runOnModule(llvm::Module &M);
+};
 } // namespace spandex
 
 #endif
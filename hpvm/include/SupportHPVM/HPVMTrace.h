@@ -0,0 +1,449 @@
+//===------------ HPVMTrace.h - Binary format of memory traces ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Binary memory traces, written by the HPVM runtime and replayed by
+// spandex-sim. A trace file is
+//
+//   FileHeader Chunk* Index Footer
+//
+// where every chunk is a ChunkHeader followed by its payload. The payload is
+// a sequence of access records, each one
+//
+//   varint(Core << KindBits | Kind) varint(zigzag(Addr - PreviousAddr))
+//
+// where PreviousAddr is the address of the previous record of the chunk, or 0
+// for the first one, so that every chunk decodes on its own. Records whose
+// kind has TaggedBit set go on with
+//
+//   varint(zigzag(Instance - PreviousInstance)) varint(Instruction)
+//
+// to name the node instance and the static instruction that made the access,
+// PreviousInstance being the instance of the previous tagged record. The
+// payload is stored raw or compressed with the LZ codec below, whichever is
+// smaller.
+//
+// The index has one IndexEntry per chunk and the footer locates it. A trace
+// whose writer did not finish has no footer; its chunks are still found by
+// walking the chunk headers from the file header on.
+//
+// All integers are little-endian. The header only depends on the C++11
+// standard library, since the runtime is built with it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef HPVM_TRACE_HEADER
+#define HPVM_TRACE_HEADER
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace hpvm {
+namespace trace {
+
+const char FileMagic[8] = {'H', 'P', 'V', 'M', 'T', 'R', 'C', '\0'};
+const char FooterMagic[8] = {'H', 'P', 'V', 'M', 'I', 'D', 'X', '\0'};
+const uint32_t FormatVersion = 1;
+
+enum AccessKind : unsigned { Load = 0, Store = 1 };
+const unsigned TaggedBit = 2;
+const unsigned KindBits = 2;
+
+enum Codec : uint32_t { CodecNone = 0, CodecLZ = 1 };
+
+// Bytes of the sections of a file
+const size_t FileHeaderSize = 16;  // Magic, FormatVersion, reserved
+const size_t ChunkHeaderSize = 16; // Codec, StoredSize, RawSize, NumAccesses
+const size_t IndexEntrySize = 16;  // Offset, FirstAccess
+const size_t FooterSize = 24;      // IndexOffset, NumChunks, FooterMagic
+
+// Largest payload of a chunk before compression
+const size_t MaxChunkSize = 1 << 20;
+// Largest access record, four 64-bit varints
+const size_t MaxRecordSize = 40;
+
+struct ChunkHeader {
+  uint32_t Codec;
+  // Bytes of the payload in the file
+  uint32_t StoredSize;
+  // Bytes of the payload once decompressed
+  uint32_t RawSize;
+  uint32_t NumAccesses;
+};
+
+struct Record {
+  uint32_t Core;
+  AccessKind Kind;
+  uint64_t Addr;
+  bool Tagged;
+  // Linear instance of the node and static instruction, if Tagged
+  uint64_t Instance;
+  uint32_t Instruction;
+};
+
+struct IndexEntry {
+  // Offset of the chunk header in the file
+  uint64_t Offset;
+  // Number of the accesses of the trace before the chunk
+  uint64_t FirstAccess;
+};
+
+//===--------------------------- Integer coding ---------------------------===//
+
+inline void put32(uint8_t *P, uint32_t V) {
+  for (unsigned I = 0; I < 4; ++I)
+    P[I] = uint8_t(V >> (8 * I));
+}
+
+inline void put64(uint8_t *P, uint64_t V) {
+  for (unsigned I = 0; I < 8; ++I)
+    P[I] = uint8_t(V >> (8 * I));
+}
+
+inline uint32_t get32(const uint8_t *P) {
+  uint32_t V = 0;
+  for (unsigned I = 0; I < 4; ++I)
+    V |= uint32_t(P[I]) << (8 * I);
+  return V;
+}
+
+inline uint64_t get64(const uint8_t *P) {
+  uint64_t V = 0;
+  for (unsigned I = 0; I < 8; ++I)
+    V |= uint64_t(P[I]) << (8 * I);
+  return V;
+}
+
+// Writes V in 7-bit groups, least significant first, and returns the end
+inline uint8_t *putVarint(uint8_t *P, uint64_t V) {
+  while (V >= 0x80) {
+    *P++ = uint8_t(V) | 0x80;
+    V >>= 7;
+  }
+  *P++ = uint8_t(V);
+  return P;
+}
+
+// Reads a varint from [P, End) into V. Returns its end, or NULL if it is
+// truncated or longer than 64 bits.
+inline const uint8_t *getVarint(const uint8_t *P, const uint8_t *End,
+                                uint64_t &V) {
+  V = 0;
+  for (unsigned Shift = 0; Shift < 64 && P != End; Shift += 7) {
+    uint8_t Byte = *P++;
+    V |= uint64_t(Byte & 0x7F) << Shift;
+    if (!(Byte & 0x80))
+      return P;
+  }
+  return NULL;
+}
+
+// Maps small negative deltas to small varints
+inline uint64_t zigzag(uint64_t Delta) {
+  return (Delta << 1) ^ (0 - (Delta >> 63));
+}
+
+inline uint64_t unzigzag(uint64_t V) { return (V >> 1) ^ (0 - (V & 1)); }
+
+//===------------------------------ LZ codec ------------------------------===//
+//
+// Byte-oriented LZ77 in the style of LZ4 blocks. A block is a sequence of
+//
+//   Token [LiteralLength+] Literals [Offset MatchLength+]
+//
+// where the high and low nibbles of Token are the literal length and the
+// match length minus MinMatch, 15 meaning that bytes follow which are added to
+// it until one is not 255. Offset is 2 bytes back from the current output.
+// The last sequence has literals only.
+//
+//===----------------------------------------------------------------------===//
+
+const size_t LZMinMatch = 4;
+const size_t LZMaxOffset = 0xFFFF;
+const unsigned LZHashBits = 14;
+
+inline void lzPutLength(std::vector<uint8_t> &Out, size_t Length) {
+  for (; Length >= 255; Length -= 255)
+    Out.push_back(255);
+  Out.push_back(uint8_t(Length));
+}
+
+inline void lzPutSequence(std::vector<uint8_t> &Out, const uint8_t *Literals,
+                          size_t NumLiterals, size_t Offset, size_t Match) {
+  size_t MatchCode = Match ? Match - LZMinMatch : 0;
+  uint8_t LiteralNibble = NumLiterals < 15 ? NumLiterals : 15;
+  uint8_t MatchNibble = MatchCode < 15 ? MatchCode : 15;
+  Out.push_back(uint8_t(LiteralNibble << 4 | MatchNibble));
+  if (LiteralNibble == 15)
+    lzPutLength(Out, NumLiterals - 15);
+  Out.insert(Out.end(), Literals, Literals + NumLiterals);
+  if (!Match)
+    return;
+  Out.push_back(uint8_t(Offset));
+  Out.push_back(uint8_t(Offset >> 8));
+  if (MatchNibble == 15)
+    lzPutLength(Out, MatchCode - 15);
+}
+
+// Appends the compressed form of [In, In + Size) to Out
+inline void lzCompress(const uint8_t *In, size_t Size,
+                       std::vector<uint8_t> &Out) {
+  // Position plus one of the last occurrence of each hashed 4-byte sequence
+  std::vector<uint32_t> Table(size_t(1) << LZHashBits, 0);
+  size_t Anchor = 0, I = 0;
+  while (I + LZMinMatch <= Size) {
+    uint32_t Sequence = get32(In + I);
+    uint32_t Hash = (Sequence * 2654435761u) >> (32 - LZHashBits);
+    size_t Candidate = Table[Hash];
+    Table[Hash] = uint32_t(I + 1);
+    if (!Candidate || I - (Candidate - 1) > LZMaxOffset ||
+        get32(In + Candidate - 1) != Sequence) {
+      ++I;
+      continue;
+    }
+    size_t From = Candidate - 1, Match = LZMinMatch;
+    while (I + Match < Size && In[From + Match] == In[I + Match])
+      ++Match;
+    lzPutSequence(Out, In + Anchor, I - Anchor, I - From, Match);
+    I += Match;
+    Anchor = I;
+  }
+  lzPutSequence(Out, In + Anchor, Size - Anchor, 0, 0);
+}
+
+inline const uint8_t *lzGetLength(const uint8_t *In, const uint8_t *End,
+                                  size_t &Length) {
+  uint8_t Byte;
+  do {
+    if (In == End)
+      return NULL;
+    Byte = *In++;
+    Length += Byte;
+  } while (Byte == 255);
+  return In;
+}
+
+// Decompresses [In, In + Size) into exactly RawSize bytes at Out. Returns
+// false if the block is malformed.
+inline bool lzDecompress(const uint8_t *In, size_t Size, uint8_t *Out,
+                         size_t RawSize) {
+  const uint8_t *End = In + Size;
+  uint8_t *Begin = Out, *OutEnd = Out + RawSize;
+  while (In != End) {
+    uint8_t Token = *In++;
+    size_t NumLiterals = Token >> 4;
+    if (NumLiterals == 15 && !(In = lzGetLength(In, End, NumLiterals)))
+      return false;
+    if (size_t(End - In) < NumLiterals || size_t(OutEnd - Out) < NumLiterals)
+      return false;
+    memcpy(Out, In, NumLiterals);
+    In += NumLiterals;
+    Out += NumLiterals;
+    if (In == End)
+      break;
+    if (End - In < 2)
+      return false;
+    size_t Offset = size_t(In[0]) | size_t(In[1]) << 8;
+    In += 2;
+    size_t Match = Token & 15;
+    if (Match == 15 && !(In = lzGetLength(In, End, Match)))
+      return false;
+    Match += LZMinMatch;
+    if (!Offset || Offset > size_t(Out - Begin) ||
+        size_t(OutEnd - Out) < Match)
+      return false;
+    // Byte by byte, since the match may overlap its own output
+    for (const uint8_t *From = Out - Offset; Match; --Match)
+      *Out++ = *From++;
+  }
+  return Out == OutEnd;
+}
+
+//===------------------------------- Chunks -------------------------------===//
+
+// Accumulates the records of one chunk
+class ChunkEncoder {
+public:
+  ChunkEncoder() { Raw.reserve(MaxChunkSize); }
+
+  void add(uint32_t Core, unsigned Kind, uint64_t Addr) {
+    uint8_t Bytes[MaxRecordSize];
+    uint8_t *P = putVarint(Bytes, uint64_t(Core) << KindBits | Kind);
+    P = putVarint(P, zigzag(Addr - PreviousAddr));
+    Raw.insert(Raw.end(), Bytes, P);
+    PreviousAddr = Addr;
+    ++NumAccesses;
+  }
+
+  void addTagged(uint32_t Core, unsigned Kind, uint64_t Addr,
+                 uint64_t Instance, uint32_t Instruction) {
+    uint8_t Bytes[MaxRecordSize];
+    uint8_t *P =
+        putVarint(Bytes, uint64_t(Core) << KindBits | TaggedBit | Kind);
+    P = putVarint(P, zigzag(Addr - PreviousAddr));
+    P = putVarint(P, zigzag(Instance - PreviousInstance));
+    P = putVarint(P, Instruction);
+    Raw.insert(Raw.end(), Bytes, P);
+    PreviousAddr = Addr;
+    PreviousInstance = Instance;
+    ++NumAccesses;
+  }
+
+  bool empty() const { return NumAccesses == 0; }
+  // Whether another record may not fit
+  bool full() const { return Raw.size() + MaxRecordSize > MaxChunkSize; }
+  uint32_t size() const { return NumAccesses; }
+
+  // Appends the chunk header and payload to Out, and starts a new chunk
+  void finish(std::vector<uint8_t> &Out, bool Compress) {
+    size_t Start = Out.size();
+    Out.resize(Start + ChunkHeaderSize);
+    uint32_t Codec = CodecNone;
+    if (Compress) {
+      lzCompress(Raw.data(), Raw.size(), Out);
+      if (Out.size() - Start - ChunkHeaderSize < Raw.size())
+        Codec = CodecLZ;
+      else
+        Out.resize(Start + ChunkHeaderSize);
+    }
+    if (Codec == CodecNone)
+      Out.insert(Out.end(), Raw.begin(), Raw.end());
+    uint8_t *Header = &Out[Start];
+    put32(Header, Codec);
+    put32(Header + 4, uint32_t(Out.size() - Start - ChunkHeaderSize));
+    put32(Header + 8, uint32_t(Raw.size()));
+    put32(Header + 12, NumAccesses);
+    Raw.clear();
+    PreviousAddr = 0;
+    PreviousInstance = 0;
+    NumAccesses = 0;
+  }
+
+private:
+  std::vector<uint8_t> Raw;
+  uint64_t PreviousAddr = 0;
+  uint64_t PreviousInstance = 0;
+  uint32_t NumAccesses = 0;
+};
+
+inline ChunkHeader getChunkHeader(const uint8_t *P) {
+  ChunkHeader H;
+  H.Codec = get32(P);
+  H.StoredSize = get32(P + 4);
+  H.RawSize = get32(P + 8);
+  H.NumAccesses = get32(P + 12);
+  return H;
+}
+
+// Calls Callback(const Record &) on the records of the decompressed payload
+// [P, P + Size). Returns false if it does not hold exactly NumAccesses
+// records.
+template <class F>
+inline bool decodeChunk(const uint8_t *P, size_t Size, uint32_t NumAccesses,
+                        F Callback) {
+  const uint8_t *End = P + Size;
+  Record R = Record();
+  for (uint32_t I = 0; I < NumAccesses; ++I) {
+    uint64_t Head, Delta;
+    if (!(P = getVarint(P, End, Head)) || !(P = getVarint(P, End, Delta)))
+      return false;
+    R.Core = uint32_t(Head >> KindBits);
+    R.Kind = AccessKind(Head & Store);
+    R.Addr += unzigzag(Delta);
+    R.Tagged = Head & TaggedBit;
+    if (R.Tagged) {
+      uint64_t Instruction;
+      if (!(P = getVarint(P, End, Delta)) ||
+          !(P = getVarint(P, End, Instruction)))
+        return false;
+      R.Instance += unzigzag(Delta);
+      R.Instruction = uint32_t(Instruction);
+    }
+    Callback(R);
+  }
+  return P == End;
+}
+
+//===------------------------------- Files --------------------------------===//
+
+// Writes a trace to a stdio file. Not thread-safe; threads that encode their
+// own chunks hand them to writeChunk under a lock.
+class FileWriter {
+public:
+  FileWriter(FILE *File, bool Compress) : File(File), Compress(Compress) {
+    uint8_t Header[FileHeaderSize] = {0};
+    memcpy(Header, FileMagic, sizeof(FileMagic));
+    put32(Header + 8, FormatVersion);
+    write(Header, FileHeaderSize);
+  }
+
+  void add(uint32_t Core, unsigned Kind, uint64_t Addr) {
+    Encoder.add(Core, Kind, Addr);
+    if (Encoder.full())
+      flush();
+  }
+
+  // Writes the last chunk, the index and the footer. Returns false if any
+  // write to the file failed.
+  bool finish() {
+    flush();
+    uint64_t IndexOffset = Offset;
+    std::vector<uint8_t> Bytes(Index.size() * IndexEntrySize + FooterSize);
+    uint8_t *P = Bytes.data();
+    for (const IndexEntry &Entry : Index) {
+      put64(P, Entry.Offset);
+      put64(P + 8, Entry.FirstAccess);
+      P += IndexEntrySize;
+    }
+    put64(P, IndexOffset);
+    put64(P + 8, Index.size());
+    memcpy(P + 16, FooterMagic, sizeof(FooterMagic));
+    write(Bytes.data(), Bytes.size());
+    return !Failed;
+  }
+
+  // Appends a chunk finished by a ChunkEncoder
+  void writeChunk(const uint8_t *Chunk, size_t Size, uint32_t ChunkAccesses) {
+    Index.push_back({Offset, NumAccesses});
+    NumAccesses += ChunkAccesses;
+    write(Chunk, Size);
+  }
+
+private:
+  void flush() {
+    if (Encoder.empty())
+      return;
+    uint32_t ChunkAccesses = Encoder.size();
+    Bytes.clear();
+    Encoder.finish(Bytes, Compress);
+    writeChunk(Bytes.data(), Bytes.size(), ChunkAccesses);
+  }
+
+  void write(const uint8_t *Data, size_t Size) {
+    if (fwrite(Data, 1, Size, File) != Size)
+      Failed = true;
+    Offset += Size;
+  }
+
+  FILE *File;
+  bool Compress;
+  bool Failed = false;
+  ChunkEncoder Encoder;
+  std::vector<uint8_t> Bytes;
+  std::vector<IndexEntry> Index;
+  uint64_t Offset = 0;
+  uint64_t NumAccesses = 0;
+};
+
+} // namespace trace
+} // namespace hpvm
+
+#endif // HPVM_TRACE_HEADER
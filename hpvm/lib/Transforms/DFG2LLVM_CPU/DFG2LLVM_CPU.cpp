@@ -14,6 +14,7 @@
 
 #define DEBUG_TYPE "DFG2LLVM_CPU"
 #include "SupportHPVM/DFG2LLVM.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/InstIterator.h"
@@ -42,6 +43,18 @@ using namespace dfg2llvm;
 static cl::opt<bool> HPVMTimer_CPU("hpvm-timers-cpu",
                                    cl::desc("Enable hpvm timers"));
 
+// HPVM Command line option to run independent children of an internal node
+// as concurrent runtime tasks instead of one after the other
+static cl::opt<bool> HPVMConcurrentChildren_CPU(
+    "hpvm-cpu-concurrent-children",
+    cl::desc("Run independent sibling nodes as parallel tasks"));
+
+// HPVM Command line option to let the runtime specialize replicated leaf nodes
+// for the scalar arguments and dimension limits they are actually called with
+static cl::opt<bool> HPVMJITLeaves_CPU(
+    "hpvm-cpu-jit-leaves",
+    cl::desc("Specialize replicated leaf nodes at run time"));
+
 namespace {
 
 // DFG2LLVM_CPU - The first implementation.
@@ -85,17 +98,50 @@ private:
   FunctionCallee llvm_hpvm_cpu_dstack_pop;
   FunctionCallee llvm_hpvm_cpu_getDimLimit;
   FunctionCallee llvm_hpvm_cpu_getDimInstance;
+  FunctionCallee llvm_hpvm_cpu_taskgraph_create;
+  FunctionCallee llvm_hpvm_cpu_task_create;
+  FunctionCallee llvm_hpvm_cpu_task_depends;
+  FunctionCallee llvm_hpvm_cpu_task_submit;
+  FunctionCallee llvm_hpvm_cpu_taskgraph_wait;
+  FunctionCallee llvm_hpvm_policy_init;
+  FunctionCallee llvm_hpvm_policy_getVersion;
+  FunctionCallee llvm_hpvm_policy_endVersion;
+  FunctionCallee llvm_hpvm_policy_clear;
+  FunctionCallee llvm_hpvm_coexec_start;
+  FunctionCallee llvm_hpvm_coexec_cpuBegin;
+  FunctionCallee llvm_hpvm_coexec_end;
+  FunctionCallee llvm_hpvm_cpu_jit_lookup;
+
+  // Calls to __hpvm__init and __hpvm__cleanup. The policy runtime is
+  // initialized and cleared around them once the first dispatch stub is
+  // generated.
+  Instruction *InitCall;
+  Instruction *CleanupCall;
+  bool PolicyInitialized;
 
   // Functions
   std::vector<IntrinsicInst *> *getUseList(Value *LI);
-  Value *addLoop(Instruction *I, Value *limit, const Twine &indexName = "");
+  Value *addLoop(Instruction *I, Value *limit, const Twine &indexName = "",
+                 Value *start = nullptr);
   void addWhileLoop(Instruction *, Instruction *, Instruction *, Value *);
   Instruction *addWhileLoopCounter(BasicBlock *, BasicBlock *, BasicBlock *);
   Argument *getArgumentFromEnd(Function *F, unsigned offset);
   Value *getInValueAt(DFNode *Child, unsigned i, Function *ParentF_CPU,
                       Instruction *InsertBefore);
   void invokeChild_CPU(DFNode *C, Function *F_CPU, ValueToValueMapTy &VMap,
-                       Instruction *InsertBefore);
+                       Instruction *InsertBefore, bool CoExecX = false);
+  CallInst *createChildCall(DFNode *C, std::vector<Value *> &Args,
+                            ValueToValueMapTy &VMap, Instruction *InsertBefore,
+                            bool CoExecX = false);
+  GlobalVariable *getLeafBitcode(Function *F);
+  Value *getSpecializedFunction(Function *F, std::vector<Value *> &Args,
+                                std::vector<Value *> &Limits,
+                                Instruction *InsertBefore);
+  bool hasIndependentChildren(DFInternalNode *N);
+  Function *createChildTask(DFNode *C, StructType *FrameTy,
+                            DenseMap<DFNode *, unsigned> &FrameIdx);
+  void invokeChildrenAsTasks_CPU(DFInternalNode *N, Function *F_CPU,
+                                 Instruction *InsertBefore);
   void invokeChild_PTX(DFNode *C, Function *F_CPU, ValueToValueMapTy &VMap,
                        Instruction *InsertBefore);
   StructType *getArgumentListStructTy(DFNode *);
@@ -104,11 +150,16 @@ private:
                        DenseMap<DFEdge *, Value *>, Value *, Value *,
                        Instruction *);
   Function *createLaunchFunction(DFInternalNode *);
+  bool isCoExecutable(DFInternalNode *N);
+  Function *createCoExecFunction(DFNode *N, Function *GF, StructType *ArgsTy);
+  Function *createDispatchFunction(DFInternalNode *N, Function *CF,
+                                   Function *GF);
 
   // Virtual Functions
   void init() {
     HPVMTimer = HPVMTimer_CPU;
     TargetName = "CPU";
+    PolicyInitialized = false;
   }
   void initRuntimeAPI();
   void codeGen(DFInternalNode *N);
@@ -200,6 +251,19 @@ void CGT_CPU::initRuntimeAPI() {
   DECLARE(llvm_hpvm_cpu_dstack_pop);
   DECLARE(llvm_hpvm_cpu_getDimLimit);
   DECLARE(llvm_hpvm_cpu_getDimInstance);
+  DECLARE(llvm_hpvm_cpu_taskgraph_create);
+  DECLARE(llvm_hpvm_cpu_task_create);
+  DECLARE(llvm_hpvm_cpu_task_depends);
+  DECLARE(llvm_hpvm_cpu_task_submit);
+  DECLARE(llvm_hpvm_cpu_taskgraph_wait);
+  DECLARE(llvm_hpvm_policy_init);
+  DECLARE(llvm_hpvm_policy_getVersion);
+  DECLARE(llvm_hpvm_policy_endVersion);
+  DECLARE(llvm_hpvm_policy_clear);
+  DECLARE(llvm_hpvm_coexec_start);
+  DECLARE(llvm_hpvm_coexec_cpuBegin);
+  DECLARE(llvm_hpvm_coexec_end);
+  DECLARE(llvm_hpvm_cpu_jit_lookup);
 
   // Get or insert timerAPI functions as well if you plan to use timers
   initTimerAPI();
@@ -209,11 +273,13 @@ void CGT_CPU::initRuntimeAPI() {
   assert(VI->getNumUses() == 1 && "__hpvm__init should only be used once");
   DEBUG(errs() << "Inserting cpu timer initialization\n");
   Instruction *I = cast<Instruction>(*VI->user_begin());
+  InitCall = I;
   initializeTimerSet(I);
   switchToTimer(hpvm_TimerID_NONE, I);
   // Insert print instruction at hpvm exit
   Function *VC = M.getFunction("llvm.hpvm.cleanup");
   assert(VC->getNumUses() == 1 && "__hpvm__cleanup should only be used once");
+  CleanupCall = cast<Instruction>(*VC->user_begin());
 
   DEBUG(errs() << "Inserting cpu timer print\n");
   printTimerSet(I);
@@ -316,7 +382,8 @@ Instruction *CGT_CPU::addWhileLoopCounter(BasicBlock *Entry, BasicBlock *Cond,
  * which loops over bidy if true and goes to end if false
  * (5) Update phi node of body
  */
-Value *CGT_CPU::addLoop(Instruction *I, Value *limit, const Twine &indexName) {
+Value *CGT_CPU::addLoop(Instruction *I, Value *limit, const Twine &indexName,
+                        Value *start) {
   BasicBlock *Entry = I->getParent();
   BasicBlock *ForBody = Entry->splitBasicBlock(I, "for.body");
 
@@ -333,9 +400,20 @@ Value *CGT_CPU::addLoop(Instruction *I, Value *limit, const Twine &indexName) {
   PHINode *IndexPhi = PHINode::Create(Type::getInt64Ty(I->getContext()), 2,
                                       "index." + indexName, I);
 
-  // Add incoming edge to phi
-  IndexPhi->addIncoming(ConstantInt::get(Type::getInt64Ty(I->getContext()), 0),
-                        Entry);
+  // Add incoming edge to phi. The loop starts at 0 unless a start index is
+  // given, in which case the loop is skipped when the start is not below the
+  // limit.
+  if (start) {
+    CmpInst *Guard =
+        CmpInst::Create(Instruction::ICmp, CmpInst::ICMP_ULT, start, limit,
+                        "guard." + indexName, Entry->getTerminator());
+    ReplaceInstWithInst(Entry->getTerminator(),
+                        BranchInst::Create(ForBody, ForEnd, Guard));
+    IndexPhi->addIncoming(start, Entry);
+  } else {
+    IndexPhi->addIncoming(
+        ConstantInt::get(Type::getInt64Ty(I->getContext()), 0), Entry);
+  }
   // Increment index variable
   BinaryOperator *IndexInc = BinaryOperator::Create(
       Instruction::Add, IndexPhi,
@@ -895,7 +973,8 @@ Value *CGT_CPU::getInValueAt(DFNode *Child, unsigned i, Function *ParentF_CPU,
 }
 
 void CGT_CPU::invokeChild_CPU(DFNode *C, Function *F_CPU,
-                              ValueToValueMapTy &VMap, Instruction *IB) {
+                              ValueToValueMapTy &VMap, Instruction *IB,
+                              bool CoExecX) {
   Function *CF = C->getFuncPointer();
 
   //  Function* CF_CPU = C->getGenFunc();
@@ -915,7 +994,21 @@ void CGT_CPU::invokeChild_CPU(DFNode *C, Function *F_CPU,
     Args.push_back(getInValueAt(C, i, F_CPU, IB));
   }
 
-  Value *I64Zero = ConstantInt::get(Type::getInt64Ty(F_CPU->getContext()), 0);
+  CallInst *CI = createChildCall(C, Args, VMap, IB, CoExecX);
+  OutputMap[C] = CI;
+}
+
+// Create the call to the CPU function of child node C with the given node
+// arguments, wrapped in one loop per replicated dimension and in the depth
+// stack push/pop. VMap maps the arguments of the parent node function to the
+// values available at InsertBefore, and is used to find the dimension limits.
+CallInst *CGT_CPU::createChildCall(DFNode *C, std::vector<Value *> &Args,
+                                   ValueToValueMapTy &VMap, Instruction *IB,
+                                   bool CoExecX) {
+  Function *CF = C->getFuncPointer();
+  Function *CF_CPU = C->getGenFuncForTarget(hpvm::CPU_TARGET);
+
+  Value *I64Zero = ConstantInt::get(Type::getInt64Ty(CF_CPU->getContext()), 0);
   for (unsigned j = 0; j < 6; j++)
     Args.push_back(I64Zero);
 
@@ -923,16 +1016,8 @@ void CGT_CPU::invokeChild_CPU(DFNode *C, Function *F_CPU,
   DEBUG(errs() << "Node Function type: " << *CF->getType() << "\n");
   DEBUG(errs() << "Arguments: " << Args.size() << "\n");
 
-  // Call the F_CPU function associated with this node
-  CallInst *CI =
-      CallInst::Create(CF_CPU, Args, CF_CPU->getName() + "_output", IB);
-  DEBUG(errs() << *CI << "\n");
-  OutputMap[C] = CI;
-
-  // Find num of dimensions this node is replicated in.
-  // Based on number of dimensions, insert loop instructions
-  std::string varNames[3] = {"x", "y", "z"};
-  unsigned numArgs = CI->getNumArgOperands();
+  // Find num of dimensions this node is replicated in, and the limit of each.
+  std::vector<Value *> Limits;
   for (unsigned j = 0; j < C->getNumOfDim(); j++) {
     Value *indexLimit = NULL;
     // Limit can either be a constant or an arguement of the internal node.
@@ -949,8 +1034,32 @@ void CGT_CPU::invokeChild_CPU(DFNode *C, Function *F_CPU,
                    << "  indexLimit type = " << *indexLimit->getType() << "\n");
     }
     assert(indexLimit && "Invalid dimension limit!");
+    Limits.push_back(indexLimit);
+  }
+
+  // Call the F_CPU function associated with this node, or the version of it
+  // the runtime specialized for the actual arguments, if there is one
+  Value *Callee = CF_CPU;
+  if (HPVMJITLeaves_CPU && isa<DFLeafNode>(C) && !Limits.empty())
+    Callee = getSpecializedFunction(CF_CPU, Args, Limits, IB);
+  CallInst *CI = CallInst::Create(CF_CPU->getFunctionType(), Callee, Args,
+                                  CF_CPU->getName() + "_output", IB);
+  DEBUG(errs() << *CI << "\n");
+
+  // Based on number of dimensions, insert loop instructions
+  std::string varNames[3] = {"x", "y", "z"};
+  unsigned numArgs = CI->getNumArgOperands();
+  for (unsigned j = 0; j < C->getNumOfDim(); j++) {
+    Value *indexLimit = Limits[j];
+    // When the node is co-executed, the device runs the leading instances in
+    // x and the loop starts after them
+    Value *indexStart = nullptr;
+    if (j == 0 && CoExecX)
+      indexStart = CallInst::Create(llvm_hpvm_coexec_cpuBegin,
+                                    ArrayRef<Value *>(indexLimit),
+                                    "index.x.begin", CI);
     // Insert loop
-    Value *indexVar = addLoop(CI, indexLimit, varNames[j]);
+    Value *indexVar = addLoop(CI, indexLimit, varNames[j], indexStart);
     DEBUG(errs() << "indexVar type = " << *indexVar->getType() << "\n");
     // Insert index variable and limit arguments
     CI->setArgOperand(numArgs - 6 + j, indexVar);
@@ -985,6 +1094,324 @@ void CGT_CPU::invokeChild_CPU(DFNode *C, Function *F_CPU,
   CallInst *Pop = CallInst::Create(llvm_hpvm_cpu_dstack_pop, None, "", NextI);
   DEBUG(errs() << "Pop from stack: " << *Pop << "\n");
   DEBUG(errs() << *CI->getParent()->getParent());
+  return CI;
+}
+
+// Returns true if leaf argument type Ty is replaced by a constant when the
+// runtime specializes the leaf. The runtime JIT follows the same rule.
+static bool isSpecializedArgTy(Type *Ty) {
+  if (Ty->isIntegerTy())
+    return Ty->getIntegerBitWidth() <= 64;
+  return Ty->isHalfTy() || Ty->isFloatTy() || Ty->isDoubleTy();
+}
+
+// Returns a private global holding the bitcode of the CPU function F of a leaf
+// node, together with the functions it calls and the constants they read.
+// Every other global is only declared, and is resolved against the running
+// program when the runtime compiles the bitcode.
+GlobalVariable *CGT_CPU::getLeafBitcode(Function *F) {
+  std::string Name = (F->getName() + ".bc").str();
+  if (GlobalVariable *GV = M.getNamedGlobal(Name))
+    return GV;
+
+  SmallPtrSet<const GlobalValue *, 8> Needed;
+  std::vector<Function *> Worklist(1, F);
+  Needed.insert(F);
+  while (!Worklist.empty()) {
+    Function *G = Worklist.back();
+    Worklist.pop_back();
+    for (inst_iterator i = inst_begin(G), e = inst_end(G); i != e; ++i) {
+      for (Value *Op : i->operands()) {
+        GlobalValue *GV = dyn_cast<GlobalValue>(Op->stripPointerCasts());
+        if (!GV || GV->isDeclaration())
+          continue;
+        // A copy of a mutable global would not be shared with the program
+        if (GlobalVariable *GVar = dyn_cast<GlobalVariable>(GV))
+          if (!GVar->isConstant())
+            continue;
+        if (!Needed.insert(GV).second)
+          continue;
+        if (Function *Callee = dyn_cast<Function>(GV))
+          Worklist.push_back(Callee);
+      }
+    }
+  }
+
+  ValueToValueMapTy BCVMap;
+  std::unique_ptr<Module> LeafM =
+      CloneModule(M, BCVMap, [&Needed](const GlobalValue *GV) {
+        return Needed.count(GV) != 0;
+      });
+  SmallVector<char, 0> Buffer;
+  raw_svector_ostream OS(Buffer);
+  WriteBitcodeToFile(*LeafM, OS);
+
+  Constant *BC = ConstantDataArray::get(
+      M.getContext(),
+      makeArrayRef(reinterpret_cast<const uint8_t *>(Buffer.data()),
+                   Buffer.size()));
+  return new GlobalVariable(M, BC->getType(), true,
+                            GlobalValue::PrivateLinkage, BC, Name);
+}
+
+// Generate code that asks the runtime for a version of leaf function F
+// specialized for its scalar arguments in Args and the dimension limits in
+// Limits, and returns the function to call: the specialized version, or F
+// itself when the runtime has none.
+Value *CGT_CPU::getSpecializedFunction(Function *F, std::vector<Value *> &Args,
+                                       std::vector<Value *> &Limits,
+                                       Instruction *IB) {
+  LLVMContext &Ctx = M.getContext();
+  Type *Int64Ty = Type::getInt64Ty(Ctx);
+  Type *Int32Ty = Type::getInt32Ty(Ctx);
+  Type *i8PtrTy = Type::getInt8PtrTy(Ctx);
+
+  // The specialized values are passed to the runtime as i64: the scalar
+  // arguments of the node first, then the limit of each of the 3 dimensions
+  std::vector<Value *> Values;
+  for (unsigned i = 0; i < Args.size() - 6; i++) {
+    Value *V = Args[i];
+    Type *Ty = V->getType();
+    if (!isSpecializedArgTy(Ty))
+      continue;
+    if (Ty->isFloatingPointTy())
+      V = new BitCastInst(
+          V, IntegerType::get(Ctx, Ty->getPrimitiveSizeInBits()), "", IB);
+    if (V->getType() != Int64Ty)
+      V = new ZExtInst(V, Int64Ty, "", IB);
+    Values.push_back(V);
+  }
+  for (unsigned j = 0; j < 3; j++)
+    Values.push_back(j < Limits.size() ? Limits[j]
+                                       : ConstantInt::get(Int64Ty, 0));
+
+  ArrayType *ValuesTy = ArrayType::get(Int64Ty, Values.size());
+  AllocaInst *ValuesAddr =
+      new AllocaInst(ValuesTy, 0, F->getName() + ".jit.values",
+                     &IB->getFunction()->getEntryBlock().front());
+  Value *Zero = ConstantInt::get(Int32Ty, 0);
+  for (unsigned i = 0; i < Values.size(); i++) {
+    Value *Idx[] = {Zero, ConstantInt::get(Int32Ty, i)};
+    GetElementPtrInst *GEP = GetElementPtrInst::Create(
+        ValuesTy, ValuesAddr, ArrayRef<Value *>(Idx, 2), "", IB);
+    new StoreInst(Values[i], GEP, IB);
+  }
+  Value *Idx[] = {Zero, Zero};
+  GetElementPtrInst *ValuesPtr =
+      GetElementPtrInst::Create(ValuesTy, ValuesAddr,
+                                ArrayRef<Value *>(Idx, 2), "", IB);
+
+  GlobalVariable *BC = getLeafBitcode(F);
+  Value *LookupArgs[] = {
+      getStringPointer(F->getName(), IB, F->getName() + ".name"),
+      ConstantExpr::getPointerCast(BC, i8PtrTy),
+      ConstantInt::get(Int64Ty,
+                       BC->getValueType()->getArrayNumElements()),
+      ValuesPtr, ConstantInt::get(Int32Ty, Values.size())};
+  CallInst *Lookup = CallInst::Create(llvm_hpvm_cpu_jit_lookup,
+                                      ArrayRef<Value *>(LookupArgs, 5),
+                                      F->getName() + ".jit", IB);
+  CmpInst *IsGeneric = CmpInst::Create(
+      Instruction::ICmp, CmpInst::ICMP_EQ, Lookup,
+      ConstantPointerNull::get(cast<PointerType>(i8PtrTy)),
+      F->getName() + ".generic", IB);
+  BitCastInst *Specialized = new BitCastInst(Lookup, F->getType(), "", IB);
+  return SelectInst::Create(IsGeneric, F, Specialized,
+                            F->getName() + ".version", IB);
+}
+
+// Returns true if the child graph of N has two children with no path between
+// them. Rank is the length of the longest path from the entry node, so
+// children with the same rank can never depend on each other.
+bool CGT_CPU::hasIndependentChildren(DFInternalNode *N) {
+  std::set<unsigned> Ranks;
+  for (DFGraph::children_iterator ci = N->getChildGraph()->begin(),
+                                  ce = N->getChildGraph()->end();
+       ci != ce; ++ci) {
+    DFNode *C = *ci;
+    if (C->isDummyNode())
+      continue;
+    if (!Ranks.insert(C->getRank()).second)
+      return true;
+  }
+  return false;
+}
+
+// Create the task function of child node C, of type i8* (i8*). The argument
+// points to the frame of the parent invocation, which holds the arguments of
+// the parent node followed by one output struct per child. The task reads its
+// inputs from the frame, invokes C and writes the output of C back to its slot.
+Function *CGT_CPU::createChildTask(DFNode *C, StructType *FrameTy,
+                                   DenseMap<DFNode *, unsigned> &FrameIdx) {
+  Function *CF = C->getFuncPointer();
+  Function *PF = C->getParent()->getFuncPointer();
+
+  Type *i8Ty = Type::getInt8Ty(M.getContext());
+  FunctionType *TaskFuncTy = FunctionType::get(
+      i8Ty->getPointerTo(), ArrayRef<Type *>(i8Ty->getPointerTo()), false);
+  Function *TaskF = Function::Create(TaskFuncTy, GlobalValue::InternalLinkage,
+                                     CF->getName() + "_task", &M);
+  Value *data = &*TaskF->arg_begin();
+  data->setName("frame.addr");
+  BasicBlock *BB = BasicBlock::Create(TaskF->getContext(), "entry", TaskF);
+  ReturnInst *RI =
+      ReturnInst::Create(TaskF->getContext(),
+                         Constant::getNullValue(TaskF->getReturnType()), BB);
+
+  CastInst *Frame = CastInst::CreatePointerCast(
+      data, FrameTy->getPointerTo(), "frame", RI);
+  Value *IntZero = ConstantInt::get(Type::getInt32Ty(M.getContext()), 0);
+  auto getFrameField = [&](unsigned idx, const Twine &Name) {
+    Value *GEPIdx[] = {IntZero,
+                       ConstantInt::get(Type::getInt32Ty(M.getContext()), idx)};
+    return GetElementPtrInst::Create(FrameTy, Frame,
+                                     ArrayRef<Value *>(GEPIdx, 2), Name, RI);
+  };
+
+  // Load the arguments of the parent node. Dimension limits of C are either
+  // constants or arguments of the parent, so this mapping is all that
+  // createChildCall needs.
+  ValueToValueMapTy VMap;
+  for (Function::arg_iterator ai = PF->arg_begin(), ae = PF->arg_end();
+       ai != ae; ++ai) {
+    GetElementPtrInst *GEP =
+        getFrameField(ai->getArgNo(), ai->getName() + ".addr");
+    VMap[&*ai] = new LoadInst(GEP, ai->getName(), RI);
+  }
+
+  // Collect the inputs of C from the parent arguments and sibling outputs
+  std::vector<Value *> Args;
+  DenseMap<DFNode *, Value *> SrcOutputs;
+  for (unsigned i = 0; i < CF->getFunctionType()->getNumParams(); i++) {
+    DFEdge *E = C->getInDFEdgeAt(i);
+    assert(E && "No incoming edge at input port of child node!");
+    DFNode *SrcDF = E->getSourceDF();
+    if (SrcDF->isEntryNode()) {
+      Args.push_back(VMap[&*(PF->arg_begin() + E->getSourcePosition())]);
+    } else {
+      assert(FrameIdx.count(SrcDF) &&
+             "Source node has no output slot. Dependency violation!");
+      if (!SrcOutputs.count(SrcDF)) {
+        GetElementPtrInst *GEP = getFrameField(
+            FrameIdx[SrcDF], SrcDF->getFuncPointer()->getName() + ".out.addr");
+        SrcOutputs[SrcDF] =
+            new LoadInst(GEP, SrcDF->getFuncPointer()->getName() + ".out", RI);
+      }
+      std::vector<unsigned> IndexList;
+      IndexList.push_back(E->getSourcePosition());
+      Args.push_back(
+          ExtractValueInst::Create(SrcOutputs[SrcDF], IndexList, "", RI));
+    }
+  }
+
+  CallInst *CI = createChildCall(C, Args, VMap, RI);
+
+  // Publish the output of C in the frame, right after the call so that it
+  // stays inside the loops over the replicated dimensions
+  Instruction *AfterCall = CI->getNextNode();
+  Value *OutIdx[] = {IntZero, ConstantInt::get(Type::getInt32Ty(M.getContext()),
+                                               FrameIdx[C])};
+  GetElementPtrInst *OutGEP =
+      GetElementPtrInst::Create(FrameTy, Frame, ArrayRef<Value *>(OutIdx, 2),
+                                CF->getName() + ".out.addr", AfterCall);
+  new StoreInst(CI, OutGEP, AfterCall);
+
+  DEBUG(errs() << "Task function for " << CF->getName() << ":\n");
+  DEBUG(errs() << *TaskF << "\n");
+  return TaskF;
+}
+
+// Invoke the children of N as a graph of runtime tasks. Every child becomes a
+// task which depends on the tasks of the siblings it has incoming edges from.
+// Independent children therefore run concurrently, and the parent waits for
+// the whole graph before producing its outputs.
+void CGT_CPU::invokeChildrenAsTasks_CPU(DFInternalNode *N, Function *F_CPU,
+                                        Instruction *IB) {
+  Function *F = N->getFuncPointer();
+
+  // Frame layout: arguments of N, then the output struct of each child
+  std::vector<Type *> TyList;
+  for (Function::arg_iterator ai = F->arg_begin(), ae = F->arg_end(); ai != ae;
+       ++ai) {
+    TyList.push_back(ai->getType());
+  }
+  DenseMap<DFNode *, unsigned> FrameIdx;
+  std::vector<DFNode *> Children;
+  for (DFGraph::children_iterator ci = N->getChildGraph()->begin(),
+                                  ce = N->getChildGraph()->end();
+       ci != ce; ++ci) {
+    DFNode *C = *ci;
+    if (C->isDummyNode())
+      continue;
+    FrameIdx[C] = TyList.size();
+    TyList.push_back(C->getOutputType());
+    Children.push_back(C);
+  }
+  StructType *FrameTy = StructType::create(
+      M.getContext(), ArrayRef<Type *>(TyList),
+      (F->getName() + ".frame.ty").str());
+
+  // The frame lives on the stack of the parent, which outlives all tasks
+  BasicBlock &EntryBB = F_CPU->getEntryBlock();
+  AllocaInst *Frame =
+      new AllocaInst(FrameTy, 0, F->getName() + ".frame", &*EntryBB.begin());
+  Value *IntZero = ConstantInt::get(Type::getInt32Ty(M.getContext()), 0);
+  auto getFrameField = [&](unsigned idx, const Twine &Name) {
+    Value *GEPIdx[] = {IntZero,
+                       ConstantInt::get(Type::getInt32Ty(M.getContext()), idx)};
+    return GetElementPtrInst::Create(FrameTy, Frame,
+                                     ArrayRef<Value *>(GEPIdx, 2), Name, IB);
+  };
+  for (unsigned i = 0; i < F->getFunctionType()->getNumParams(); i++) {
+    Argument *Arg = getArgumentAt(F_CPU, i);
+    new StoreInst(Arg, getFrameField(i, Arg->getName() + ".addr"), IB);
+  }
+  CastInst *FrameI8 = CastInst::CreatePointerCast(
+      Frame, Type::getInt8PtrTy(M.getContext()), "frame.i8", IB);
+
+  CallInst *Graph = CallInst::Create(llvm_hpvm_cpu_taskgraph_create, None,
+                                     F->getName() + ".taskgraph", IB);
+
+  // Children are sorted topologically, so the tasks a child depends on have
+  // already been created when we reach it
+  DenseMap<DFNode *, Value *> Tasks;
+  for (DFNode *C : Children) {
+    Function *TaskF = createChildTask(C, FrameTy, FrameIdx);
+    Value *TaskArgs[] = {Graph, TaskF, FrameI8};
+    CallInst *Task = CallInst::Create(llvm_hpvm_cpu_task_create,
+                                      ArrayRef<Value *>(TaskArgs, 3),
+                                      C->getFuncPointer()->getName() + ".task",
+                                      IB);
+    Tasks[C] = Task;
+
+    std::set<DFNode *> Deps;
+    for (DFNode::indfedge_iterator ei = C->indfedge_begin(),
+                                   ee = C->indfedge_end();
+         ei != ee; ++ei) {
+      DFNode *SrcDF = (*ei)->getSourceDF();
+      if (SrcDF->isDummyNode() || !Deps.insert(SrcDF).second)
+        continue;
+      assert(Tasks.count(SrcDF) &&
+             "Source node task not found. Dependency violation!");
+      Value *DepArgs[] = {Task, Tasks[SrcDF]};
+      CallInst::Create(llvm_hpvm_cpu_task_depends,
+                       ArrayRef<Value *>(DepArgs, 2), "", IB);
+    }
+    CallInst::Create(llvm_hpvm_cpu_task_submit, ArrayRef<Value *>(Task), "",
+                     IB);
+  }
+
+  // Join at the exit node
+  CallInst::Create(llvm_hpvm_cpu_taskgraph_wait, ArrayRef<Value *>(Graph), "",
+                   IB);
+
+  // The outputs of the children are now available in the frame
+  for (DFNode *C : Children) {
+    GetElementPtrInst *GEP = getFrameField(
+        FrameIdx[C], C->getFuncPointer()->getName() + ".out.addr");
+    OutputMap[C] =
+        new LoadInst(GEP, C->getFuncPointer()->getName() + "_output", IB);
+  }
 }
 
 /* This function takes a DFNode, and creates a filter function for it. By filter
@@ -1257,17 +1684,25 @@ void CGT_CPU::codeGen(DFInternalNode *N) {
       ++dest_iterator;
     }
 
-    // Iterate over children in topological order
-    for (DFGraph::children_iterator ci = N->getChildGraph()->begin(),
-                                    ce = N->getChildGraph()->end();
-         ci != ce; ++ci) {
-      DFNode *C = *ci;
-      // Skip dummy node call
-      if (C->isDummyNode())
-        continue;
-
-      // Create calls to CPU function of child node
-      invokeChild_CPU(C, F_CPU, VMap, RI);
+    if (HPVMConcurrentChildren_CPU && hasIndependentChildren(N)) {
+      // Run children as a task graph, so that independent branches overlap
+      invokeChildrenAsTasks_CPU(N, F_CPU, RI);
+    } else {
+      // A node which can be co-executed splits the x dimension of its only
+      // child with the device
+      bool CoExecX = isCoExecutable(N);
+      // Iterate over children in topological order
+      for (DFGraph::children_iterator ci = N->getChildGraph()->begin(),
+                                      ce = N->getChildGraph()->end();
+           ci != ce; ++ci) {
+        DFNode *C = *ci;
+        // Skip dummy node call
+        if (C->isDummyNode())
+          continue;
+
+        // Create calls to CPU function of child node
+        invokeChild_CPU(C, F_CPU, VMap, RI, CoExecX);
+      }
     }
 
     DEBUG(errs() << "*** Generating epilogue code for the function****\n");
@@ -1398,10 +1833,219 @@ void CGT_CPU::codeGen(DFInternalNode *N) {
     DEBUG(errs() << "hascpuGenFuncForGPU : " << GFcpu << "\n");
 
   } else {
-    assert(false && "Multiple tags unsupported!");
+    // There is a CPU and a GPU version for this node. Generate a dispatch
+    // function which queries the runtime policy at every invocation and calls
+    // the selected version. The dispatch function becomes the CPU version.
+    assert(CF && CFcpu && GF && GFcpu &&
+           "Expected a CPU callable function for both targets!");
+    assert(CF->getFunctionType() == GF->getFunctionType() &&
+           "CPU and GPU versions must have the same type!");
+
+    Function *F_Dispatch = createDispatchFunction(N, CF, GF);
+    N->addGenFunc(F_Dispatch, hpvm::CPU_TARGET, true);
+    N->removeGenFuncForTarget(hpvm::GPU_TARGET);
+    N->setTag(hpvm::CPU_TARGET);
+
+    DEBUG(errs() << "After editing\n");
+    DEBUG(errs() << "Node: " << N->getFuncPointer()->getName() << " with tag "
+                 << N->getTag() << "\n");
+    DEBUG(errs() << "Dispatch Fun: " << F_Dispatch->getName() << "\n");
   }
 }
 
+// Returns true if the x dimension of the kernel launched by the GPU version of
+// N can be split between the device and the CPU version of N. The device runs
+// the leading instances of the only child of N, so the instance ids seen by
+// the kernel keep their values, but the kernel sees fewer instances in x: the
+// leaf must not ask for the number of instances of the split node in x.
+bool CGT_CPU::isCoExecutable(DFInternalNode *N) {
+  if (!N->getGenFuncForTarget(hpvm::GPU_TARGET) ||
+      !N->hasCPUGenFuncForTarget(hpvm::GPU_TARGET))
+    return false;
+  // Outputs of the kernel cannot be merged
+  StructType *OutTy = cast<StructType>(N->getFuncPointer()->getReturnType());
+  if (OutTy->getNumElements() != 0)
+    return false;
+
+  // Find the node replicated by the kernel launch and the kernel leaf
+  DFNode *Kernel = NULL;
+  for (DFNode *C : *N->getChildGraph()) {
+    if (C->isDummyNode())
+      continue;
+    if (Kernel)
+      return false;
+    Kernel = C;
+  }
+  if (!Kernel || Kernel->getNumOfDim() == 0)
+    return false;
+
+  DFNode *Leaf = Kernel;
+  bool TwoLevel = false;
+  if (DFInternalNode *KN = dyn_cast<DFInternalNode>(Kernel)) {
+    Leaf = NULL;
+    for (DFNode *C : *KN->getChildGraph()) {
+      if (C->isDummyNode())
+        continue;
+      if (Leaf || !isa<DFLeafNode>(C))
+        return false;
+      Leaf = C;
+    }
+    if (!Leaf)
+      return false;
+    TwoLevel = true;
+  }
+
+  // In a two level kernel, the leaf may only ask for its own number of
+  // instances, which is the work group size
+  for (inst_iterator i = inst_begin(Leaf->getFuncPointer()),
+                     e = inst_end(Leaf->getFuncPointer());
+       i != e; ++i) {
+    IntrinsicInst *II = dyn_cast<IntrinsicInst>(&*i);
+    if (!II || II->getIntrinsicID() != Intrinsic::hpvm_getNumNodeInstances_x)
+      continue;
+    IntrinsicInst *ArgII =
+        dyn_cast<IntrinsicInst>(II->getArgOperand(0)->stripPointerCasts());
+    if (!TwoLevel || !ArgII ||
+        ArgII->getIntrinsicID() != Intrinsic::hpvm_getNode) {
+      DEBUG(errs() << "Node " << N->getFuncPointer()->getName()
+                   << " cannot be co-executed: " << *II << "\n");
+      return false;
+    }
+  }
+  return true;
+}
+
+// Creates the function run in its own thread by the runtime to execute the
+// GPU version GF of node N while its CPU version runs. It takes the arguments
+// of GF packed in a struct of type ArgsTy.
+Function *CGT_CPU::createCoExecFunction(DFNode *N, Function *GF,
+                                        StructType *ArgsTy) {
+  LLVMContext &Ctx = M.getContext();
+  Type *I8PtrTy = Type::getInt8PtrTy(Ctx);
+  FunctionType *FTy = FunctionType::get(I8PtrTy, I8PtrTy, false);
+  Function *F_GPU =
+      Function::Create(FTy, GlobalValue::InternalLinkage,
+                       N->getFuncPointer()->getName() + "_coexec_gpu", &M);
+  Argument *ArgsI8 = &*F_GPU->arg_begin();
+  ArgsI8->setName("args.addr");
+
+  BasicBlock *BB = BasicBlock::Create(Ctx, "entry", F_GPU);
+  ReturnInst *RI =
+      ReturnInst::Create(Ctx, Constant::getNullValue(I8PtrTy), BB);
+  CastInst *ArgsPtr = CastInst::CreatePointerCast(
+      ArgsI8, ArgsTy->getPointerTo(), "args", RI);
+
+  std::vector<Value *> Args;
+  Value *I32Zero = ConstantInt::get(Type::getInt32Ty(Ctx), 0);
+  for (unsigned i = 0; i < ArgsTy->getNumElements(); i++) {
+    Value *GEPIdx[] = {I32Zero, ConstantInt::get(Type::getInt32Ty(Ctx), i)};
+    GetElementPtrInst *GEP =
+        GetElementPtrInst::Create(ArgsTy, ArgsPtr, GEPIdx, "", RI);
+    Args.push_back(new LoadInst(GEP, (GF->arg_begin() + i)->getName(), RI));
+  }
+  CallInst::Create(GF, Args, "", RI);
+  return F_GPU;
+}
+
+// Creates a function with the same type as the CPU and GPU versions of node N.
+// At each invocation, it increments the iteration count of N, asks the runtime
+// policy which version to run and forwards its arguments to that version.
+// Version 0 selects the CPU version, any other version the GPU one. If N can
+// be co-executed, the policy is told so, and version 3 runs the GPU version in
+// a runtime thread on the leading instances and the CPU version on the rest.
+// Version 2 is left to the GPU, as the older policies use it for the GPU.
+// Once the version returns, the runtime is notified so the policy can time it.
+Function *CGT_CPU::createDispatchFunction(DFInternalNode *N, Function *CF,
+                                          Function *GF) {
+  Function *F = N->getFuncPointer();
+  Function *F_Dispatch =
+      Function::Create(CF->getFunctionType(), GlobalValue::InternalLinkage,
+                       F->getName() + "_dispatch", &M);
+  for (Function::arg_iterator ai = CF->arg_begin(), ae = CF->arg_end(),
+                              di = F_Dispatch->arg_begin();
+       ai != ae; ++ai, ++di)
+    di->setName(ai->getName());
+
+  // The policy runtime is set up only if some node needs it
+  if (!PolicyInitialized) {
+    CallInst::Create(llvm_hpvm_policy_init, None, "", InitCall);
+    CallInst::Create(llvm_hpvm_policy_clear, None, "", CleanupCall);
+    PolicyInitialized = true;
+  }
+
+  bool CoExec = isCoExecutable(N);
+  LLVMContext &Ctx = M.getContext();
+  BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", F_Dispatch);
+  BasicBlock *CPUBB = BasicBlock::Create(Ctx, "version.cpu", F_Dispatch);
+  BasicBlock *GPUBB = BasicBlock::Create(Ctx, "version.gpu", F_Dispatch);
+  BasicBlock *CoExecBB =
+      CoExec ? BasicBlock::Create(Ctx, "version.coexec", F_Dispatch) : NULL;
+  Instruction *IB = new UnreachableInst(Ctx, Entry);
+
+  // Iteration count of this node, shared by all its invocations
+  Type *Int64Ty = Type::getInt64Ty(Ctx);
+  GlobalVariable *Iteration = new GlobalVariable(
+      M, Int64Ty, false, GlobalValue::InternalLinkage,
+      ConstantInt::get(Int64Ty, 0), F->getName() + ".iteration");
+  Value *It = new AtomicRMWInst(AtomicRMWInst::Add, Iteration,
+                                ConstantInt::get(Int64Ty, 1),
+                                AtomicOrdering::Monotonic, SyncScope::System,
+                                IB);
+  It->setName("iteration");
+
+  Value *Name = getStringPointer(F->getName(), IB, F->getName() + ".name");
+  Value *PolicyArgs[] = {Name, It,
+                         ConstantInt::get(Type::getInt32Ty(Ctx), CoExec)};
+  CallInst *Version = CallInst::Create(
+      llvm_hpvm_policy_getVersion, ArrayRef<Value *>(PolicyArgs, 3), "version",
+      IB);
+  IntegerType *VersionTy = cast<IntegerType>(Version->getType());
+  SwitchInst *SI = SwitchInst::Create(Version, GPUBB, CoExec ? 2 : 1, IB);
+  SI->addCase(ConstantInt::get(VersionTy, 0), CPUBB);
+  if (CoExec)
+    SI->addCase(ConstantInt::get(VersionTy, 3), CoExecBB);
+
+  std::vector<Value *> Args;
+  for (Argument &A : F_Dispatch->args())
+    Args.push_back(&A);
+
+  // Pack the arguments for the GPU version, which runs in its own thread
+  if (CoExec) {
+    StructType *ArgsTy = StructType::create(
+        Ctx, CF->getFunctionType()->params(), (F->getName() + ".args").str());
+    AllocaInst *ArgsAlloca =
+        new AllocaInst(ArgsTy, 0, "args", &Entry->front());
+    Value *I32Zero = ConstantInt::get(Type::getInt32Ty(Ctx), 0);
+    for (unsigned i = 0; i < Args.size(); i++) {
+      Value *GEPIdx[] = {I32Zero, ConstantInt::get(Type::getInt32Ty(Ctx), i)};
+      GetElementPtrInst *GEP =
+          GetElementPtrInst::Create(ArgsTy, ArgsAlloca, GEPIdx, "", CoExecBB);
+      new StoreInst(Args[i], GEP, CoExecBB);
+    }
+    CastInst *ArgsI8 = CastInst::CreatePointerCast(
+        ArgsAlloca, Type::getInt8PtrTy(Ctx), "args.i8", CoExecBB);
+    Value *StartArgs[] = {Name, createCoExecFunction(N, GF, ArgsTy), ArgsI8};
+    CallInst::Create(llvm_hpvm_coexec_start, StartArgs, "", CoExecBB);
+  }
+  IB->eraseFromParent();
+
+  BasicBlock *BBs[] = {CPUBB, GPUBB, CoExecBB};
+  Function *Versions[] = {CF, GF, CF};
+  for (unsigned i = 0; i < (CoExec ? 3 : 2); i++) {
+    CallInst *CI = CallInst::Create(Versions[i], Args, "", BBs[i]);
+    if (BBs[i] == CoExecBB)
+      CallInst::Create(llvm_hpvm_coexec_end, None, "", BBs[i]);
+    CallInst::Create(llvm_hpvm_policy_endVersion, None, "", BBs[i]);
+    if (F_Dispatch->getReturnType()->isVoidTy())
+      ReturnInst::Create(Ctx, BBs[i]);
+    else
+      ReturnInst::Create(Ctx, CI, BBs[i]);
+  }
+
+  DEBUG(errs() << "Generated dispatch function: " << *F_Dispatch << "\n");
+  return F_Dispatch;
+}
+
 // Code generation for leaf nodes
 void CGT_CPU::codeGen(DFLeafNode *N) {
   // Skip code generation if it is a dummy node
@@ -1453,6 +1453,8 @@ void CGT_OpenCL::codeGen(DFLeafNode *N) {
         Value *Params[] = {Ptr, Val};
         CallInst *AtomCI = CallInst::Create(
             AtomFunc, ArrayRef<Value *>(Params, 2), II->getName(), II);
+        // Keep analysis hints, e.g. !spandex.req
+        AtomCI->copyMetadata(*II);
         DEBUG(errs() << "Substitute with: " << *AtomCI << "\n");
         II->replaceAllUsesWith(AtomCI);
         IItoRemove.push_back(II);
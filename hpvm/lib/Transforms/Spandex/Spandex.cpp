@@ -15,14 +15,78 @@ Anticipate errors related to intrinsics not found. Compile for real with
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ToolOutputFile.h"
 #include "BuildDFG/BuildDFG.h"
 #include "SupportHPVM/DFGraph.h"
 #include "Spandex/Spandex.h"
 #include "hpvm_util.hpp"
 #include "spandex_util.hpp"
+#include "trace_util.hpp"
 
 using namespace spandex;
 
+static cl::opt<unsigned> SpandexThreads(
+    "spandex-threads",
+    cl::desc("Number of threads analyzing functions (0 for one per core)"),
+    cl::init(0));
+
+static cl::opt<std::string> SpandexHints(
+    "spandex-hints",
+    cl::desc("Write the table of Spandex hints as JSON to this file"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string> SpandexProfile(
+    "spandex-profile",
+    cl::desc("Decide the accesses measured in this JSON profile from their "
+             "measurements"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string> SpandexCacheDir(
+    "spandex-cache-dir",
+    cl::desc("Reuse the decisions of earlier runs cached in this directory"),
+    cl::value_desc("directory"), cl::init(""));
+
+static cl::opt<std::string> SpandexTraceNodes(
+    "spandex-trace-nodes",
+    cl::desc("Write the function of each node ID of -spandex-trace as JSON to "
+             "this file"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<float> SpandexSparseDensity(
+    "spandex-sparse-density",
+    cl::desc("Fraction of a buffer below which the stores or loads of a "
+             "producer/consumer pair are sparse enough to give up ownership"),
+    cl::init(0.25));
+
+// Hardware model. Sizes are in bytes and apply to the CPU and the GPU, unless
+// overridden by -spandex-hw.
+static cl::opt<unsigned> SpandexCacheSize(
+    "spandex-cache-size", cl::desc("Size of the private caches in bytes"),
+    cl::init(1024 * 1024));
+static cl::opt<unsigned> SpandexLineSize(
+    "spandex-line-size", cl::desc("Size of a cache line in bytes"),
+    cl::init(64));
+static cl::opt<unsigned> SpandexWordSize(
+    "spandex-word-size", cl::desc("Size of a word in bytes"), cl::init(8));
+static cl::opt<bool> SpandexOwnerPred(
+    "spandex-owner-pred", cl::desc("Caches support owner prediction"),
+    cl::init(false));
+static cl::opt<unsigned> SpandexCores(
+    "spandex-cores", cl::desc("Number of cores of each kind"), cl::init(1));
+static cl::opt<std::string> SpandexDistribution(
+    "spandex-distribution",
+    cl::desc("How the instances of a replicated node are spread over the "
+             "cores (block or cyclic)"),
+    cl::init("block"));
+static cl::opt<std::string> SpandexHW(
+    "spandex-hw",
+    cl::desc("Read per-target hardware parameters from this JSON file"),
+    cl::value_desc("filename"), cl::init(""));
+
 
 class Spandex::impl {
 public:
@@ -49,6 +113,11 @@ public:
     const std::vector<DFInternalNode *> roots = DFG.getRoots();
 
 	bool active = false;
+	json::Array hints;
+	const HardwareModel hardware = unwrap(getHardwareModel());
+	LLVM_DEBUG(dbgs() << "CPU: " << hardware.cpu << "\nGPU: " << hardware.gpu << "\n");
+	const Profile profile = unwrap(getProfile());
+	const DecisionCache cache{SpandexCacheDir};
     if (!roots.empty()) {
 	  active = true;
       for (const auto _root : roots) {
@@ -62,16 +131,83 @@ public:
         Digraph<Ref<llvm::DFNode>> coarse_leaf_dfg = get_coarse_leaf_dfg(leaf_dfg);
         //DUMP_GRAPHVIZ(coarse_leaf_dfg);
 
-        Digraph<Port> mem_comm_dfg = get_mem_comm_dfg(leaf_dfg, coarse_leaf_dfg);
+        Digraph<Port> mem_comm_dfg = get_mem_comm_dfg(leaf_dfg, CsrGraph<Ref<llvm::DFNode>>{coarse_leaf_dfg});
         DUMP_GRAPHVIZ_PORT_PTRS(mem_comm_dfg);
 
-		spandex_annotate(module, mem_comm_dfg);
+		spandex_annotate(module, mem_comm_dfg, get_bound_args(leaf_dfg), thisp, hardware, profile, SpandexSparseDensity, SpandexThreads,
+				SpandexCacheDir.empty() ? nullptr : &cache, hints);
       }
     }
+	if (!SpandexHints.empty()) {
+		writeHints(hardware, std::move(hints));
+	}
 	// No DFG. Nothing for us to do;
 	LLVM_DEBUG(dbgs() << "^^^^ Spandex ^^^^\n");
 	return active;
   }
+
+  ResultStr<HardwareModel> getHardwareModel() const {
+    auto ParsedDistribution =
+        Distribution::_from_string_nothrow(SpandexDistribution.c_str());
+    if (!ParsedDistribution) {
+      return Err(str{"Unknown distribution '"} + SpandexDistribution +
+                 str{"'"});
+    }
+    HardwareParams params{
+        .producer = false,
+        .owner_pred_available = SpandexOwnerPred,
+        .cache_size = TRY(HardwareModel::to_bits<uint64_t>(SpandexCacheSize,
+                                                           "Cache size")),
+        .block_size = TRY(HardwareModel::to_bits<unsigned short>(
+            SpandexLineSize, "Line size")),
+        .word_size = TRY(HardwareModel::to_bits<unsigned short>(
+            SpandexWordSize, "Word size")),
+        .cores = SpandexCores,
+        .distribution = *ParsedDistribution,
+        .core = {hpvm::CPU_TARGET, 0},
+    };
+    HardwareModel defaults = TRY(HardwareModel::create(params, params));
+    if (SpandexHW.empty()) {
+      return Ok(defaults);
+    }
+    auto Buffer = MemoryBuffer::getFile(SpandexHW);
+    if (!Buffer) {
+      return Err(str{"Cannot read "} + SpandexHW + str{": "} +
+                 Buffer.getError().message());
+    }
+    return HardwareModel::parse(defaults, (*Buffer)->getBuffer());
+  }
+
+  ResultStr<Profile> getProfile() const {
+    if (SpandexProfile.empty()) {
+      return Ok(Profile{});
+    }
+    auto Buffer = MemoryBuffer::getFile(SpandexProfile);
+    if (!Buffer) {
+      return Err(str{"Cannot read "} + SpandexProfile + str{": "} +
+                 Buffer.getError().message());
+    }
+    return Profile::parse((*Buffer)->getBuffer());
+  }
+
+  // Hints are keyed by their !spandex.id, and masks have one bit per word of
+  // a block
+  void writeHints(const HardwareModel &hardware, json::Array hints) const {
+    std::error_code EC;
+    ToolOutputFile Out(SpandexHints, EC, sys::fs::F_None);
+    if (EC) {
+      errs() << "Cannot write Spandex hints to " << SpandexHints << ": "
+             << EC.message() << "\n";
+      return;
+    }
+    json::Object table{
+        {"block_size", int64_t(hardware.block_size())},
+        {"word_size", int64_t(hardware.word_size())},
+        {"hints", std::move(hints)},
+    };
+    Out.os() << formatv("{0:2}", json::Value(std::move(table))) << "\n";
+    Out.keep();
+  }
 };
 
 bool Spandex::runOnModule(Module &M) { return pImpl->runOnModule(M); }
@@ -88,3 +224,37 @@ static RegisterPass<Spandex> X{
     "spandex", "Generate Spandex Hints Pass", false /* Only looks at CFG */,
     false /* Analysis Pass */
 };
+
+void SpandexTrace::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<builddfg::BuildDFG>();
+  AU.addPreserved<builddfg::BuildDFG>();
+}
+
+bool SpandexTrace::runOnModule(Module &module) {
+  builddfg::BuildDFG &DFG = getAnalysis<builddfg::BuildDFG>();
+  const std::vector<str> functions = instrument_leaves(module, DFG.getRoots());
+  if (!SpandexTraceNodes.empty()) {
+    std::error_code EC;
+    ToolOutputFile Out(SpandexTraceNodes, EC, sys::fs::F_None);
+    if (EC) {
+      errs() << "Cannot write trace nodes to " << SpandexTraceNodes << ": "
+             << EC.message() << "\n";
+    } else {
+      json::Array nodes;
+      for (const str &function : functions) {
+        nodes.push_back(function);
+      }
+      json::Object table{{"nodes", std::move(nodes)}};
+      Out.os() << formatv("{0:2}", json::Value(std::move(table))) << "\n";
+      Out.keep();
+    }
+  }
+  return !functions.empty();
+}
+
+char SpandexTrace::ID = 0;
+
+static RegisterPass<SpandexTrace> Y{
+    "spandex-trace", "Trace memory accesses of leaf nodes", false /* Only looks at CFG */,
+    false /* Analysis Pass */
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <optional>
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "util.hpp"
+
+/*
+Hex digest of data, used to key cached results by the structure they were
+computed from.
+*/
+class Digest {
+public:
+	Digest& add(llvm::StringRef data) {
+		// The length keeps consecutive fields from running into each other
+		uint64_t size = data.size();
+		hash.update(llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t*>(&size), sizeof(size)));
+		hash.update(data);
+		return *this;
+	}
+	Digest& add(int64_t value) {
+		return add(llvm::StringRef(std::to_string(value)));
+	}
+	str finish() {
+		llvm::MD5::MD5Result result;
+		hash.final(result);
+		return result.digest().str().str();
+	}
+
+private:
+	llvm::MD5 hash;
+};
+
+/*
+Results of earlier runs of the pass, one JSON file per key in a directory.
+Files are written to a unique temporary name and renamed into place, so
+concurrent runs sharing the directory never read a partial file; a file that
+cannot be read or parsed is a miss.
+*/
+class DecisionCache {
+public:
+	explicit DecisionCache(str _dir) : dir{std::move(_dir)} { }
+
+	std::optional<llvm::json::Value> load(const str& key) const {
+		auto buffer = llvm::MemoryBuffer::getFile(path(key));
+		if (!buffer) {
+			return std::nullopt;
+		}
+		llvm::Expected<llvm::json::Value> value = llvm::json::parse((*buffer)->getBuffer());
+		if (!value) {
+			llvm::consumeError(value.takeError());
+			return std::nullopt;
+		}
+		return std::move(*value);
+	}
+
+	// Failures to write only cost a later miss, so they are ignored
+	void store(const str& key, llvm::json::Value value) const {
+		if (llvm::sys::fs::create_directories(dir)) {
+			return;
+		}
+		int fd;
+		llvm::SmallString<128> temporary;
+		if (llvm::sys::fs::createUniqueFile(path(key) + ".%%%%%%.tmp", fd, temporary)) {
+			return;
+		}
+		{
+			llvm::raw_fd_ostream os{fd, /* shouldClose */ true};
+			os << value;
+			if (os.has_error()) {
+				os.clear_error();
+				llvm::sys::fs::remove(temporary);
+				return;
+			}
+		}
+		if (llvm::sys::fs::rename(temporary, path(key))) {
+			llvm::sys::fs::remove(temporary);
+		}
+	}
+
+private:
+	str path(const str& key) const {
+		llvm::SmallString<128> result{dir};
+		llvm::sys::path::append(result, key + ".json");
+		return result.str().str();
+	}
+
+	str dir;
+};
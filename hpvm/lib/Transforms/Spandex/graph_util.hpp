@@ -3,8 +3,13 @@
 #include <unordered_set>
 #include <deque>
 #include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <type_traits>
 #include <functional>
+#include <vector>
 #include "util.hpp"
 #include <cassert>
 
@@ -62,7 +67,7 @@ template <
 	>
 NodeSet get_nodes(const ThisDigraph &digraph) {
   NodeSet nodes;
-  for_each_adj_list<Node, ThisDigraph, NodeSet>(digraph, [&](const Node &src, AdjList<Node> dsts) {
+  for_each_adj_list<Node, ThisDigraph, NodeSet>(digraph, [&](const Node &src, const NodeSet &dsts) {
     nodes.insert(src);
     for (const Node &dst : dsts) {
       nodes.insert(dst);
@@ -79,52 +84,164 @@ template <typename Node> Digraph<Node> invert(const Digraph<Node> &digraph) {
   return inverse;
 }
 
-template <typename Node, typename ThisDigraph = Digraph<Node>> class BfsIt
+/*
+Immutable compressed sparse row form of a Digraph, for the analysis phases.
+Every node with an edge gets a dense ID in [0, size()), and the successors of
+node n are targets[offsets[n]] up to targets[offsets[n + 1]]. Graphs are built
+and edited as a Digraph, then frozen into a CsrGraph.
+*/
+template <typename Node, typename ThisDigraph = Digraph<Node>> class CsrGraph {
+public:
+	typedef unsigned int NodeId;
+	typedef std::unordered_map<Node, NodeId, typename ThisDigraph::hasher, typename ThisDigraph::key_equal> IdMap;
+
+	CsrGraph() : offsets(1, 0) { }
+
+	explicit CsrGraph(const ThisDigraph &digraph) {
+		for (const auto &node_successors : digraph) {
+			add_node(node_successors.first);
+			for (const Node &dst : node_successors.second) {
+				add_node(dst);
+			}
+		}
+		offsets.assign(nodes.size() + 1, 0);
+		for (const auto &node_successors : digraph) {
+			offsets[ids.at(node_successors.first) + 1] = node_successors.second.size();
+		}
+		std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+		targets.resize(offsets.back());
+		std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+		for (const auto &node_successors : digraph) {
+			NodeId src = ids.at(node_successors.first);
+			for (const Node &dst : node_successors.second) {
+				targets[next[src]++] = ids.at(dst);
+			}
+		}
+	}
+
+	size_t size() const { return nodes.size(); }
+	size_t num_edges() const { return targets.size(); }
+	const Node &node(NodeId id) const { return nodes[id]; }
+	bool contains(const Node &node) const { return ids.count(node) != 0; }
+	NodeId id(const Node &node) const { return ids.at(node); }
+	IterRange<const NodeId *> successors(NodeId id) const {
+		return IterRange<const NodeId *>{targets.data() + offsets[id], targets.data() + offsets[id + 1]};
+	}
+
+	// Same graph with every edge reversed, and the same node IDs
+	CsrGraph reverse() const {
+		CsrGraph ret{nodes, ids};
+		ret.offsets.assign(nodes.size() + 1, 0);
+		for (NodeId dst : targets) {
+			ret.offsets[dst + 1]++;
+		}
+		std::partial_sum(ret.offsets.begin(), ret.offsets.end(), ret.offsets.begin());
+		ret.targets.resize(targets.size());
+		std::vector<size_t> next(ret.offsets.begin(), ret.offsets.end() - 1);
+		for (NodeId src = 0; src < size(); ++src) {
+			for (NodeId dst : successors(src)) {
+				ret.targets[next[dst]++] = src;
+			}
+		}
+		return ret;
+	}
+
+private:
+	CsrGraph(const std::vector<Node> &_nodes, const IdMap &_ids)
+		: nodes{_nodes}
+		, ids{_ids}
+	{ }
+
+	void add_node(const Node &node) {
+		if (ids.emplace(node, nodes.size()).second) {
+			nodes.push_back(node);
+		}
+	}
+
+	std::vector<Node> nodes;
+	IdMap ids;
+	std::vector<size_t> offsets;
+	std::vector<NodeId> targets;
+};
+
+template <typename Node, typename ThisGraph = CsrGraph<Node>> class BfsIt
   // Iterator traits - typedefs and types required to be STL compliant
 	: public std::iterator<std::input_iterator_tag, Node, size_t, const Node*, const Node&>
 {
+private:
+	typedef typename ThisGraph::NodeId NodeId;
+
+	// Copies of an iterator share its traversal, so that copying one is cheap
+	struct State {
+		State(const ThisGraph &_graph, const Node &src) : graph{_graph} {
+			cur.emplace(src);
+			if (graph.contains(src)) {
+				cur_id = graph.id(src);
+				visited.resize(graph.size(), false);
+				visited[*cur_id] = true;
+			}
+		}
+		const ThisGraph &graph;
+		size_t i = 0;
+		std::optional<Node> cur;
+		std::optional<NodeId> cur_id;
+		std::deque<NodeId> lst;
+		// Nodes already queued, so that each is visited once even in cyclic
+		// graphs
+		std::vector<bool> visited;
+	};
+
 public:
+	// Result of post-increment, which holds the node the iterator was at
+	class PostIncrement {
+	public:
+		explicit PostIncrement(const Node &_node) : node{_node} {}
+		const Node &operator*() const { return node; }
+	private:
+		Node node;
+	};
+
   BfsIt() {}
 
-  BfsIt(const ThisDigraph &digraph, Node src)
-      : _digraph{&digraph}, cur{std::make_optional<Node>(src)} {}
+  BfsIt(const ThisGraph &graph, Node src)
+      : state{std::make_shared<State>(graph, src)} {}
 
-	bool empty() const { return !cur.has_value(); }
+	bool empty() const { return !state || !state->cur.has_value(); }
 	const Node &operator*() const {
     assert(!empty() && "Accessed a completed iterator");
-    return *cur;
+    return *state->cur;
   }
-	BfsIt end() {
+	BfsIt end() const {
 		return BfsIt{};
 	}
-	BfsIt begin() {
+	BfsIt begin() const {
 		return *this;
 	}
-  Node &operator*() {
-    assert(!empty() && "Accessed a completed iterator");
-    return *cur;
-  }
-	const Node *operator->() const { return **this; }
-  Node *operator->() { return **this; }
+	const Node *operator->() const { return &**this; }
   BfsIt &operator++() {
-    // only works in acyclic graph
     assert(!empty() && "Incremented a completed iterator");
-	i++;
-    if (_digraph->count(*cur) != 0) {
-      for (const auto &next : _digraph->at(*cur)) {
-        lst.push_back(next);
+	State &s = *state;
+	s.i++;
+    if (s.cur_id.has_value()) {
+      for (NodeId next : s.graph.successors(*s.cur_id)) {
+        if (!s.visited[next]) {
+          s.visited[next] = true;
+          s.lst.push_back(next);
+        }
       }
     }
-    if (lst.empty()) {
-		cur = std::nullopt;
+    if (s.lst.empty()) {
+		s.cur.reset();
+		s.cur_id.reset();
     } else {
-		cur = lst.front();
-      lst.pop_front();
+		s.cur_id = s.lst.front();
+		s.cur.emplace(s.graph.node(*s.cur_id));
+		s.lst.pop_front();
     }
     return *this;
   }
-  BfsIt operator++(int) {
-    BfsIt other = *this;
+  PostIncrement operator++(int) {
+    PostIncrement other{**this};
     ++*this;
     return other;
   }
@@ -132,34 +249,217 @@ public:
 	  if (empty() || other.empty()) {
 		  return empty() && other.empty();
 	  } else {
-		  return i == other.i && _digraph == other._digraph;
+		  return state == other.state;
 	  }
   }
   bool operator!=(const BfsIt &other) const { return !(*this == other); }
 
 private:
-	size_t i = 0;
-	const ThisDigraph* _digraph;
-	std::optional<Node> cur;
-  std::deque<Node> lst;
+	std::shared_ptr<State> state;
 };
 
-template <typename Node>
-bool is_descendant(const Digraph<Node> &digraph, Node n1, Node n2) {
-	return std::find(BfsIt<Node>{digraph, n1}, BfsIt<Node>{}, n2) !=
-	  BfsIt<Node>{};
+template <typename Node, typename ThisGraph = CsrGraph<Node>>
+bool is_descendant(const ThisGraph &graph, Node n1, Node n2) {
+	return std::find(BfsIt<Node, ThisGraph>{graph, n1}, BfsIt<Node, ThisGraph>{}, n2) !=
+	  BfsIt<Node, ThisGraph>{};
+}
+
+/*
+src and the nodes reachable from it, each once, in topological order of the
+subgraph they form. Unlike BfsIt this never yields a node before one of its
+predecessors, e.g. D comes last in A -> B -> C -> D, A -> D.
+
+The sweep is cycle-safe for streaming graphs with feedback edges: edges back
+into src are ignored, and when only nodes on a cycle are left, the cycle is
+broken at the one discovered first. Costs O(size of the subgraph), plus
+clearing two arrays over the graph.
+*/
+template <typename Node, typename ThisGraph = CsrGraph<Node>>
+std::vector<Node> topological_descendants(const ThisGraph &graph, const Node &src) {
+	typedef typename ThisGraph::NodeId NodeId;
+	if (!graph.contains(src)) {
+		return std::vector<Node>{src};
+	}
+	const NodeId src_id = graph.id(src);
+
+	// Discover the subgraph breadth-first
+	std::vector<bool> visited(graph.size(), false);
+	std::vector<NodeId> discovered{src_id};
+	visited[src_id] = true;
+	for (size_t i = 0; i < discovered.size(); ++i) {
+		for (NodeId succ : graph.successors(discovered[i])) {
+			if (!visited[succ]) {
+				visited[succ] = true;
+				discovered.push_back(succ);
+			}
+		}
+	}
+
+	// visited is reused to mark the nodes already in the order
+	std::vector<size_t> in_degree(graph.size(), 0);
+	for (NodeId id : discovered) {
+		visited[id] = false;
+		for (NodeId succ : graph.successors(id)) {
+			if (succ != src_id) {
+				in_degree[succ]++;
+			}
+		}
+	}
+
+	std::vector<Node> order;
+	order.reserve(discovered.size());
+	std::deque<NodeId> ready{src_id};
+	size_t next_discovered = 0;
+	while (order.size() < discovered.size()) {
+		if (ready.empty()) {
+			while (visited[discovered[next_discovered]]) {
+				++next_discovered;
+			}
+			ready.push_back(discovered[next_discovered]);
+		}
+		NodeId id = ready.front();
+		ready.pop_front();
+		if (visited[id]) {
+			continue;
+		}
+		visited[id] = true;
+		order.push_back(graph.node(id));
+		for (NodeId succ : graph.successors(id)) {
+			if (succ != src_id && --in_degree[succ] == 0 && !visited[succ]) {
+				ready.push_back(succ);
+			}
+		}
+	}
+	return order;
+}
+
+/*
+Node IDs of graph in topological order (Kahn's algorithm). Nodes on a cycle,
+or reachable from one, are left out, so the order covers the whole graph iff it
+is acyclic.
+*/
+template <typename ThisGraph>
+std::vector<typename ThisGraph::NodeId> topological_order(const ThisGraph &graph) {
+	typedef typename ThisGraph::NodeId NodeId;
+	std::vector<size_t> in_degree(graph.size(), 0);
+	for (NodeId src = 0; src < graph.size(); ++src) {
+		for (NodeId dst : graph.successors(src)) {
+			in_degree[dst]++;
+		}
+	}
+	std::vector<NodeId> order;
+	order.reserve(graph.size());
+	for (NodeId id = 0; id < graph.size(); ++id) {
+		if (in_degree[id] == 0) {
+			order.push_back(id);
+		}
+	}
+	// order doubles as the queue
+	for (size_t i = 0; i < order.size(); ++i) {
+		for (NodeId dst : graph.successors(order[i])) {
+			if (--in_degree[dst] == 0) {
+				order.push_back(dst);
+			}
+		}
+	}
+	return order;
 }
 
+/*
+Transitive closure of a graph, as one bitset per node of the nodes it reaches.
+Bitsets are computed by merging successors into predecessors in reverse
+topological order, so that every query is O(1). Graphs with cycles fall back on
+repeated sweeps until no bitset changes.
+
+Like is_descendant, every node reaches itself, including nodes not in the graph.
+*/
+template <typename Node, typename ThisGraph = CsrGraph<Node>> class Reachability {
+public:
+	typedef typename ThisGraph::NodeId NodeId;
+
+	explicit Reachability(const ThisGraph &_graph)
+		: graph{_graph}
+		, words{(graph.size() + word_bits - 1) / word_bits}
+		, bits(graph.size() * words, 0)
+	{
+		for (NodeId id = 0; id < graph.size(); ++id) {
+			bitset(id)[id / word_bits] |= uint64_t{1} << (id % word_bits);
+		}
+
+		std::vector<NodeId> order = topological_order(graph);
+		bool acyclic = order.size() == graph.size();
+		if (!acyclic) {
+			order.resize(graph.size());
+			std::iota(order.begin(), order.end(), 0);
+		}
+
+		bool changed;
+		do {
+			changed = false;
+			for (auto it = order.rbegin(); it != order.rend(); ++it) {
+				for (NodeId succ : graph.successors(*it)) {
+					changed |= merge(*it, succ);
+				}
+			}
+		} while (!acyclic && changed);
+	}
+
+	bool reaches(NodeId src, NodeId dst) const {
+		return (bitset(src)[dst / word_bits] >> (dst % word_bits)) & 1;
+	}
+
+	bool reaches(const Node &src, const Node &dst) const {
+		if (!graph.contains(src) || !graph.contains(dst)) {
+			return graph.contains(src) == graph.contains(dst) &&
+				typename ThisGraph::IdMap::key_equal{}(src, dst);
+		}
+		return reaches(graph.id(src), graph.id(dst));
+	}
+
+private:
+	static constexpr size_t word_bits = 64;
+
+	uint64_t *bitset(NodeId id) { return bits.data() + id * words; }
+	const uint64_t *bitset(NodeId id) const { return bits.data() + id * words; }
+
+	// Adds the nodes src reaches to the ones dst reaches. Returns whether it
+	// added any.
+	bool merge(NodeId dst, NodeId src) {
+		const uint64_t *from = bitset(src);
+		uint64_t *to = bitset(dst);
+		bool changed = false;
+		for (size_t i = 0; i < words; ++i) {
+			uint64_t merged = to[i] | from[i];
+			changed |= merged != to[i];
+			to[i] = merged;
+		}
+		return changed;
+	}
+
+	const ThisGraph &graph;
+	size_t words;
+	std::vector<uint64_t> bits;
+};
+
 template <typename Node1, typename Node2, typename Digraph1 = Digraph<Node1>, typename Digraph2 = Digraph<Node2>>
 Digraph2 map_graph(const Digraph1 &inp,
 				   std::function<Node2(const Node1 &)> fn) {
   Digraph2 out;
 
+  // fn is called once per node
+  std::unordered_map<Node1, Node2, typename Digraph1::hasher, typename Digraph1::key_equal> mapped;
+  auto map_node = [&](const Node1 &node1) -> const Node2 & {
+    auto it = mapped.find(node1);
+    if (it == mapped.end()) {
+      it = mapped.emplace(node1, fn(node1)).first;
+    }
+    return it->second;
+  };
+
   for_each_adj_list<Node1, Digraph1, typename Digraph1::mapped_type>(inp, [&](const Node1 &src1, const typename Digraph1::mapped_type& dst1s) {
-    Node2 src2 = fn(src1);
+    const Node2 &src2 = map_node(src1);
     for (const Node1 &dst1 : dst1s) {
-      Node2 dst2 = fn(dst1);
-      out[src2].insert(dst2);
+      out[src2].insert(map_node(dst1));
     }
   });
 
@@ -232,10 +532,12 @@ void delete_node(ThisDigraph &graph, ThisDigraph &inverse_graph,
       }
     }
   }
+#ifndef NDEBUG
   auto b1 = get_nodes<Node, ThisDigraph, ThisAdjList>(graph).count(node) == 0;
   assert(b1);
   auto b2 = get_nodes<Node, ThisDigraph, ThisAdjList>(inverse_graph).count(node) == 0;
   assert(b2);
+#endif
 }
 
 template <typename Node, typename ThisDigraph = Digraph<Node>>
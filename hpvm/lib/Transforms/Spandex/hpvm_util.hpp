@@ -103,8 +103,9 @@ Digraph<Ref<llvm::DFNode>> get_coarse_leaf_dfg(const Digraph<Port>& leaf_dfg) {
 }
 
 Digraph<Port> get_mem_comm_dfg(const Digraph<Port> &dfg,
-                               const Digraph<Ref<llvm::DFNode>> &coarse_dfg) {
+                               const CsrGraph<Ref<llvm::DFNode>> &coarse_dfg) {
   Digraph<Port> result;
+  const Reachability<Ref<llvm::DFNode>> reachability{coarse_dfg};
   for_each_adj_list<Port, Digraph<Port>, AdjList<Port>>(dfg, [&](const Port &src, const AdjList<Port>& dsts) {
     if (dsts.size() > 1 && dsts.cbegin()->get_type().isPointerTy()) {
       for (const Port &dst1 : dsts) {
@@ -113,7 +114,7 @@ Digraph<Port> get_mem_comm_dfg(const Digraph<Port> &dfg,
             if (true &&
                 ptr2ref<llvm::Function>(dst1.N.getFuncPointer()).hasAttribute(dst1.pos + 1, llvm::Attribute::Out) &&
                 ptr2ref<llvm::Function>(dst2.N.getFuncPointer()).hasAttribute(dst2.pos + 1, llvm::Attribute::In ) &&
-                is_descendant<Ref<llvm::DFNode>>(coarse_dfg, dst1.N, dst2.N)) {
+                reachability.reaches(dst1.N, dst2.N)) {
               result[dst1].insert(dst2);
             }
           }
@@ -124,6 +125,40 @@ Digraph<Port> get_mem_comm_dfg(const Digraph<Port> &dfg,
   return result;
 }
 
+// Instances of a node, if its dimension limits are constants
+std::optional<uint64_t> count_instances(const llvm::DFNode &node) {
+  uint64_t result = 1;
+  for (llvm::Value *limit : node.getDimLimits()) {
+    const auto *constant = llvm::dyn_cast_or_null<llvm::ConstantInt>(limit);
+    if (!constant) {
+      return std::nullopt;
+    }
+    result *= constant->getZExtValue();
+  }
+  return result;
+}
+
+/*
+Pairs of pointer arguments of each leaf function that the DFG binds to the same
+buffer, because one port feeds both.
+*/
+typedef std::unordered_map<const llvm::Function*, std::vector<std::pair<unsigned, unsigned>>> BoundArgs;
+
+BoundArgs get_bound_args(const Digraph<Port> &dfg) {
+  BoundArgs result;
+  for_each_adj_list<Port, Digraph<Port>, AdjList<Port>>(dfg, [&](const Port &src, const AdjList<Port>& dsts) {
+    if (dsts.size() > 1 && dsts.cbegin()->get_type().isPointerTy()) {
+      for (const Port &dst1 : dsts) {
+        for (const Port &dst2 : dsts) {
+          if (&dst1.N == &dst2.N && dst1.pos < dst2.pos) {
+            result[dst1.N.getFuncPointer()].emplace_back(dst1.pos, dst2.pos);
+          }
+        }
+      }
+    }
+  });
+  return result;
+}
 
 llvm::raw_ostream &dump_graphviz_ports(llvm::raw_ostream &os, const Digraph<Port> &dfg,
 									   bool inps_only = false) {
@@ -1,8 +1,19 @@
 #pragma once
+#include <cctype>
 #include <utility>
 #include <functional>
 #include <optional>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 #define DEBUG_TYPE "Spandex"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Support/Debug.h"
 #include "util.hpp"
 
@@ -36,6 +47,10 @@ llvm_to_str(T& obj) {
 
 BETTER_ENUM(AccessKind, char, load, store, rmw, cas)
 
+// Atomics both read and write their location
+static bool is_read(AccessKind kind) { return kind != +AccessKind::store; }
+static bool is_write(AccessKind kind) { return kind != +AccessKind::load; }
+
 /*
 There is a weird problem between ResultStr and std::pair<std::reference_wrapper<...>, ...>
 
@@ -61,6 +76,21 @@ get_pointer_target(const llvm::Instruction& instruction) {
 		return Ok(pair(ptr2ref<llvm::Value>(cas_inst->getPointerOperand()), AccessKind::cas));
 	} else if (const auto* rmw_inst = llvm::dyn_cast<llvm::AtomicRMWInst>(&instruction)) {
 		return Ok(pair(ptr2ref<llvm::Value>(rmw_inst->getPointerOperand()), AccessKind::rmw));
+	} else if (const auto* intrinsic = llvm::dyn_cast<llvm::IntrinsicInst>(&instruction)) {
+		// __hpvm__atomic_* are only lowered to atomicrmw by the backends
+		switch (intrinsic->getIntrinsicID()) {
+		case llvm::Intrinsic::hpvm_atomic_add:
+		case llvm::Intrinsic::hpvm_atomic_sub:
+		case llvm::Intrinsic::hpvm_atomic_xchg:
+		case llvm::Intrinsic::hpvm_atomic_min:
+		case llvm::Intrinsic::hpvm_atomic_max:
+		case llvm::Intrinsic::hpvm_atomic_and:
+		case llvm::Intrinsic::hpvm_atomic_or:
+		case llvm::Intrinsic::hpvm_atomic_xor:
+			return Ok(pair(ptr2ref<llvm::Value>(intrinsic->getArgOperand(0)), AccessKind::rmw));
+		default:
+			return Err(str{"Instruction "} + llvm_to_str(instruction) + str{" is not a memory access"});
+		}
 	} else {
 		return Err(str{"Instruction "} + llvm_to_str(instruction) + str{" is not a memory access"});
 	}
@@ -70,6 +100,115 @@ static bool is_memory_access(const llvm::Instruction& instruction) {
 	return get_pointer_target(instruction).isOk();
 }
 
+/*
+Memory accesses of function in reverse post-order of its basic blocks. Their
+position in it identifies them across runs, in profiles and caches.
+ */
+static std::vector<Ref<llvm::Instruction>> memory_accesses(const llvm::Function& function) {
+	std::vector<Ref<llvm::Instruction>> result;
+	llvm::ReversePostOrderTraversal<const llvm::Function*> rpot{&function};
+	for (const llvm::BasicBlock* basic_block : rpot) {
+		for (const llvm::Instruction& instruction : *basic_block) {
+			if (is_memory_access(instruction)) {
+				result.push_back(instruction);
+			}
+		}
+	}
+	return result;
+}
+
+/*
+Prints md with its operands in place, so that it does not depend on the slot
+numbers of the module. Debug info is left out, and nodes already printed by an
+earlier call with the same seen are referred to as ^N.
+ */
+static void print_metadata(llvm::raw_ostream& os, const llvm::Metadata* md, std::unordered_map<const llvm::Metadata*, size_t>& seen) {
+	if (!md) {
+		os << "null";
+	} else if (const auto* string = llvm::dyn_cast<llvm::MDString>(md)) {
+		os << "!\"";
+		os.write_escaped(string->getString());
+		os << "\"";
+	} else if (const auto* value = llvm::dyn_cast<llvm::ValueAsMetadata>(md)) {
+		value->getValue()->printAsOperand(os, true);
+	} else if (llvm::isa<llvm::DINode>(md) || llvm::isa<llvm::DILocation>(md)) {
+		os << "dbg";
+	} else if (const auto* node = llvm::dyn_cast<llvm::MDNode>(md)) {
+		auto [it, inserted] = seen.emplace(node, seen.size());
+		if (!inserted) {
+			os << "^" << it->second;
+			return;
+		}
+		os << (node->isDistinct() ? "distinct !{" : "!{");
+		for (unsigned i = 0; i < node->getNumOperands(); ++i) {
+			os << (i == 0 ? "" : ", ");
+			print_metadata(os, node->getOperand(i).get(), seen);
+		}
+		os << "}";
+	} else {
+		os << "?";
+	}
+}
+
+/*
+IR of function, without the numbers of the attribute groups (#N) and metadata
+nodes (!N) it refers to, which change with the rest of the module. What they
+stand for follows it instead: the attributes of the function and of its calls,
+and the metadata attached to the function and its instructions, apart from
+debug info, in the order they occur.
+ */
+static str module_independent_ir(const llvm::Function& function) {
+	str ir;
+	llvm::raw_string_ostream ir_os{ir};
+	function.print(ir_os);
+	ir_os.flush();
+
+	str result;
+	llvm::raw_string_ostream os{result};
+	// Quotes in names and strings are printed as \22, so a quote always
+	// starts or ends one
+	bool quoted = false;
+	for (size_t i = 0; i < ir.size(); ++i) {
+		os << ir[i];
+		if (ir[i] == '"') {
+			quoted = !quoted;
+		} else if (!quoted && (ir[i] == '#' || ir[i] == '!')) {
+			while (i + 1 < ir.size() && std::isdigit(static_cast<unsigned char>(ir[i + 1]))) {
+				++i;
+			}
+		}
+	}
+
+	llvm::SmallVector<llvm::StringRef, 32> kind_names;
+	function.getContext().getMDKindNames(kind_names);
+	std::unordered_map<const llvm::Metadata*, size_t> seen;
+	llvm::SmallVector<std::pair<unsigned, llvm::MDNode*>, 4> attachments;
+	auto print_attachments = [&]() {
+		for (auto [kind, node] : attachments) {
+			if (kind != llvm::LLVMContext::MD_dbg) {
+				os << " !" << kind_names[kind] << " ";
+				print_metadata(os, node, seen);
+			}
+		}
+	};
+
+	os << "\nattributes " << function.getAttributes().getAsString(llvm::AttributeList::FunctionIndex);
+	function.getAllMetadata(attachments);
+	print_attachments();
+	for (const llvm::BasicBlock& basic_block : function) {
+		for (const llvm::Instruction& instruction : basic_block) {
+			os << "\n";
+			if (const auto* call = llvm::dyn_cast<llvm::CallBase>(&instruction)) {
+				os << "attributes " << call->getAttributes().getAsString(llvm::AttributeList::FunctionIndex);
+			}
+			attachments.clear();
+			instruction.getAllMetadataOtherThanDebugLoc(attachments);
+			print_attachments();
+		}
+	}
+	return os.str();
+}
+
 typedef nonstd::variant<const llvm::Value*, size_t> ValueOrConst;
 typedef std::vector<std::pair<ValueOrConst, size_t>> GEPList;
 
@@ -157,6 +296,277 @@ statically_evaluate(const llvm::Value& value) {
 	}
 }
 
+/*
+Evaluates an offset computed by ScalarEvolution for the first instance of the
+node, i.e. with every node instance ID taken to be 0.
+ */
+static ResultStr<int64_t>
+evaluate_first_instance(const llvm::SCEV& scev) {
+	if (const auto* constant = llvm::dyn_cast<llvm::SCEVConstant>(&scev)) {
+		return Ok(constant->getAPInt().getSExtValue());
+	} else if (const auto* cast = llvm::dyn_cast<llvm::SCEVCastExpr>(&scev)) {
+		return evaluate_first_instance(ptr2ref<llvm::SCEV>(cast->getOperand()));
+	} else if (const auto* add = llvm::dyn_cast<llvm::SCEVAddExpr>(&scev)) {
+		int64_t result = 0;
+		for (const llvm::SCEV* operand : add->operands()) {
+			result += TRY(evaluate_first_instance(ptr2ref<llvm::SCEV>(operand)));
+		}
+		return Ok(result);
+	} else if (const auto* mul = llvm::dyn_cast<llvm::SCEVMulExpr>(&scev)) {
+		// A product with an instance ID is 0, whatever the other factors are
+		int64_t result = 1;
+		bool evaluated = true;
+		for (const llvm::SCEV* operand : mul->operands()) {
+			ResultStr<int64_t> factor = evaluate_first_instance(ptr2ref<llvm::SCEV>(operand));
+			if (factor.isOk() && factor.unwrap() == 0) {
+				return Ok(int64_t{0});
+			} else if (factor.isOk()) {
+				result *= factor.unwrap();
+			} else {
+				evaluated = false;
+			}
+		}
+		if (evaluated) {
+			return Ok(result);
+		} else {
+			return Err(str{"'"} + llvm_to_str_ndbg(scev) + str{"' is not statically evaluatable"});
+		}
+	} else if (const auto* unknown = llvm::dyn_cast<llvm::SCEVUnknown>(&scev)) {
+		if (const auto* intrinsic = llvm::dyn_cast<llvm::IntrinsicInst>(unknown->getValue())) {
+			switch (intrinsic->getIntrinsicID()) {
+			case llvm::Intrinsic::hpvm_getNodeInstanceID_x:
+			case llvm::Intrinsic::hpvm_getNodeInstanceID_y:
+			case llvm::Intrinsic::hpvm_getNodeInstanceID_z:
+				return Ok(int64_t{0});
+			default:
+				break;
+			}
+		}
+		return Err(str{"Value '"} + llvm_to_str(ptr2ref<llvm::Value>(unknown->getValue())) + str{"' is not statically evaluatable"});
+	} else {
+		return Err(str{"SCEV '"} + llvm_to_str_ndbg(scev) + str{"' is not statically evaluatable"});
+	}
+}
+
+/*
+Bytes an offset computed by ScalarEvolution moves from one instance of the
+node to the next along x, i.e. its coefficient in the x instance ID. Fails if
+the offset is not affine in it.
+ */
+static ResultStr<int64_t>
+evaluate_instance_stride(const llvm::SCEV& scev) {
+	if (llvm::isa<llvm::SCEVConstant>(&scev)) {
+		return Ok(int64_t{0});
+	} else if (const auto* cast = llvm::dyn_cast<llvm::SCEVCastExpr>(&scev)) {
+		return evaluate_instance_stride(ptr2ref<llvm::SCEV>(cast->getOperand()));
+	} else if (const auto* add = llvm::dyn_cast<llvm::SCEVAddExpr>(&scev)) {
+		int64_t result = 0;
+		for (const llvm::SCEV* operand : add->operands()) {
+			result += TRY(evaluate_instance_stride(ptr2ref<llvm::SCEV>(operand)));
+		}
+		return Ok(result);
+	} else if (const auto* mul = llvm::dyn_cast<llvm::SCEVMulExpr>(&scev)) {
+		// Affine only if at most one factor depends on the instance
+		int64_t result = 1;
+		bool dependent = false;
+		for (const llvm::SCEV* operand : mul->operands()) {
+			int64_t stride = TRY(evaluate_instance_stride(ptr2ref<llvm::SCEV>(operand)));
+			if (stride != 0) {
+				if (dependent) {
+					return Err(str{"'"} + llvm_to_str_ndbg(scev) + str{"' is not affine in the instance ID"});
+				}
+				dependent = true;
+				result *= stride;
+			} else {
+				result *= TRY(evaluate_first_instance(ptr2ref<llvm::SCEV>(operand)));
+			}
+		}
+		return Ok(dependent ? result : int64_t{0});
+	} else if (const auto* unknown = llvm::dyn_cast<llvm::SCEVUnknown>(&scev)) {
+		if (const auto* intrinsic = llvm::dyn_cast<llvm::IntrinsicInst>(unknown->getValue())) {
+			switch (intrinsic->getIntrinsicID()) {
+			case llvm::Intrinsic::hpvm_getNodeInstanceID_x:
+				return Ok(int64_t{1});
+			case llvm::Intrinsic::hpvm_getNodeInstanceID_y:
+			case llvm::Intrinsic::hpvm_getNodeInstanceID_z:
+				return Ok(int64_t{0});
+			default:
+				break;
+			}
+		}
+		return Err(str{"Value '"} + llvm_to_str(ptr2ref<llvm::Value>(unknown->getValue())) + str{"' is not statically evaluatable"});
+	} else {
+		return Err(str{"SCEV '"} + llvm_to_str_ndbg(scev) + str{"' is not statically evaluatable"});
+	}
+}
+
+/*
+One loop around an access, along which its address moves by stride bytes per
+iteration. Either is nullopt when it is not a compile-time constant.
+ */
+struct AffineLoop {
+	std::optional<int64_t> stride;
+	std::optional<uint64_t> trip_count;
+};
+
+/*
+Summary of the bytes an access touches over all iterations of the loops around
+it, from the SCEV of its pointer:
+
+    base + offset + sum_i loops[i].stride * k_i    for 0 <= k_i < loops[i].trip_count
+
+where each such address is accessed for size bytes. loops is ordered from the
+innermost loop out. The offset is the one of the first instance of the node
+(see evaluate_first_instance), and instance_stride is how far it moves per
+instance along x, if known.
+ */
+class AccessRange {
+private:
+	AccessRange(const llvm::Value& _base, int64_t _offset, std::optional<int64_t> _instance_stride, std::vector<AffineLoop> _loops, uint64_t _size)
+		: base{_base}
+		, offset{_offset}
+		, instance_stride{_instance_stride}
+		, loops{std::move(_loops)}
+		, size{_size}
+	{ }
+public:
+	AccessRange() = delete;
+	const llvm::Value& base;
+	int64_t offset;
+	std::optional<int64_t> instance_stride;
+	std::vector<AffineLoop> loops;
+	uint64_t size;
+
+	bool bounded() const {
+		return std::all_of(loops.cbegin(), loops.cend(), [](const AffineLoop& loop) {
+			return loop.stride.has_value() && loop.trip_count.has_value();
+		});
+	}
+
+	// Number of accesses in the range, which must be bounded
+	uint64_t count() const {
+		assert(bounded());
+		uint64_t result = 1;
+		for (const AffineLoop& loop : loops) {
+			result *= *loop.trip_count;
+		}
+		return result;
+	}
+
+	// One past the last byte the range touches, which must be bounded
+	int64_t end() const {
+		assert(bounded());
+		int64_t result = offset + size;
+		for (const AffineLoop& loop : loops) {
+			if (*loop.trip_count > 0) {
+				result += std::max<int64_t>(0, *loop.stride * int64_t(*loop.trip_count - 1));
+			}
+		}
+		return result;
+	}
+
+	/*
+	First byte and one past the last byte the range may touch, each nullopt if
+	unknown. Unlike end(), this works for unbounded ranges: a loop with an
+	unknown trip count extends the range without bound in the direction of its
+	stride, and one with an unknown stride in both directions.
+	*/
+	std::pair<std::optional<int64_t>, std::optional<int64_t>> extent() const {
+		std::optional<int64_t> first = offset;
+		std::optional<int64_t> last = offset + int64_t(size);
+		for (const AffineLoop& loop : loops) {
+			if (!loop.stride.has_value()) {
+				first.reset();
+				last.reset();
+			} else if (!loop.trip_count.has_value()) {
+				if (*loop.stride > 0) {
+					last.reset();
+				} else if (*loop.stride < 0) {
+					first.reset();
+				}
+			} else if (*loop.trip_count > 0) {
+				int64_t span = *loop.stride * int64_t(*loop.trip_count - 1);
+				if (span > 0 && last.has_value()) {
+					*last += span;
+				} else if (span < 0 && first.has_value()) {
+					*first += span;
+				}
+			}
+		}
+		return {first, last};
+	}
+
+	// Whether the range may touch a byte in [from, to), from its extent
+	bool may_touch(int64_t from, int64_t to) const {
+		auto [first, last] = extent();
+		return (!first.has_value() || *first < to) && (!last.has_value() || from < *last);
+	}
+
+	// Calls fn on the offset of every access in the range, which must be
+	// bounded, in iteration order
+	void for_each_offset(std::function<void(int64_t)> fn) const {
+		assert(bounded());
+		for_each_offset(fn, loops.size(), offset);
+	}
+
+	static ResultStr<AccessRange>
+	create(llvm::ScalarEvolution& SE, const llvm::DataLayout& data_layout, const llvm::Instruction& instruction) {
+		auto pointer_x_kind = TRY(get_pointer_target(instruction));
+		llvm::Value& pointer = const_cast<llvm::Value&>(pointer_x_kind.first.get());
+		const llvm::SCEV* pointer_scev = SE.getSCEV(&pointer);
+		const auto* base_scev = llvm::dyn_cast<llvm::SCEVUnknown>(SE.getPointerBase(pointer_scev));
+		if (!base_scev) {
+			return Err(str{"Pointer '"} + llvm_to_str(pointer) + str{"' has no base pointer"});
+		}
+		const llvm::Value& base = ptr2ref<llvm::Value>(base_scev->getValue());
+		if (!llvm::isa<llvm::Argument>(&base)) {
+			return Err(str{"Base pointer '"} + llvm_to_str(base) + str{"' is not the start of a segment"});
+		}
+
+		// The outermost recurrence is the one of the innermost loop
+		std::vector<AffineLoop> loops;
+		const llvm::SCEV* offset_scev = SE.getMinusSCEV(pointer_scev, base_scev);
+		while (const auto* add_rec = llvm::dyn_cast<llvm::SCEVAddRecExpr>(offset_scev)) {
+			if (!add_rec->isAffine()) {
+				return Err(str{"Pointer '"} + llvm_to_str(pointer) + str{"' is not affine in its loops"});
+			}
+			const auto* step = llvm::dyn_cast<llvm::SCEVConstant>(add_rec->getStepRecurrence(SE));
+			unsigned trip_count = SE.getSmallConstantTripCount(add_rec->getLoop());
+			AffineLoop loop;
+			if (step) {
+				loop.stride = step->getAPInt().getSExtValue();
+			}
+			if (trip_count != 0) {
+				loop.trip_count = trip_count;
+			}
+			loops.push_back(loop);
+			offset_scev = add_rec->getStart();
+		}
+		int64_t offset = TRY(evaluate_first_instance(ptr2ref<llvm::SCEV>(offset_scev)));
+		ResultStr<int64_t> instance_stride = evaluate_instance_stride(ptr2ref<llvm::SCEV>(offset_scev));
+		uint64_t size = data_layout.getTypeStoreSize(pointer.getType()->getPointerElementType());
+		return Ok(AccessRange{
+			base,
+			offset,
+			instance_stride.isOk() ? std::optional<int64_t>{instance_stride.unwrap()} : std::nullopt,
+			std::move(loops),
+			size
+		});
+	}
+
+private:
+	void for_each_offset(std::function<void(int64_t)>& fn, size_t depth, int64_t start) const {
+		if (depth == 0) {
+			fn(start);
+		} else {
+			const AffineLoop& loop = loops[depth - 1];
+			for (uint64_t k = 0; k < *loop.trip_count; ++k) {
+				for_each_offset(fn, depth - 1, start + int64_t(k) * *loop.stride);
+			}
+		}
+	}
+};
+
 class Address;
 class Segment {
 private:
@@ -234,26 +644,34 @@ public:
 	}
 	bool operator==(const Address& other) const { return block == other.block && block_offset == other.block_offset; }
 	bool operator!=(const Address& other) const { return !(*this == other); }
-	Address operator+(int i) const {
-		assert(block_offset + i > 0);
-		unsigned int new_block_index = (block_offset + i) / block.segment.block_size;
-		unsigned short new_block_offset = (block_offset + i) % block.segment.block_size;
+	size_t offset() const { return size_t(block.block_index) * block.segment.block_size + block_offset; }
+	// Address at the given offset from the base of the same segment
+	Address at_offset(size_t offset) const {
+		unsigned int new_block_index = offset / block.segment.block_size;
+		unsigned short new_block_offset = offset % block.segment.block_size;
 		return Address{Block{block.segment, new_block_index}, new_block_offset};
 	}
+	Address operator+(int i) const {
+		assert(int64_t(offset()) + i >= 0);
+		return at_offset(offset() + i);
+	}
 	Address operator-(int i) const { return *this + (-i); }
 
 	static ResultStr<Address>
 	create(const llvm::DataLayout& data_layout, const llvm::Value& pointer, unsigned short block_size) {
 		auto base_x_offset = TRY(split_pointer(data_layout, pointer));
-		const auto& base = *base_x_offset.first;
+		size_t offset = TRY(evaluate_gep_list(base_x_offset.second));
+		return create(*base_x_offset.first, offset, block_size);
+	}
 
+	static ResultStr<Address>
+	create(const llvm::Value& base, size_t offset, unsigned short block_size) {
 		/*
 		 TODO: also permit:
 		 - result of malloc
 		 - reference to static data
 		*/
 		if (llvm::isa<llvm::Argument>(&base)) {
-			size_t offset = TRY(evaluate_gep_list(base_x_offset.second));
 			unsigned int block_index = offset / block_size;
 			unsigned short block_offset = offset % block_size;
 			return Ok(Address{Block{Segment{base, block_size}, block_index}, block_offset});
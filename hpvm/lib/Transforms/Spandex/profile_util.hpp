@@ -0,0 +1,87 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include "cache_util.hpp"
+#include "util.hpp"
+
+/*
+What a run of the program measured for one static memory access, which is
+identified by its function and its index among the memory accesses of the
+function in reverse post-order (MemoryAccess::order).
+*/
+struct AccessProfile {
+	// Dynamic accesses
+	uint64_t count;
+	// Median number of accesses by the same core since it last touched the word,
+	// or nothing if it never touched the word again
+	std::optional<uint64_t> reuse_distance;
+	// Cores that touched the words of the access
+	uint64_t sharers;
+	// Fraction of the accesses whose word was last written by another core
+	double remote;
+};
+
+/*
+Profile of a run, read from JSON like
+{"profile": [{"function": "f", "index": 0, "count": 100, "reuse_distance": 12,
+"sharers": 2, "remote": 0.5}]}. reuse_distance may be null. Accesses without
+an entry, or with a count of 0, are decided statically.
+*/
+class Profile {
+public:
+	Profile() = default;
+
+	static ResultStr<Profile> parse(llvm::StringRef text) {
+		llvm::Expected<llvm::json::Value> value = llvm::json::parse(text);
+		if (!value) {
+			return Err(str{"Invalid profile: "} + llvm::toString(value.takeError()));
+		}
+		const llvm::json::Object* root = value->getAsObject();
+		const llvm::json::Array* entries = root ? root->getArray("profile") : nullptr;
+		if (!entries) {
+			return Err(str{"Profile has no \"profile\" array"});
+		}
+		Profile profile;
+		profile.source_digest = Digest{}.add(text).finish();
+		for (const llvm::json::Value& entry_value : *entries) {
+			const llvm::json::Object* entry = entry_value.getAsObject();
+			if (!entry) {
+				return Err(str{"Profile entry is not a JSON object"});
+			}
+			auto function = entry->getString("function");
+			auto index = entry->getInteger("index");
+			auto count = entry->getInteger("count");
+			auto sharers = entry->getInteger("sharers");
+			auto remote = entry->getNumber("remote");
+			if (!function || !index || !count || !sharers || !remote || *index < 0 || *count < 0) {
+				return Err(str{"Profile entry needs function, index, count, sharers and remote"});
+			}
+			AccessProfile access{uint64_t(*count), std::nullopt, uint64_t(*sharers), *remote};
+			if (auto reuse_distance = entry->getInteger("reuse_distance")) {
+				access.reuse_distance = *reuse_distance;
+			}
+			profile.accesses[key(*function, *index)] = access;
+		}
+		return Ok(profile);
+	}
+
+	const AccessProfile* find(llvm::StringRef function, unsigned index) const {
+		auto it = accesses.find(key(function, index));
+		return it == accesses.end() || it->second.count == 0 ? nullptr : &it->second;
+	}
+
+	bool empty() const { return accesses.empty(); }
+	// Digest of the JSON the profile was read from, empty if there is none
+	const str& digest() const { return source_digest; }
+
+private:
+	static str key(llvm::StringRef function, int64_t index) {
+		return function.str() + str{":"} + std::to_string(index);
+	}
+
+	std::unordered_map<str, AccessProfile> accesses;
+	str source_digest;
+};
@@ -1,10 +1,23 @@
 #include <iomanip>
+#include <limits>
+#include <list>
+#include <sstream>
+#include <numeric>
 #define DEBUG_TYPE "Spandex"
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Metadata.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm_util.hpp"
+#include "profile_util.hpp"
+#include "cache_util.hpp"
 
 #define NO_COMMIT(block) block
 
@@ -12,21 +25,172 @@ BETTER_ENUM(SpandexRequestType, char, O_data, O, S, V, WTfwd, WTfwd_data, Vo, WT
 
 using Req = SpandexRequestType;
 
+// How the instances of a replicated node are spread over the cores of its
+// kind: in contiguous chunks, or round-robin
+BETTER_ENUM(Distribution, char, block, cyclic)
+
 constexpr unsigned short BYTE_SIZE = 8;
-constexpr unsigned short LINE_SIZE = 64 * BYTE_SIZE;
-constexpr unsigned short WORD_SIZE = 8 * BYTE_SIZE;
-using WordMask = std::bitset<LINE_SIZE / WORD_SIZE>;
+// Bit i of a mask is word i of a block
+constexpr unsigned short MAX_WORDS_PER_BLOCK = 64;
+using WordMask = std::bitset<MAX_WORDS_PER_BLOCK>;
 
+// Sizes are in bits
 class HardwareParams {
 public:
 	HardwareParams() = delete;
 	bool producer;
 	bool owner_pred_available;
-	unsigned int cache_size;
+	uint64_t cache_size;
 	unsigned short block_size;
+	unsigned short word_size;
+	// Cores of this kind
+	unsigned int cores;
+	Distribution distribution;
 	Core core;
+	size_t words_per_block() const { return block_size / word_size; }
+};
+
+// Prints the parameters with sizes in bytes, as they are given
+llvm::raw_ostream &operator<<(llvm::raw_ostream &stream, const HardwareParams &params) {
+	return stream
+		<< "cache_size=" << params.cache_size / BYTE_SIZE
+		<< " line_size=" << params.block_size / BYTE_SIZE
+		<< " word_size=" << params.word_size / BYTE_SIZE
+		<< " owner_pred=" << params.owner_pred_available
+		<< " producer=" << params.producer
+		<< " cores=" << params.cores
+		<< " distribution=" << params.distribution._to_string();
+}
+
+/*
+Hardware parameters of the CPU and GPU cores. Nodes run on the kind of core of
+their target hint. Blocks and words are the same size for both, since they are
+the granularity of the shared LLC.
+*/
+class HardwareModel {
+public:
+	HardwareModel() = delete;
+	HardwareParams cpu;
+	HardwareParams gpu;
+
+	static ResultStr<HardwareModel> create(HardwareParams cpu, HardwareParams gpu) {
+		cpu.core = Core{hpvm::CPU_TARGET, 0};
+		gpu.core = Core{hpvm::GPU_TARGET, 0};
+		if (cpu.block_size != gpu.block_size || cpu.word_size != gpu.word_size) {
+			return Err(str{"CPU and GPU must have the same line and word size"});
+		}
+		for (const HardwareParams* params : {&cpu, &gpu}) {
+			if (params->word_size == 0 || params->word_size % BYTE_SIZE != 0) {
+				return Err(str{"Word size must be a positive number of bytes"});
+			}
+			if (params->block_size % params->word_size != 0 || params->words_per_block() == 0) {
+				return Err(str{"Line size must be a positive multiple of the word size"});
+			}
+			if (params->words_per_block() > MAX_WORDS_PER_BLOCK) {
+				return Err(str{"Lines have at most "} + std::to_string(MAX_WORDS_PER_BLOCK) + str{" words"});
+			}
+			if (params->cache_size < params->block_size) {
+				return Err(str{"Cache size must be at least one line"});
+			}
+			if (params->cores == 0) {
+				return Err(str{"Core counts must be positive"});
+			}
+		}
+		return Ok(HardwareModel{cpu, gpu});
+	}
+
+	// Size in bits of a positive number of bytes, if it fits in a T
+	template <typename T>
+	static ResultStr<T> to_bits(int64_t bytes, const char* what) {
+		constexpr uint64_t max_bytes = std::numeric_limits<T>::max() / BYTE_SIZE;
+		if (bytes <= 0 || uint64_t(bytes) > max_bytes) {
+			return Err(str{what} + str{" must be between 1 and "} + std::to_string(max_bytes) + str{" bytes"});
+		}
+		return Ok(T(bytes * BYTE_SIZE));
+	}
+
+	/*
+	Overrides the parameters of defaults with the ones in a JSON object like
+	{"line_size": 64, "word_size": 8, "cpu": {"cache_size": 1048576,
+	"owner_pred": false, "producer": false, "cores": 4, "distribution": "block"},
+	"gpu": {...}}, with sizes in bytes. Every key is optional.
+	*/
+	static ResultStr<HardwareModel> parse(const HardwareModel& defaults, llvm::StringRef text) {
+		llvm::Expected<llvm::json::Value> value = llvm::json::parse(text);
+		if (!value) {
+			return Err(str{"Invalid hardware model: "} + llvm::toString(value.takeError()));
+		}
+		const llvm::json::Object* root = value->getAsObject();
+		if (!root) {
+			return Err(str{"Hardware model is not a JSON object"});
+		}
+		HardwareParams cpu = defaults.cpu;
+		HardwareParams gpu = defaults.gpu;
+		for (HardwareParams* params : {&cpu, &gpu}) {
+			if (auto line_size = root->getInteger("line_size")) {
+				params->block_size = TRY(to_bits<unsigned short>(*line_size, "Line size"));
+			}
+			if (auto word_size = root->getInteger("word_size")) {
+				params->word_size = TRY(to_bits<unsigned short>(*word_size, "Word size"));
+			}
+		}
+		for (auto [key, params] : {std::make_pair("cpu", &cpu), std::make_pair("gpu", &gpu)}) {
+			const llvm::json::Object* target = root->getObject(key);
+			if (!target) {
+				continue;
+			}
+			if (auto cache_size = target->getInteger("cache_size")) {
+				params->cache_size = TRY(to_bits<uint64_t>(*cache_size, "Cache size"));
+			}
+			if (auto owner_pred = target->getBoolean("owner_pred")) {
+				params->owner_pred_available = *owner_pred;
+			}
+			if (auto producer = target->getBoolean("producer")) {
+				params->producer = *producer;
+			}
+			if (auto cores = target->getInteger("cores")) {
+				params->cores = *cores;
+			}
+			if (auto distribution = target->getString("distribution")) {
+				auto parsed = Distribution::_from_string_nothrow(distribution->str().c_str());
+				if (!parsed) {
+					return Err(str{"Unknown distribution '"} + distribution->str() + str{"'"});
+				}
+				params->distribution = *parsed;
+			}
+		}
+		return create(cpu, gpu);
+	}
+
+	// Parameters of the cores a node with this target hint runs on
+	const HardwareParams& of(hpvm::Target hint) const {
+		switch (hint) {
+		case hpvm::GPU_TARGET:
+		case hpvm::SPIR_TARGET:
+		case hpvm::CUDNN_TARGET:
+		case hpvm::PROMISE_TARGET:
+			return gpu;
+		default:
+			// Nodes that may run on either start out on the CPU
+			return cpu;
+		}
+	}
+
+	unsigned short block_size() const { return cpu.block_size; }
+	unsigned short word_size() const { return cpu.word_size; }
+
+private:
+	HardwareModel(HardwareParams _cpu, HardwareParams _gpu)
+		: cpu{_cpu}
+		, gpu{_gpu}
+	{ }
 };
 
+// Mask as a string of the words of a block, the first word last
+static str mask_to_string(const WordMask& mask, size_t words_per_block) {
+	return mask.to_string().substr(mask.size() - words_per_block);
+}
+
 class BoiledDownFunction;
 
 class MemoryAccess {
@@ -34,28 +198,99 @@ public:
 	MemoryAccess() = delete;
 	const llvm::Instruction& instruction;
 	AccessKind kind;
+	AccessRange range;
+	// First word the access touches
 	Address address;
+	// Every word the access touches over its loops, in the order they are first
+	// touched. Only the first word is known when bounded_footprint is false,
+	// which it is until expand_footprint. The other words are then only known
+	// to lie in the extent of range (see may_touch).
+	std::vector<Address> footprint;
+	bool bounded_footprint;
 	const BoiledDownFunction& bdf;
 	unsigned order;
 	Req req_type;
 	WordMask word_mask;
 private:
-	MemoryAccess(const llvm::Instruction& _instruction, AccessKind _kind, Address _address, const BoiledDownFunction& _bdf, unsigned _order)
+	MemoryAccess(const llvm::Instruction& _instruction, AccessKind _kind, AccessRange _range, Address _address, const BoiledDownFunction& _bdf, unsigned _order)
 		: instruction{_instruction}
 		, kind{_kind}
+		, range{std::move(_range)}
 		, address{_address}
+		, footprint{_address}
+		, bounded_footprint{false}
 		, bdf{_bdf}
 		, order{_order}
 		, req_type{+Req::unassigned}
 	{ }
 
+	// Fills footprint from the range, unless it is unbounded or has more than
+	// max_words words
+	bool get_footprint(size_t max_words, unsigned short word_size) {
+		if (!range.bounded() || range.count() > max_words) {
+			return false;
+		}
+		std::unordered_set<Address> seen;
+		bool valid = true;
+		range.for_each_offset([&](int64_t offset) {
+			if (offset < 0) {
+				valid = false;
+				return;
+			}
+			size_t first_word = offset * BYTE_SIZE / word_size * word_size;
+			for (size_t word = first_word; word < (offset + range.size) * BYTE_SIZE; word += word_size) {
+				Address word_address = address.at_offset(word);
+				if (seen.insert(word_address).second) {
+					footprint.push_back(word_address);
+				}
+			}
+		});
+		if (!valid || footprint.size() > max_words) {
+			footprint.clear();
+			return false;
+		}
+		return true;
+	}
+
 public:
 	static ResultStr<MemoryAccess>
-	create(const llvm::DataLayout& data_layout, const llvm::Instruction& instruction, const HardwareParams& hw_params, const BoiledDownFunction& bdf, unsigned order) {
-		auto [pointer, kind] = TRY(get_pointer_target(instruction));
-		Address address = TRY(Address::create(data_layout, pointer.get(), hw_params.block_size));
-		return Ok(MemoryAccess{instruction, kind, address, bdf, order});
+	create(llvm::ScalarEvolution& SE, const llvm::DataLayout& data_layout, const llvm::Instruction& instruction, const HardwareParams& hw_params, const BoiledDownFunction& bdf, unsigned order) {
+		auto pointer_x_kind = TRY(get_pointer_target(instruction));
+		AccessRange range = TRY(AccessRange::create(SE, data_layout, instruction));
+		if (range.offset < 0) {
+			return Err(str{"Access '"} + llvm_to_str(instruction) + str{"' is before the start of its segment"});
+		}
+		// Assume access is to word
+		size_t offset = range.offset * BYTE_SIZE / hw_params.word_size * hw_params.word_size;
+		Address address = TRY(Address::create(range.base, offset, hw_params.block_size));
+		return Ok(MemoryAccess{instruction, pointer_x_kind.second, std::move(range), address, bdf, order});
 	}
+	/*
+	Expands the footprint from the range. Only reads the access, so accesses
+	can be expanded in parallel once ScalarEvolution is done with them.
+
+	Ranges with a runtime trip count or stride, or with more words than fit in
+	the cache, are not expanded. The conflicts of such an access are instead
+	found by intersecting the extent of its range with the footprints and
+	ranges of the other accesses (see BoiledDownFunction::range_conflicts), so
+	they are kept, only at a coarser granularity.
+	*/
+	void expand_footprint(const HardwareParams& hw_params) {
+		// A larger footprint overflows the cache on its own
+		size_t max_footprint = hw_params.cache_size / hw_params.word_size;
+		footprint.clear();
+		bounded_footprint = get_footprint(max_footprint, hw_params.word_size);
+		if (!bounded_footprint) {
+			footprint.clear();
+			footprint.push_back(address);
+		}
+	}
+	// Words of block the access touches
+	WordMask words_in(const Block& block) const;
+	// Whether the access may touch a byte in [from, to) of its segment, or in
+	// [from, ...) without to, over all its iterations
+	bool may_touch(int64_t from, std::optional<int64_t> to) const;
+	bool false_shared() const;
 	float criticality_weight() const;
 	bool operator==(const MemoryAccess& other) const {
 		return this == &other;
@@ -72,17 +307,94 @@ bool iterator_in_range(const Iterator it, const Range range, bool not_end = fals
 		: range .begin() <= it && (not_end ? it < range .end() : it <= range .end());
 }
 
+/*
+Alias classes of the arguments of function, as the lowest argument number in
+the class of each argument. Two pointer arguments are in the same class if
+alias analysis finds that they must alias, or the DFG binds them to the same
+buffer (bound_args), unless alias analysis finds that they cannot alias.
+Arguments the node only reads (HPVM In without Out) are not joined to each
+other, since they cannot conflict in it. Other arguments are assumed not to
+alias.
+*/
+static std::vector<unsigned> alias_classes(const llvm::Function& function, llvm::AAResults& AA, const std::vector<std::pair<unsigned, unsigned>>& bound_args) {
+	std::vector<unsigned> classes(function.arg_size());
+	std::iota(classes.begin(), classes.end(), 0);
+	auto find = [&](unsigned arg_no) {
+		while (classes[arg_no] != arg_no) {
+			arg_no = classes[arg_no] = classes[classes[arg_no]];
+		}
+		return arg_no;
+	};
+	auto read_only = [&](unsigned arg_no) {
+		return function.hasAttribute(arg_no + 1, llvm::Attribute::In)
+			&& !function.hasAttribute(arg_no + 1, llvm::Attribute::Out);
+	};
+	auto join = [&](unsigned a, unsigned b, bool bound) {
+		const llvm::Argument& arg_a = ptr2ref<llvm::Argument>(function.arg_begin() + a);
+		const llvm::Argument& arg_b = ptr2ref<llvm::Argument>(function.arg_begin() + b);
+		if (!arg_a.getType()->isPointerTy() || !arg_b.getType()->isPointerTy() || (read_only(a) && read_only(b))) {
+			return;
+		}
+		llvm::AliasResult alias = AA.alias(
+			llvm::MemoryLocation(&arg_a, llvm::LocationSize::unknown()),
+			llvm::MemoryLocation(&arg_b, llvm::LocationSize::unknown())
+		);
+		if (alias == llvm::MustAlias || (bound && alias != llvm::NoAlias)) {
+			unsigned class_a = find(a);
+			unsigned class_b = find(b);
+			classes[std::max(class_a, class_b)] = std::min(class_a, class_b);
+		}
+	};
+	for (const auto& [a, b] : bound_args) {
+		if (a < function.arg_size() && b < function.arg_size()) {
+			join(a, b, true);
+		}
+	}
+	for (unsigned a = 0; a < function.arg_size(); ++a) {
+		for (unsigned b = a + 1; b < function.arg_size(); ++b) {
+			join(a, b, false);
+		}
+	}
+	for (unsigned arg_no = 0; arg_no < classes.size(); ++arg_no) {
+		classes[arg_no] = find(arg_no);
+	}
+	return classes;
+}
+
 class BoiledDownFunction {
 private:
 	std::vector<MemoryAccess> accesses;
 	std::unordered_map<Address, std::vector<Ref<MemoryAccess>>> accesses_to_loc;
 	std::unordered_map<Block, std::vector<Ref<MemoryAccess>>> accesses_to_block;
+	// Words of the footprints of all accesses, in order: the words of access k
+	// start at position access_words[k]
+	DistinctInRange<Address> word_reuse;
+	std::vector<size_t> access_words;
+	// Number of accesses with an unbounded footprint before access k
+	std::vector<size_t> unbounded_before;
 	const HardwareParams& hw_params;
 	const llvm::Function& function;
-	BoiledDownFunction(const HardwareParams& _hw_params, const llvm::Function& _function)
+	// Lowest argument number in the alias class of each argument
+	std::vector<unsigned> classes;
+	// Instances of the node, if known
+	std::optional<uint64_t> instances;
+	BoiledDownFunction(const HardwareParams& _hw_params, const llvm::Function& _function, std::vector<unsigned> _classes, std::optional<uint64_t> _instances)
 		: hw_params{_hw_params}
 		, function{_function}
+		, classes{std::move(_classes)}
+		, instances{_instances}
 	{ }
+	static const std::vector<Ref<MemoryAccess>>& no_conflicts() {
+		static const std::vector<Ref<MemoryAccess>> empty;
+		return empty;
+	}
+	// Inserts access in conflicts, which are in order
+	static void insert_in_order(std::vector<Ref<MemoryAccess>>& conflicts, const MemoryAccess& access) {
+		auto it = std::upper_bound(conflicts.begin(), conflicts.end(), access.order, [](unsigned order, const Ref<MemoryAccess>& other) {
+			return order < other.get().order;
+		});
+		conflicts.emplace(it, access);
+	}
 public:
 	BoiledDownFunction() = delete;
 	BoiledDownFunction& operator=(const BoiledDownFunction&) = delete;
@@ -92,62 +404,150 @@ public:
 		: accesses{std::move(other.accesses)}
 		, accesses_to_loc{std::move(other.accesses_to_loc)}
 		, accesses_to_block{std::move(other.accesses_to_block)}
+		, word_reuse{std::move(other.word_reuse)}
+		, access_words{std::move(other.access_words)}
+		, unbounded_before{std::move(other.unbounded_before)}
 		, hw_params{other.hw_params}
 		, function{other.function}
+		, classes{std::move(other.classes)}
+		, instances{other.instances}
 	{ }
 	
-	BoiledDownFunction(const llvm::Function& function, const llvm::DataLayout& data_layout, const HardwareParams& hw_params)
-		: BoiledDownFunction{hw_params, function}
+	/*
+	Accesses are collected in reverse post-order of the basic blocks, so an
+	access comes after the ones that dominate it. An access under a branch is
+	assumed to execute, and one under a loop stands for all its iterations
+	through its AccessRange. Accesses are indexed by the location in the first
+	argument of their alias class (see alias_classes), so the accesses through
+	aliased arguments conflict with each other and share their words.
+
+	Construction queries ScalarEvolution, which creates constants in the
+	LLVMContext, so it runs on the thread of the pass. The BDF must then be
+	indexed before it is analyzed.
+	*/
+	BoiledDownFunction(const llvm::Function& function, const llvm::DataLayout& data_layout, const HardwareParams& hw_params, llvm::ScalarEvolution& SE, std::vector<unsigned> classes, std::optional<uint64_t> instances)
+		: BoiledDownFunction{hw_params, function, std::move(classes), instances}
 	{
-		if (&function.front() != &function.back()) {
-			//return Err("Spandex pass supports straight-line code for now. Function is not straight-line:\n" + llvm_to_str_ndbg(function));
-			std::cerr << "Spandex pass supports straight-line code for now. Function is not straight-line:\n" + llvm_to_str_ndbg(function);
-			abort();
-		} else {
-			const llvm::BasicBlock& basic_block = function.getEntryBlock();
-			for (const llvm::Instruction& instruction : basic_block) {
-				if (is_memory_access(instruction)) {
-					ResultStr<MemoryAccess> access = MemoryAccess::create(data_layout, instruction, hw_params, *this, this->accesses.size());
-					if (access.isErr()) {
-						std::cerr << access.unwrapErr() << std::endl;
-						abort();
-					} else if (access.unwrap().kind == +AccessKind::rmw || access.unwrap().kind == +AccessKind::cas) {
-						std::cerr << "Spandex pass does not support atomics yet.\n";
-						abort();
-						//return Err(str{"Spandex pass does not support atomics yet."});
-					} else {
-						this->accesses.push_back(access.unwrap());
-					}
+		for (const llvm::Instruction& instruction : memory_accesses(function)) {
+			ResultStr<MemoryAccess> access = MemoryAccess::create(SE, data_layout, instruction, hw_params, *this, this->accesses.size());
+			if (access.isErr()) {
+				std::cerr << access.unwrapErr() << std::endl;
+				abort();
+			} else {
+				this->accesses.push_back(access.unwrap());
+			}
+		}
+	}
+	/*
+	Expands the footprints of the accesses and indexes them by location.
+	Only touches this BDF, so BDFs can be indexed in parallel.
+	*/
+	void index() {
+		for (MemoryAccess& access : this->accesses) {
+			access.expand_footprint(hw_params);
+		}
+		for (const MemoryAccess& access : this->accesses) {
+			std::unordered_set<Block> blocks;
+			for (const Address& word : access.footprint) {
+				const Address canonical_word = canonical(word);
+				this->accesses_to_loc[canonical_word].emplace_back(access);
+				if (blocks.insert(canonical_word.block).second) {
+					this->accesses_to_block[canonical_word.block].emplace_back(access);
 				}
 			}
-			for (const MemoryAccess& access : this->accesses) {
-				this->accesses_to_loc  [access.address      ].emplace_back(access);
-				this->accesses_to_block[access.address.block].emplace_back(access);
+		}
+
+		// An access whose footprint was not expanded is only indexed at its first
+		// word above. It still conflicts with the other accesses to the words and
+		// blocks of its segment that its range may touch.
+		const int64_t word_bytes = hw_params.word_size / BYTE_SIZE;
+		const int64_t block_bytes = hw_params.block_size / BYTE_SIZE;
+		for (const MemoryAccess& access : this->accesses) {
+			if (access.bounded_footprint) {
+				continue;
+			}
+			const Address first = canonical(access.address);
+			for (auto& [word, conflicts] : accesses_to_loc) {
+				const int64_t from = int64_t(word.offset() / BYTE_SIZE);
+				if (word.block.segment == first.block.segment && word != first && access.may_touch(from, from + word_bytes)) {
+					insert_in_order(conflicts, access);
+				}
+			}
+			for (auto& [block, conflicts] : accesses_to_block) {
+				const int64_t from = int64_t(block.block_index) * block_bytes;
+				if (block.segment == first.block.segment && block != first.block && access.may_touch(from, from + block_bytes)) {
+					insert_in_order(conflicts, access);
+				}
 			}
-			//return Ok(std::move(bdf));
 		}
-	}
-	void emulate_cache(std::unordered_set<Address>& cache, const MemoryAccess& begin, const MemoryAccess& end) const {
-		// TODO: this algorithm overestimates the cache, because it doesn't consider aliasing between arguments
-		// TODO: improve performance of this algorithm with a Binary Indexed Tree
-		auto begin_it = std::find_if(accesses.cbegin(), accesses.cend(), curried_address_equality<MemoryAccess>(begin));
-		auto end_it   = std::find_if(accesses.cbegin(), accesses.cend(), curried_address_equality<MemoryAccess>(end  ));
-		for (auto it = begin_it; it != end_it; ++it) {
-			// Assume access is to word
-			assert(it->address.aligned(WORD_SIZE));
-			for (unsigned short byte = 0; byte < WORD_SIZE; ++byte) {
-				cache.insert(it->address + byte);
+
+		std::vector<Address> words;
+		access_words.push_back(0);
+		unbounded_before.push_back(0);
+		for (const MemoryAccess& access : this->accesses) {
+			for (const Address& word : access.footprint) {
+				words.push_back(canonical(word));
 			}
+			access_words.push_back(words.size());
+			unbounded_before.push_back(unbounded_before.back() + !access.bounded_footprint);
 		}
+		word_reuse = DistinctInRange<Address>{words};
+	}
+	/*
+	Number of distinct words the accesses from index from up to index to
+	touch, in O(log n). Returns nothing if one of them has an unbounded
+	footprint, which is taken to overflow the cache.
+	*/
+	std::optional<size_t> distinct_words(size_t from, size_t to) const {
+		assert(from <= to && to <= accesses.size());
+		if (unbounded_before[to] != unbounded_before[from]) {
+			return std::nullopt;
+		}
+		return word_reuse.count(access_words[from], access_words[to]);
+	}
+	// The same location through the first argument of its alias class
+	Block canonical(const Block& block) const {
+		const auto* argument = llvm::dyn_cast<llvm::Argument>(&block.segment.base);
+		if (!argument || argument->getParent() != &function || classes[argument->getArgNo()] == argument->getArgNo()) {
+			return block;
+		}
+		return block.rebase(ptr2ref<llvm::Argument>(function.arg_begin() + classes[argument->getArgNo()]));
+	}
+	Address canonical(const Address& address) const {
+		Block block = canonical(address.block);
+		return &block.segment.base == &address.block.segment.base ? address : address.rebase(block.segment.base);
 	}
 	const std::vector<Ref<MemoryAccess>>& all_loc_conflicts(const Address& address) const {
-		return const_cast<BoiledDownFunction&>(*this).accesses_to_loc[address];
+		auto it = accesses_to_loc.find(canonical(address));
+		return it == accesses_to_loc.end() ? no_conflicts() : it->second;
 	}
 	const std::vector<Ref<MemoryAccess>>& all_block_conflicts(const Block& block) const {
-		return const_cast<BoiledDownFunction&>(*this).accesses_to_block[block];
+		auto it = accesses_to_block.find(canonical(block));
+		return it == accesses_to_block.end() ? no_conflicts() : it->second;
+	}
+	/*
+	Accesses that may touch the words (or lines, with blocks) that range may
+	touch, in order. range starts at address, which is in this BDF. These are
+	the conflicts of an access whose footprint was not expanded, in place of
+	the ones of its first word.
+	*/
+	std::vector<Ref<MemoryAccess>> range_conflicts(const Address& address, const AccessRange& range, bool blocks) const {
+		const Segment segment = canonical(address).block.segment;
+		const int64_t unit = (blocks ? hw_params.block_size : hw_params.word_size) / BYTE_SIZE;
+		// The extent of range, widened to whole words or lines
+		auto [first, last] = range.extent();
+		const int64_t from = first.has_value() ? std::max<int64_t>(0, *first) / unit * unit : 0;
+		const std::optional<int64_t> to = last.has_value() ? std::optional<int64_t>{(*last + unit - 1) / unit * unit} : std::nullopt;
+		std::vector<Ref<MemoryAccess>> result;
+		for (const MemoryAccess& access : accesses) {
+			if (canonical(access.address).block.segment == segment && access.may_touch(from, to)) {
+				result.emplace_back(access);
+			}
+		}
+		return result;
 	}
 	WordMask intra_synch_load_reuse(const MemoryAccess& X) const {
-		WordMask mask;
+		WordMask mask = X.words_in(X.address.block);
 		std::unordered_set<Address> cache;
 		intra_synch_load_reuse(X, mask, cache);
 		return mask;
@@ -159,15 +559,13 @@ public:
 		assert(it != accesses_to_block.cend());
 		for (; it != accesses_to_block.cend(); ++it) {
 			// Assume access is to word
-			assert(it->get().address.aligned(WORD_SIZE));
-			cache.insert(it->get().address);
+			assert(it->get().address.aligned(hw_params.word_size));
+			cache.insert(it->get().footprint.cbegin(), it->get().footprint.cend());
 			if (cache.size() > 0.75 * hw_params.cache_size) {
 				break;
 			}
-			if (it->get().kind == +AccessKind::load && it->get().address.block == X.address.block) {
-				size_t word_index = it->get().address.block_offset / WORD_SIZE;
-				assert(word_index < mask.size());
-				mask.set(word_index);
+			if (it->get().kind == +AccessKind::load) {
+				mask |= it->get().words_in(X.address.block);
 			}
 		}
 	}
@@ -176,6 +574,30 @@ public:
 	const llvm::Function& get_function() const { return function; }
 	const HardwareParams& get_hw_params() const { return hw_params; }
 	Core get_core() const { return hw_params.core; }
+	/*
+	The instances of the node run on instance_cores() cores of its kind,
+	instance 0 on core 0, so the first instance, which the accesses are
+	computed for, runs on get_core(). An unknown number of instances is taken to
+	fill all cores.
+	*/
+	unsigned instance_cores() const {
+		return instances.has_value() ? unsigned(std::min<uint64_t>(hw_params.cores, *instances)) : hw_params.cores;
+	}
+	// Consecutive instances on one core under the block distribution
+	std::optional<uint64_t> instances_per_core() const {
+		if (!instances.has_value()) {
+			return std::nullopt;
+		}
+		return (*instances + instance_cores() - 1) / std::max(1u, instance_cores());
+	}
+	// Words of block the first instance touches
+	WordMask instance_words(const Block& block) const {
+		WordMask mask;
+		for (const MemoryAccess& access : all_block_conflicts(block)) {
+			mask |= access.words_in(block);
+		}
+		return mask;
+	}
 	bool operator==(const BoiledDownFunction& other) const {
 		return this == &other;
 	}
@@ -184,6 +606,72 @@ public:
 	}
 };
 
+WordMask MemoryAccess::words_in(const Block& block) const {
+	WordMask mask;
+	const Block canonical_block = bdf.canonical(block);
+	if (!bounded_footprint) {
+		// Every word of the block the range may touch
+		if (bdf.canonical(address.block).segment == canonical_block.segment) {
+			const HardwareParams& hw_params = bdf.get_hw_params();
+			const int64_t word_bytes = hw_params.word_size / BYTE_SIZE;
+			const int64_t block_start = int64_t(block.block_index) * (hw_params.block_size / BYTE_SIZE);
+			for (size_t word_index = 0; word_index < hw_params.words_per_block(); ++word_index) {
+				const int64_t from = block_start + int64_t(word_index) * word_bytes;
+				if (range.may_touch(from, from + word_bytes)) {
+					mask.set(word_index);
+				}
+			}
+		}
+		return mask;
+	}
+	for (const Address& word : footprint) {
+		if (bdf.canonical(word.block) == canonical_block) {
+			size_t word_index = word.block_offset / bdf.get_hw_params().word_size;
+			assert(word_index < mask.size());
+			mask.set(word_index);
+		}
+	}
+	return mask;
+}
+
+bool MemoryAccess::may_touch(int64_t from, std::optional<int64_t> to) const {
+	if (!bounded_footprint) {
+		return range.may_touch(from, to.value_or(std::numeric_limits<int64_t>::max()));
+	}
+	const int64_t word_bytes = bdf.get_hw_params().word_size / BYTE_SIZE;
+	return std::any_of(footprint.cbegin(), footprint.cend(), [&](const Address& word) {
+		const int64_t first = int64_t(word.offset() / BYTE_SIZE);
+		return from < first + word_bytes && (!to.has_value() || first < *to);
+	});
+}
+
+/*
+Whether instances of the node on other cores touch other words of the line of
+X, while one of them writes it. Instance i+1 accesses the line
+range.instance_stride bytes after instance i. Under the block distribution
+only lines inside a chunk are counted, not the ones at its edges.
+*/
+bool MemoryAccess::false_shared() const {
+	const HardwareParams& hw_params = bdf.get_hw_params();
+	if (bdf.instance_cores() <= 1 || !range.instance_stride.has_value() || *range.instance_stride == 0) {
+		return false;
+	}
+	uint64_t stride = uint64_t(std::abs(*range.instance_stride)) * BYTE_SIZE;
+	if (stride >= hw_params.block_size) {
+		return false;
+	}
+	if (hw_params.distribution == +Distribution::block) {
+		std::optional<uint64_t> per_core = bdf.instances_per_core();
+		if (!per_core.has_value() || *per_core * stride >= hw_params.block_size) {
+			return false;
+		}
+	}
+	const auto& block_conflicts = bdf.all_block_conflicts(address.block);
+	return std::any_of(block_conflicts.cbegin(), block_conflicts.cend(), [](const MemoryAccess& access) {
+		return is_write(access.kind);
+	});
+}
+
 float MemoryAccess::criticality_weight() const {
 		if (bdf.get_core().target == hpvm::CPU_TARGET
 		    && (kind == +AccessKind::load || kind == +AccessKind::cas || kind == +AccessKind::rmw)) {
@@ -204,41 +692,201 @@ struct BdfDfgEquality {
 	}
 };
 
+// Hashes the BDF the node refers to, not the reference_wrapper holding it, so
+// that equal nodes built in different places hash alike
 struct BdfDfgHasher {
 	std::size_t operator()(const BdfDfgNode& a) const noexcept {
-		return reinterpret_cast<size_t>(&a.first) ^ a.second;
+		return std::hash<const BoiledDownFunction*>{}(&a.first.get()) ^ std::hash<unsigned>{}(a.second);
 	}
 };
 
 typedef Digraph<BdfDfgNode, BdfDfgHasher, BdfDfgEquality> BdfDfg;
+typedef CsrGraph<BdfDfgNode, BdfDfg> BdfCsr;
 
-BfsIt<BdfDfgNode, BdfDfg>
-get_static_trace(const BdfDfg& dfg, const MemoryAccess& X) {
+/*
+BDFs that may access the memory of X after X.bdf (or before, in the reverse
+DFG), in the order they run. Each BDF occurs once, however many paths lead to
+it.
+*/
+std::vector<BdfDfgNode>
+get_static_trace(const BdfCsr& dfg, const MemoryAccess& X) {
 	const auto& argument = ptr2ref<llvm::Argument>(llvm::dyn_cast<llvm::Argument>(&X.address.block.segment.base));
-	return BfsIt<BdfDfgNode, BdfDfg>{
+	return topological_descendants<BdfDfgNode, BdfCsr>(
 		dfg,
 		BdfDfgNode(std::cref(X.bdf), argument.getArgNo())
-	};
+	);
 }
 
+llvm::raw_ostream &operator<<(llvm::raw_ostream &stream, const BdfDfgNode &node) {
+	return stream << demangle(node.first.get().get_function().getName().str()) << "[" << node.second << "]";
+}
+
+// Prints the static trace of every node of dfg, one line per node
+void dump_static_traces(llvm::raw_ostream &os, const BdfCsr& dfg) {
+	for (BdfCsr::NodeId id = 0; id < dfg.size(); ++id) {
+		os << "Trace of " << dfg.node(id) << ":";
+		for (const BdfDfgNode& node : topological_descendants<BdfDfgNode, BdfCsr>(dfg, dfg.node(id))) {
+			os << " " << node;
+		}
+		os << "\n";
+	}
+}
+
+/*
+Memo tables for the walks over the static traces of one DFG. Accesses to the
+same location of the same BDF share their trace, and in every BDF of it the
+equivalent location and its conflict lists, so the walks cost time
+proportional to the distinct locations rather than to the accesses.
+*/
+class TraceMemo {
+public:
+	// A BDF of a trace, with the location the walk looks at in it
+	struct Step {
+		Ref<BoiledDownFunction> bdf;
+		// Equivalent in bdf to the address of the walk, which is aliased to it
+		Address address;
+		const std::vector<Ref<MemoryAccess>>& loc_conflicts;
+		const std::vector<Ref<MemoryAccess>>& block_conflicts;
+	};
+
+	explicit TraceMemo(const BdfCsr& _dfg) : dfg{_dfg} { }
+	TraceMemo(const TraceMemo&) = delete;
+	TraceMemo& operator=(const TraceMemo&) = delete;
+
+	const std::vector<BdfDfgNode>& trace(const MemoryAccess& X) {
+		const auto& argument = ptr2ref<llvm::Argument>(llvm::dyn_cast<llvm::Argument>(&X.address.block.segment.base));
+		PortKey key{&X.bdf, argument.getArgNo()};
+		auto it = traces.find(key);
+		if (it == traces.end()) {
+			it = traces.emplace(key, get_static_trace(dfg, X)).first;
+		}
+		return it->second;
+	}
+
+	/*
+	The trace of X, with the address of X rebased in each BDF. If the
+	footprint of X was not expanded, the conflicts in each BDF are the ones of
+	its whole range rather than of its first word, and the walk is X's own.
+	*/
+	const std::vector<Step>& walk(const MemoryAccess& X) {
+		LocKey key{&X.bdf, X.address, X.bounded_footprint ? nullptr : &X};
+		auto it = walks.find(key);
+		if (it == walks.end()) {
+			std::vector<Step> steps;
+			for (auto [bdf, arg_no] : trace(X)) {
+				const auto& function = bdf.get().get_function();
+				assert(arg_no < function.arg_size());
+				const auto& equiv_argument = ptr2ref<llvm::Argument>(function.arg_begin() + arg_no);
+				const Address equiv_address = X.address.rebase(equiv_argument);
+				if (X.bounded_footprint) {
+					steps.push_back(Step{
+						bdf,
+						equiv_address,
+						bdf.get().all_loc_conflicts(equiv_address),
+						bdf.get().all_block_conflicts(equiv_address.block),
+					});
+				} else {
+					const auto& loc_conflicts = range_conflicts.emplace_back(bdf.get().range_conflicts(equiv_address, X.range, false));
+					const auto& block_conflicts = range_conflicts.emplace_back(bdf.get().range_conflicts(equiv_address, X.range, true));
+					steps.push_back(Step{bdf, equiv_address, loc_conflicts, block_conflicts});
+				}
+			}
+			it = walks.emplace(key, std::move(steps)).first;
+		}
+		return it->second;
+	}
+
+	struct BlockKeyHasher {
+		std::size_t operator()(const std::pair<const BoiledDownFunction*, Block>& key) const noexcept {
+			return reinterpret_cast<size_t>(key.first) ^ std::hash<Block>{}(key.second);
+		}
+	};
+	template <typename T>
+	using BlockTable = std::unordered_map<std::pair<const BoiledDownFunction*, Block>, T, BlockKeyHasher>;
+
+	// Result of fn for the block of X in X.bdf, computed once per block. An
+	// access whose footprint was not expanded has its own walk, so its result
+	// is not shared.
+	template <typename T, typename Fn>
+	static T per_block(BlockTable<T>& table, const MemoryAccess& X, Fn fn) {
+		if (!X.bounded_footprint) {
+			return fn();
+		}
+		auto key = std::make_pair(&X.bdf, X.address.block);
+		auto it = table.find(key);
+		if (it == table.end()) {
+			it = table.emplace(key, fn()).first;
+		}
+		return it->second;
+	}
+
+	// Results that only depend on the BDF and block of an access
+	BlockTable<bool> shared_state;
+	BlockTable<WordMask> inter_synch_reuse;
+
+private:
+	// Traces are shared by the accesses through the same port of a BDF
+	typedef std::pair<const BoiledDownFunction*, unsigned> PortKey;
+	struct PortKeyHasher {
+		std::size_t operator()(const PortKey& key) const noexcept {
+			return std::hash<const BoiledDownFunction*>{}(key.first) ^ std::hash<unsigned>{}(key.second);
+		}
+	};
+	// Walks are shared by the accesses to a location, except the ones whose
+	// footprint was not expanded
+	struct LocKey {
+		const BoiledDownFunction* bdf;
+		Address address;
+		const MemoryAccess* unexpanded;
+		bool operator==(const LocKey& other) const {
+			return bdf == other.bdf && address == other.address && unexpanded == other.unexpanded;
+		}
+	};
+	struct LocKeyHasher {
+		std::size_t operator()(const LocKey& key) const noexcept {
+			return reinterpret_cast<size_t>(key.bdf) ^ std::hash<Address>{}(key.address) ^ reinterpret_cast<size_t>(key.unexpanded);
+		}
+	};
+
+	const BdfCsr& dfg;
+	std::unordered_map<PortKey, std::vector<BdfDfgNode>, PortKeyHasher> traces;
+	std::unordered_map<LocKey, std::vector<Step>, LocKeyHasher> walks;
+	// Conflict lists of the walks of accesses whose footprint was not expanded
+	std::list<std::vector<Ref<MemoryAccess>>> range_conflicts;
+};
+
 bool reuse_possible(
-					const BdfDfg& dfg,
+					TraceMemo& traces,
 					const MemoryAccess& begin,
 					const MemoryAccess& end
 					) {
-	std::unordered_set<Address> cache;
-	for (auto [bdf, arg_no] : get_static_trace(dfg, begin)) {
-		if (bdf.get().get_core() == begin.bdf.get_core()) {
-			bdf.get().emulate_cache(cache, begin, end);
+	// Words touched on the core from begin up to end: the rest of the BDF of
+	// begin, the BDFs on the same core in between, then the BDF of end up to
+	// it. Different BDFs address their words through different arguments, so
+	// their counts add up.
+	size_t words = 0;
+	for (auto [bdf, arg_no] : traces.trace(begin)) {
+		if (bdf.get().get_core() != begin.bdf.get_core()) {
+			continue;
+		}
+		size_t from = bdf.get() == begin.bdf ? begin.order : 0;
+		size_t to = bdf.get() == end.bdf ? end.order : bdf.get().get_all_accesses().size();
+		std::optional<size_t> bdf_words = bdf.get().distinct_words(from, std::max(from, to));
+		if (!bdf_words.has_value()) {
+			return false;
+		}
+		words += *bdf_words;
+		if (bdf.get() == end.bdf) {
+			break;
 		}
 	}
-	return cache.size() < begin.bdf.get_hw_params().cache_size * 0.75;
+	return words * begin.bdf.get_hw_params().word_size < begin.bdf.get_hw_params().cache_size * 0.75;
 }
 
 /*
 Algorithm 5: Is ownership beneficial?
 */
-static bool ownership_beneficial(const BdfDfg& dfg, const MemoryAccess& X) {
+static bool ownership_beneficial(TraceMemo& traces, const MemoryAccess& X) {
 	char phase = 4;
 	float X_score = 0.0;
 
@@ -246,17 +894,12 @@ static bool ownership_beneficial(const BdfDfg& dfg, const MemoryAccess& X) {
 	// Therefore the algoirhtm simply sets Y_prev to the last conflicting access in the same BDF
 	const MemoryAccess* Y_prev = &(X.bdf.all_loc_conflicts(X.address).end() - 1)->get();
 
-	for (auto [bdf, arg_no] : get_static_trace(dfg, X)) {
-		const auto& function = bdf.get().get_function();
-		assert(arg_no < function.arg_size());
-		const auto& equiv_argument = ptr2ref<llvm::Argument>(function.arg_begin() + arg_no);
-		// equiv_address in bdf is aliased to X.address in X.bdf
-		const Address equiv_address = X.address.rebase(equiv_argument);
+	for (const TraceMemo::Step& step : traces.walk(X)) {
 		bool sync_sept = true;
-		for (const MemoryAccess& Y : bdf.get().all_loc_conflicts(equiv_address)) {
+		for (const MemoryAccess& Y : step.loc_conflicts) {
 			if (Y_prev->bdf.get_core() != Y.bdf.get_core() || sync_sept) {
 				phase--;
-				if (phase < 0 || (Y_prev->bdf.get_core() == Y.bdf.get_core() && reuse_possible(dfg, X, Y))) {
+				if (phase < 0 || (Y_prev->bdf.get_core() == Y.bdf.get_core() && reuse_possible(traces, X, Y))) {
 					break;
 				}
 				float Y_val = phase * Y.criticality_weight();
@@ -279,45 +922,43 @@ static bool ownership_beneficial(const BdfDfg& dfg, const MemoryAccess& X) {
 /*
 Algorithm 6: Is shared-state beneficial?
 */
-static bool shared_state_beneficial(const BdfDfg& dfg, const MemoryAccess& X) {
-	if (X.bdf.get_core().target == hpvm::GPU_TARGET) {
+static bool shared_state_beneficial(TraceMemo& traces, const MemoryAccess& X) {
+	// A line written by other instances on other cores does not stay shared
+	if (X.bdf.get_core().target == hpvm::GPU_TARGET || X.false_shared()) {
 		return false;
 	}
 
-	// Everything in the same BDF is not sync seperated and same core
-	// Therefore the algoirhtm simply sets Y_prev to the last conflicting access in the same BDF
-	const MemoryAccess* Y_prev = &(X.bdf.all_block_conflicts(X.address.block).end() - 1)->get();
-
-	for (auto [bdf, arg_no] : get_static_trace(dfg, X)) {
-		const auto& function = bdf.get().get_function();
-		assert(arg_no < function.arg_size());
-		const auto& equiv_argument = ptr2ref<llvm::Argument>(function.arg_begin() + arg_no);
-		// equiv_address in bdf is aliased to X.address in X.bdf
-		const Address equiv_address = X.address.rebase(equiv_argument);
-		bool sync_sept = true;
-		for (const MemoryAccess& Y : bdf.get().all_block_conflicts(equiv_address.block)) {
-			if (Y_prev->bdf.get_core() != Y.bdf.get_core() || sync_sept) {
-				if (Y.kind == +AccessKind::load && X.bdf.get_core() == Y.bdf.get_core()) {
-					return true;
+	return TraceMemo::per_block(traces.shared_state, X, [&]() {
+		// Everything in the same BDF is not sync seperated and same core
+		// Therefore the algoirhtm simply sets Y_prev to the last conflicting access in the same BDF
+		const MemoryAccess* Y_prev = &(X.bdf.all_block_conflicts(X.address.block).end() - 1)->get();
+
+		for (const TraceMemo::Step& step : traces.walk(X)) {
+			bool sync_sept = true;
+			for (const MemoryAccess& Y : step.block_conflicts) {
+				if (Y_prev->bdf.get_core() != Y.bdf.get_core() || sync_sept) {
+					if (Y.kind == +AccessKind::load && X.bdf.get_core() == Y.bdf.get_core()) {
+						return true;
+					}
+					if (is_write(Y.kind) && X.bdf.get_core() != Y.bdf.get_core()) {
+						return false;
+					}
 				}
-				if (Y.kind == +AccessKind::store && X.bdf.get_core() != Y.bdf.get_core()) {
-					return false;
+				Y_prev = &Y;
+				if (sync_sept) {
+					// sync_sept should only be true fir the firs titeration of the new bdf
+					sync_sept = false;
 				}
 			}
-			Y_prev = &Y;
-			if (sync_sept) {
-				// sync_sept should only be true fir the firs titeration of the new bdf
-				sync_sept = false;
-			}
 		}
-	}
-	return false;
+		return false;
+	});
 }
 
 /*
 Algorithm 7: Is owner-prediction beneficial?
 */
-static bool owner_pred_beneficial(const BdfDfg&, const BdfDfg& reverse_dfg, const MemoryAccess& X) {
+static bool owner_pred_beneficial(TraceMemo&, TraceMemo& reverse_traces, const MemoryAccess& X) {
 	char phase = 4;
 	float X_score = 0.0;
 	const auto* conflicts = &X.bdf.all_loc_conflicts(X.address);
@@ -325,15 +966,9 @@ static bool owner_pred_beneficial(const BdfDfg&, const BdfDfg& reverse_dfg, cons
 	auto Y = X_prev;
 	bool first_time = true;
 
-	for (auto [bdf, arg_no] : get_static_trace(reverse_dfg, X)) {
-		const auto& function = bdf.get().get_function();
-		assert(arg_no < function.arg_size());
-		const auto& equiv_argument = ptr2ref<llvm::Argument>(function.arg_begin() + arg_no);
-		// equiv_address in bdf is aliased to X.address in X.bdf
-		const Address equiv_address = X.address.rebase(equiv_argument);
-
+	for (const TraceMemo::Step& step : reverse_traces.walk(X)) {
 		if (!first_time) {
-			conflicts = &bdf.get().all_loc_conflicts(equiv_address);
+			conflicts = &step.loc_conflicts;
 			Y = conflicts->cend();
 			first_time = false;
 		}
@@ -362,23 +997,77 @@ static bool owner_pred_beneficial(const BdfDfg&, const BdfDfg& reverse_dfg, cons
 
 static WordMask requested_words_only(const MemoryAccess& X) {
 	WordMask mask;
-	size_t word_index = X.address.block_offset / WORD_SIZE;
+	size_t word_index = X.address.block_offset / X.bdf.get_hw_params().word_size;
 	assert(word_index < mask.size());
 	mask.set(word_index);
 	return mask;
 }
 
-static Req assign_request_type(const BdfDfg& dfg, const BdfDfg& reverse_dfg, const MemoryAccess& X) {
+/*
+Request type of X from what a run measured, in place of the phase counting
+and criticality weights of Algorithms 1 to 3:
+- the core reuses a word if it touches it again within 3/4 of the cache,
+  taking each access in between to touch a new word;
+- it owns what it reuses and no other core touches (loads), or what it
+  mostly wrote last itself (stores and RMWs);
+- it predicts the owner when most accesses find the word last written by
+  another core, and keeps lines in S (CPU loads) when it reuses them and
+  mostly reads its own data.
+*/
+static Req measured_request_type(const AccessProfile& measured, const MemoryAccess& X) {
+	const HardwareParams& hw_params = X.bdf.get_hw_params();
+	bool reused = measured.reuse_distance.has_value()
+		&& *measured.reuse_distance * hw_params.word_size < hw_params.cache_size * 0.75;
+	bool local = measured.remote < 0.5;
+	bool alone = measured.sharers <= 1;
+	switch (X.kind) {
+	case +AccessKind::load:
+		if (reused && alone) {
+			return Req::O_data;
+		} else if (reused && local && X.bdf.get_core().target != hpvm::GPU_TARGET && !X.false_shared()) {
+			return Req::S;
+		} else if (!local) {
+			return Req::Vo;
+		} else {
+			return Req::V;
+		}
+	case +AccessKind::store:
+		if (local && (reused || alone)) {
+			return Req::O;
+		} else if (!local) {
+			return Req::WTo;
+		} else {
+			return Req::WTfwd;
+		}
+	case +AccessKind::rmw:
+	case +AccessKind::cas:
+		if (local && (reused || alone)) {
+			return Req::O_data;
+		} else if (!local) {
+			return Req::WTo_data;
+		} else {
+			return Req::WTfwd_data;
+		}
+	default:
+		errs() << "Unknown AccessKind " << X.kind._to_string() << "\n";
+		abort();
+	}
+}
+
+static Req assign_request_type(const Profile& profile, TraceMemo& traces, TraceMemo& reverse_traces, const MemoryAccess& X) {
+	if (const AccessProfile* measured = profile.find(X.bdf.get_function().getName(), X.order)) {
+		return measured_request_type(*measured, X);
+	}
 	switch (X.kind) {
 	case +AccessKind::load: {
 		/*
 		  Algorithm 1: Select load request type.
 		*/
-		if (ownership_beneficial(dfg, X)) {
+		if (ownership_beneficial(traces, X)) {
 			return Req::O_data;
-		} else if (shared_state_beneficial(dfg, X)) {
+		} else if (shared_state_beneficial(traces, X)) {
 			return Req::S;
-		} else if (owner_pred_beneficial(dfg, reverse_dfg, X)) {
+		} else if (owner_pred_beneficial(traces, reverse_traces, X)) {
 			return Req::Vo;
 		} else {
 			return Req::V;
@@ -388,9 +1077,9 @@ static Req assign_request_type(const BdfDfg& dfg, const BdfDfg& reverse_dfg, con
 		/*
 		  Algorithm 2: Select store request type.
 		*/
-		if (ownership_beneficial(dfg, X)) {
+		if (ownership_beneficial(traces, X)) {
 			return Req::O;
-		} else if (owner_pred_beneficial(dfg, reverse_dfg, X)) {
+		} else if (owner_pred_beneficial(traces, reverse_traces, X)) {
 			return Req::WTo;
 		} else {
 			return Req::WTfwd;
@@ -401,9 +1090,9 @@ static Req assign_request_type(const BdfDfg& dfg, const BdfDfg& reverse_dfg, con
 		/*
 		  Algorithm 3: Select RMW request type
 		*/
-		if (ownership_beneficial(dfg, X)) {
+		if (ownership_beneficial(traces, X)) {
 			return Req::O_data;
-		} else if (owner_pred_beneficial(dfg, reverse_dfg, X)) {
+		} else if (owner_pred_beneficial(traces, reverse_traces, X)) {
 			return Req::WTo_data;
 		} else {
 			return Req::WTfwd_data;
@@ -415,56 +1104,69 @@ static Req assign_request_type(const BdfDfg& dfg, const BdfDfg& reverse_dfg, con
 	}
 }
 
-WordMask full_block_mask() {
+WordMask full_block_mask(const MemoryAccess& X) {
 	WordMask mask;
-	mask.set();
+	for (size_t word = 0; word < X.bdf.get_hw_params().words_per_block(); ++word) {
+		mask.set(word);
+	}
 	return mask;
 }
 
-WordMask inter_synch_load_reuse(const BdfDfg& dfg, const MemoryAccess& X) {
-	const llvm::Value& orig_base = X.address.block.segment.base;
+WordMask inter_synch_load_reuse(TraceMemo& traces, const MemoryAccess& X) {
+	return TraceMemo::per_block(traces.inter_synch_reuse, X, [&]() {
+		const llvm::Value& orig_base = X.address.block.segment.base;
 
-	std::unordered_set<Address> cache;
-	WordMask mask;
+		std::unordered_set<Address> cache;
+		WordMask mask;
 
-	for (auto [bdf, arg_no] : get_static_trace(dfg, X)) {
-		const auto& function = bdf.get().get_function();
-		assert(arg_no < function.arg_size());
-		const llvm::Argument& equiv_base = ptr2ref<llvm::Argument>(function.arg_begin() + arg_no);
-		const Address equiv_address = X.address.rebase(equiv_base);
-		for (const Ref<MemoryAccess>& access : bdf.get().all_block_conflicts(equiv_address.block)) {
-			const Address transposed_address =
-				(&access.get().address.block.segment.base == &equiv_base)
-				? access.get().address.rebase(orig_base)
-				: access.get().address
-				;
-
-			cache.insert(transposed_address);
-			assert(transposed_address.aligned(WORD_SIZE));
-			if (cache.size() > 0.75 * bdf.get().get_hw_params().cache_size) {
-				break;
-			}
-			if (access.get().kind == +AccessKind::load && transposed_address.block == X.address.block) {
-				mask.set(transposed_address.block_offset / WORD_SIZE);
+		for (const TraceMemo::Step& step : traces.walk(X)) {
+			const BoiledDownFunction& step_bdf = step.bdf.get();
+			const llvm::Value& equiv_base = step_bdf.canonical(step.address.block).segment.base;
+			for (const Ref<MemoryAccess>& access : step.block_conflicts) {
+				for (const Address& word : access.get().footprint) {
+					const Address canonical_word = step_bdf.canonical(word);
+					const Address transposed_address =
+						(&canonical_word.block.segment.base == &equiv_base)
+						? canonical_word.rebase(orig_base)
+						: canonical_word
+						;
+					assert(transposed_address.aligned(step.bdf.get().get_hw_params().word_size));
+					cache.insert(transposed_address);
+				}
+				if (cache.size() > 0.75 * step.bdf.get().get_hw_params().cache_size) {
+					break;
+				}
+				// Owned words also serve later atomics on the same core
+				if (is_read(access.get().kind)) {
+					mask |= access.get().words_in(step.address.block);
+				}
 			}
 		}
-	}
 
-	return mask;
+		return mask;
+	});
 }
 
 /*
 Algorithm 4: Request-granularity selection.
+
+When X is false-shared, the masks are limited to the words of its own
+instance, so that it does not take the words of instances on other cores, and
+it does not ask for the whole line in S.
 */
-static std::pair<WordMask, Req> select_granularity(const BdfDfg& dfg, const MemoryAccess& X) {
-	if (X.req_type == +Req::V) {
-		return std::pair<WordMask, Req>(X.bdf.intra_synch_load_reuse(X), X.req_type);
+static std::pair<WordMask, Req> select_granularity(TraceMemo& traces, const MemoryAccess& X) {
+	WordMask own_words = X.false_shared() ? X.bdf.instance_words(X.address.block) : full_block_mask(X);
+	if (X.req_type == +Req::V || (X.req_type == +Req::S && X.false_shared())) {
+		return std::pair<WordMask, Req>(X.bdf.intra_synch_load_reuse(X) & own_words, +Req::V);
+	} else if (X.req_type == +Req::Vo) {
+		// Like V, and the owner is predicted for the words it asks for
+		return std::pair<WordMask, Req>(X.bdf.intra_synch_load_reuse(X) & own_words, X.req_type);
 	} else if (X.req_type == +Req::S) {
-		return std::pair<WordMask, Req>(full_block_mask(), X.req_type);
+		return std::pair<WordMask, Req>(full_block_mask(X), X.req_type);
 	} else if (X.req_type == +Req::WTo || X.req_type == +Req::WTfwd || X.req_type == +Req::WTo_data || X.req_type == +Req::WTfwd_data) {
 		return std::pair<WordMask, Req>(requested_words_only(X), X.req_type);
 	} else if (X.req_type == +Req::O || X.req_type == +Req::O_data) {
-		WordMask word_mask = inter_synch_load_reuse(dfg, X);
+		WordMask word_mask = inter_synch_load_reuse(traces, X) & own_words;
 		if (word_mask != requested_words_only(X)) {
 			return std::pair<WordMask, Req>(word_mask, +Req::O_data);
 		} else {
@@ -476,36 +1178,412 @@ static std::pair<WordMask, Req> select_granularity(const BdfDfg& dfg, const Memo
 	}
 }
 
- static void spandex_annotate(const llvm::Module& module, const Digraph<Port>& mem_comm_dfg) {
-	std::list<BoiledDownFunction> bdfs;
-	llvm::DataLayout data_layout {&module};
-	HardwareParams hp {
-					   .producer = false,
-					   .owner_pred_available = false,
-					   .cache_size = 1024*1024 * BYTE_SIZE,
-					   .block_size = 64 * BYTE_SIZE,
-					   .core = {hpvm::CPU_TARGET, 0},
+/*
+Whether X was decided in the BDF of the port it accesses. Each BDF stands for
+one port of its node, and only the accesses through that port have a trace.
+*/
+static bool decided_for_port(const BdfCsr& dfg, const MemoryAccess& X) {
+	const auto* argument = llvm::dyn_cast<llvm::Argument>(&X.address.block.segment.base);
+	return argument && dfg.contains(BdfDfgNode{std::cref(X.bdf), argument->getArgNo()});
+}
+
+/*
+Coherence policy of a producer/consumer pair (see the report):
+- producer_owned: the producer owns the buffer, so its stores hit (O), and the
+  consumer loads from it with owner prediction (Vo). Best for sparse loads.
+- consumer_owned: the consumer owns the buffer, so its loads hit (O_data), and
+  the producer writes through to it with owner prediction (WTo). Best for
+  sparse stores.
+- spandex: no pair-wide policy; every access is decided on its own.
+*/
+BETTER_ENUM(PairPolicy, char, spandex, producer_owned, consumer_owned)
+
+/*
+Words of the buffer behind a port that the accesses of one kind touch over
+all their iterations, and the byte the buffer is known to extend to. Returns
+nothing if one of them has unknown strides or trip counts.
+*/
+static std::optional<std::pair<size_t, int64_t>>
+port_usage(const BdfDfgNode& port, bool (*of_kind)(AccessKind)) {
+	const BoiledDownFunction& bdf = port.first.get();
+	unsigned short word_size = bdf.get_hw_params().word_size;
+	std::unordered_set<Address> words;
+	// Words of the accesses too large to expand, as trip counts times the words
+	// of one access
+	size_t unexpanded_words = 0;
+	int64_t end = 0;
+	for (const MemoryAccess& access : bdf.get_all_accesses()) {
+		const auto* argument = llvm::dyn_cast<llvm::Argument>(&access.address.block.segment.base);
+		if (!argument || argument->getArgNo() != port.second) {
+			continue;
+		}
+		if (!access.range.bounded()) {
+			return std::nullopt;
+		}
+		end = std::max(end, access.range.end());
+		if (!of_kind(access.kind)) {
+			continue;
+		}
+		if (access.bounded_footprint) {
+			words.insert(access.footprint.cbegin(), access.footprint.cend());
+		} else {
+			unexpanded_words += access.range.count() * ((access.range.size * BYTE_SIZE + word_size - 1) / word_size);
+		}
+	}
+	return std::make_pair(words.size() + unexpanded_words, end);
+}
+
+/*
+Policy of the pair of the stores of producer and the loads of consumer, from
+their densities: the words each side touches over the words of the buffer.
+A side is sparse below sparse_density, and the sparser side gives up
+ownership, as long as the other side can predict it as the owner.
+*/
+static PairPolicy select_pair_policy(const BdfDfgNode& producer, const BdfDfgNode& consumer, float sparse_density) {
+	auto stores = port_usage(producer, is_write);
+	auto loads = port_usage(consumer, is_read);
+	if (!stores.has_value() || !loads.has_value() || stores->first == 0 || loads->first == 0) {
+		return PairPolicy::spandex;
+	}
+	unsigned short word_size = producer.first.get().get_hw_params().word_size;
+	int64_t buffer_end = std::max(stores->second, loads->second);
+	float buffer_words = float((buffer_end * BYTE_SIZE + word_size - 1) / word_size);
+	float store_density = std::min(1.0f, stores->first / buffer_words);
+	float load_density = std::min(1.0f, loads->first / buffer_words);
+
+	bool producer_predicts = producer.first.get().get_hw_params().owner_pred_available;
+	bool consumer_predicts = consumer.first.get().get_hw_params().owner_pred_available;
+	bool stores_sparse = store_density < sparse_density && producer_predicts;
+	bool loads_sparse = load_density < sparse_density && consumer_predicts;
+	if (stores_sparse && !(loads_sparse && load_density < store_density)) {
+		return PairPolicy::consumer_owned;
+	} else if (loads_sparse) {
+		return PairPolicy::producer_owned;
+	} else {
+		return PairPolicy::spandex;
+	}
+}
+
+// Policies of the pairs a port is in, as the producer and as the consumer.
+// A port in pairs with different policies falls back to spandex for that role.
+struct PortPolicy {
+	std::optional<PairPolicy> as_producer;
+	std::optional<PairPolicy> as_consumer;
+};
+typedef std::unordered_map<BdfDfgNode, PortPolicy, BdfDfgHasher, BdfDfgEquality> PortPolicies;
+
+static void merge_policy(std::optional<PairPolicy>& into, PairPolicy policy) {
+	into = (!into.has_value() || *into == policy) ? policy : +PairPolicy::spandex;
+}
+
+static PortPolicies select_port_policies(const BdfCsr& dfg, float sparse_density) {
+	PortPolicies policies;
+	for (BdfCsr::NodeId src = 0; src < dfg.size(); ++src) {
+		for (BdfCsr::NodeId dst : dfg.successors(src)) {
+			PairPolicy policy = select_pair_policy(dfg.node(src), dfg.node(dst), sparse_density);
+			merge_policy(policies[dfg.node(src)].as_producer, policy);
+			merge_policy(policies[dfg.node(dst)].as_consumer, policy);
+		}
+	}
+	return policies;
+}
+
+/*
+Request type the policies of its port impose on X, if any: stores follow the
+pairs the port produces for, and loads the pairs it consumes from.
+*/
+static std::optional<Req> pair_request_type(const PortPolicies& policies, const MemoryAccess& X) {
+	const auto* argument = llvm::dyn_cast<llvm::Argument>(&X.address.block.segment.base);
+	if (!argument) {
+		return std::nullopt;
+	}
+	auto it = policies.find(BdfDfgNode{std::cref(X.bdf), argument->getArgNo()});
+	if (it == policies.end()) {
+		return std::nullopt;
+	}
+	const PortPolicy& policy = it->second;
+	if (X.kind == +AccessKind::store && policy.as_producer.has_value()) {
+		switch (*policy.as_producer) {
+		case +PairPolicy::producer_owned: return Req::O;
+		case +PairPolicy::consumer_owned: return Req::WTo;
+		default: break;
+		}
+	} else if (X.kind == +AccessKind::load && policy.as_consumer.has_value()) {
+		switch (*policy.as_consumer) {
+		case +PairPolicy::producer_owned: return Req::Vo;
+		case +PairPolicy::consumer_owned: return Req::O_data;
+		default: break;
+		}
+	}
+	return std::nullopt;
+}
+
+/*
+Attaches the decisions for X to its instruction, as the request type
+!spandex.req !{!"O_data"}, the word mask !spandex.mask !{i64 0b11} (bit i for
+word i of the block) and the ID of its hint in the table !spandex.id !{i64 id}.
+Instruction metadata is copied along when the backends clone functions and
+modules.
+*/
+static void attach_hint(const llvm::Instruction& _instruction, llvm::StringRef req_type, uint64_t word_mask, uint64_t id) {
+	// The analysis only reads the IR; this is the one place that writes it
+	auto& instruction = const_cast<llvm::Instruction&>(_instruction);
+	llvm::LLVMContext& context = instruction.getContext();
+	llvm::Type* i64 = llvm::Type::getInt64Ty(context);
+	instruction.setMetadata("spandex.req", llvm::MDNode::get(context,
+		llvm::MDString::get(context, req_type)));
+	instruction.setMetadata("spandex.mask", llvm::MDNode::get(context,
+		llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(i64, word_mask))));
+	instruction.setMetadata("spandex.id", llvm::MDNode::get(context,
+		llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(i64, id))));
+}
+
+static void attach_hint(const MemoryAccess& X, uint64_t id) {
+	attach_hint(X.instruction, X.req_type._to_string(), X.word_mask.to_ullong(), id);
+}
+
+/*
+Entry of the hint table for X, which lets consumers act on the decisions
+without re-running the analysis or parsing the IR.
+*/
+static llvm::json::Object hint_to_json(const MemoryAccess& X, uint64_t id) {
+	const auto& argument = llvm::cast<llvm::Argument>(X.address.block.segment.base);
+	return llvm::json::Object{
+		{"id", int64_t(id)},
+		{"function", X.bdf.get_function().getName()},
+		{"instruction", llvm_to_str(X.instruction)},
+		// Key of the access in profiles
+		{"index", int64_t(X.order)},
+		{"kind", X.kind._to_string()},
+		{"argument", int64_t(argument.getArgNo())},
+		// In bits from the start of the argument, like the masks
+		{"offset", int64_t(X.address.offset())},
+		{"req", X.req_type._to_string()},
+		{"mask", int64_t(X.word_mask.to_ullong())},
 	};
-	BdfDfg bdf_mem_comm_dfg = map_graph<Port, BdfDfgNode, Digraph<Port>, BdfDfg>(mem_comm_dfg, [&](const Port& port) {
-		const auto& function = ptr2ref<llvm::Function>(port.N.getFuncPointer());
-		bdfs.emplace_back(function, data_layout, hp);
-		unsigned int pos = port.pos;
-		return BdfDfgNode{bdfs.back(), std::move(pos)};
-	});
-	BdfDfg reverse_dfg = reverse<BdfDfgNode, BdfDfg>(bdf_mem_comm_dfg);
-	for (auto& bdf : bdfs) {
-		for (auto& ma : bdf.get_all_accesses()) {
-			if (llvm::isa<llvm::Argument>(ma.address.block.segment.base)) {
-				ma.req_type = assign_request_type(bdf_mem_comm_dfg, reverse_dfg, ma);
-				auto word_mask_x_req_type = select_granularity(bdf_mem_comm_dfg, ma);
-				ma.word_mask = word_mask_x_req_type.first;
-				ma.req_type = word_mask_x_req_type.second;
-				std::cout
-					<< std::setw(60) << std::left << llvm_to_str(ma.instruction)
-					<< std::setw(5) << std::left << ma.req_type._to_string()
-					<< "[" << ma.word_mask.to_string() << "] "
-					<< "for "<< ma.address << " "
-					<< std::endl;
+}
+
+/*
+Key of the decisions for the BDF of port: what they are computed from. That is
+the IR of the functions of the ports the traces of port reach in either
+direction (see module_independent_ir, so that editing other functions does not
+change it), with their ports, targets, instance counts and aliased arguments,
+as well as the hardware model, the profile and the options. Decisions only
+depend on these, so they can be reused while the key stays the same.
+*/
+static str decision_cache_key(
+	const CsrGraph<Port>& ports,
+	const CsrGraph<Port>& reverse_ports,
+	const Port& port,
+	const BoundArgs& bound_args,
+	const HardwareModel& hardware,
+	const Profile& profile,
+	float sparse_density,
+	std::unordered_map<const llvm::Function*, str>& function_digests
+) {
+	Digest digest;
+	digest.add("spandex-decisions-1");
+	for (const HardwareParams* params : {&hardware.cpu, &hardware.gpu}) {
+		digest
+			.add(params->producer)
+			.add(params->owner_pred_available)
+			.add(params->cache_size)
+			.add(params->block_size)
+			.add(params->word_size)
+			.add(params->cores)
+			.add(params->distribution._to_string());
+	}
+	digest.add(profile.digest()).add(llvm::StringRef(std::to_string(sparse_density)));
+
+	auto add_port = [&](const Port& neighbour) {
+		const llvm::Function& function = ptr2ref<llvm::Function>(neighbour.N.getFuncPointer());
+		auto it = function_digests.find(&function);
+		if (it == function_digests.end()) {
+			it = function_digests.emplace(&function, Digest{}.add(module_independent_ir(function)).finish()).first;
+		}
+		std::optional<uint64_t> instances = count_instances(neighbour.N);
+		digest
+			.add(it->second)
+			.add(neighbour.pos)
+			.add(neighbour.N.getTargetHint())
+			.add(instances.has_value() ? int64_t(*instances) : int64_t{-1});
+		auto bound = bound_args.find(&function);
+		if (bound != bound_args.end()) {
+			for (auto [a, b] : bound->second) {
+				digest.add(a).add(b);
+			}
+		}
+		digest.add("|");
+	};
+	for (const Port& descendant : topological_descendants<Port, CsrGraph<Port>>(ports, port)) {
+		add_port(descendant);
+	}
+	digest.add("reverse");
+	for (const Port& ancestor : topological_descendants<Port, CsrGraph<Port>>(reverse_ports, port)) {
+		add_port(ancestor);
+	}
+	return digest.finish();
+}
+
+// Decision for ma as printed after its instruction in the output of the pass.
+// The instruction is printed from the module, as its text has slot numbers.
+static str decision_text(const MemoryAccess& ma, const HardwareModel& hardware) {
+	std::ostringstream text;
+	text
+		<< std::setw(5) << std::left << ma.req_type._to_string()
+		<< "[" << mask_to_string(ma.word_mask, hardware.cpu.words_per_block()) << "] "
+		<< "for "<< ma.address << " ";
+	return text.str();
+}
+
+ /*
+Builds a BDF for each port of the memory communication DFG, then selects the
+request type and granularity of every access. BDFs are built on this thread,
+since that queries ScalarEvolution; indexing them and the per-access decisions
+only read the shared graphs and run on a pool of threads (0 for one per core).
+Each task covers the accesses of one BDF and owns its memo tables, whose keys
+are all per BDF. Decisions are printed and attached afterwards in port order,
+so the output does not depend on scheduling.
+
+With a cache, the decisions for a port are reused as long as its key (see
+decision_cache_key) is the same, and only ports without cached decisions are
+decided. BDFs are only built if one of them is not cached.
+
+Before that, every producer/consumer edge gets a pair policy from the densities
+of its stores and loads (see select_pair_policy), and the stores and loads of
+ports with a policy other than spandex take their request type from it. The
+other accesses found in profile are decided from their measurements, and the
+rest statically.
+
+The decisions for the accesses through the port of their BDF are attached to
+their instructions and appended to hints, numbered from its size.
+*/
+static void spandex_annotate(const llvm::Module& module, const Digraph<Port>& mem_comm_dfg, const BoundArgs& bound_args, llvm::Pass& pass, const HardwareModel& hardware, const Profile& profile, float sparse_density, unsigned threads, const DecisionCache* cache, llvm::json::Array& hints) {
+	const CsrGraph<Port> ports{mem_comm_dfg};
+	const CsrGraph<Port> reverse_ports = ports.reverse();
+
+	// Decisions of earlier runs for each port, as {"accesses": [{"index",
+	// "decision", "hint"}]} with the hints numbered from 0
+	std::vector<str> keys(ports.size());
+	std::vector<std::optional<llvm::json::Value>> cached(ports.size());
+	if (cache) {
+		std::unordered_map<const llvm::Function*, str> function_digests;
+		for (CsrGraph<Port>::NodeId id = 0; id < ports.size(); ++id) {
+			keys[id] = decision_cache_key(ports, reverse_ports, ports.node(id), bound_args, hardware, profile, sparse_density, function_digests);
+			cached[id] = cache->load(keys[id]);
+		}
+	}
+
+	// The BDFs of cached ports are still needed for the traces of the others
+	std::list<BoiledDownFunction> bdfs;
+	std::vector<BoiledDownFunction*> bdf_of_port(ports.size(), nullptr);
+	if (std::any_of(cached.cbegin(), cached.cend(), [](const auto& entry) { return !entry.has_value(); })) {
+		llvm::DataLayout data_layout {&module};
+		BdfDfg bdf_mem_comm_dfg = map_graph<Port, BdfDfgNode, Digraph<Port>, BdfDfg>(mem_comm_dfg, [&](const Port& port) {
+			auto& function = ptr2ref<llvm::Function>(port.N.getFuncPointer());
+			// Each getAnalysis on function recomputes the analyses of the other
+			// ones, so AA is done with before SE is taken
+			auto bound = bound_args.find(&function);
+			std::vector<unsigned> classes = alias_classes(
+				function,
+				pass.getAnalysis<llvm::AAResultsWrapperPass>(function).getAAResults(),
+				bound == bound_args.end() ? std::vector<std::pair<unsigned, unsigned>>{} : bound->second
+			);
+			llvm::ScalarEvolution& SE = pass.getAnalysis<llvm::ScalarEvolutionWrapperPass>(function).getSE();
+			bdfs.emplace_back(function, data_layout, hardware.of(port.N.getTargetHint()), SE, std::move(classes), count_instances(port.N));
+			bdf_of_port[ports.id(port)] = &bdfs.back();
+			unsigned int pos = port.pos;
+			return BdfDfgNode{bdfs.back(), std::move(pos)};
+		});
+
+		llvm::ThreadPool pool{threads == 0 ? llvm::hardware_concurrency() : threads};
+		for (auto& bdf : bdfs) {
+			pool.async([&bdf]() { bdf.index(); });
+		}
+		pool.wait();
+
+		const BdfCsr dfg{bdf_mem_comm_dfg};
+		const BdfCsr reverse_dfg = dfg.reverse();
+		LLVM_DEBUG(dump_static_traces(dbgs(), dfg));
+		const PortPolicies policies = select_port_policies(dfg, sparse_density);
+		for (CsrGraph<Port>::NodeId id = 0; id < ports.size(); ++id) {
+			if (cached[id].has_value()) {
+				continue;
+			}
+			BoiledDownFunction& bdf = *bdf_of_port[id];
+			pool.async([&bdf, &dfg, &reverse_dfg, &policies, &profile]() {
+				TraceMemo traces{dfg};
+				TraceMemo reverse_traces{reverse_dfg};
+				for (auto& ma : bdf.get_all_accesses()) {
+					if (llvm::isa<llvm::Argument>(ma.address.block.segment.base)) {
+						std::optional<Req> pair_req_type = pair_request_type(policies, ma);
+						ma.req_type = pair_req_type.has_value()
+							? *pair_req_type
+							: assign_request_type(profile, traces, reverse_traces, ma);
+						auto word_mask_x_req_type = select_granularity(traces, ma);
+						ma.word_mask = word_mask_x_req_type.first;
+						ma.req_type = word_mask_x_req_type.second;
+					}
+				}
+			});
+		}
+		pool.wait();
+
+		for (CsrGraph<Port>::NodeId id = 0; id < ports.size(); ++id) {
+			if (cached[id].has_value()) {
+				continue;
+			}
+			llvm::json::Array accesses;
+			for (const auto& ma : bdf_of_port[id]->get_all_accesses()) {
+				if (llvm::isa<llvm::Argument>(ma.address.block.segment.base)) {
+					accesses.push_back(llvm::json::Object{
+						{"index", int64_t(ma.order)},
+						{"decision", decision_text(ma, hardware)},
+						{"hint", decided_for_port(dfg, ma) ? llvm::json::Value{hint_to_json(ma, 0)} : llvm::json::Value{nullptr}},
+					});
+				}
+			}
+			cached[id] = llvm::json::Object{{"accesses", std::move(accesses)}};
+			if (cache) {
+				cache->store(keys[id], *cached[id]);
+			}
+		}
+	}
+
+	// Decisions are printed and attached in port order, whether they were
+	// cached or not
+	for (CsrGraph<Port>::NodeId id = 0; id < ports.size(); ++id) {
+		const llvm::Function& function = ptr2ref<llvm::Function>(ports.node(id).N.getFuncPointer());
+		const std::vector<Ref<llvm::Instruction>> instructions = memory_accesses(function);
+		const llvm::json::Object* entry = cached[id]->getAsObject();
+		const llvm::json::Array* accesses = entry ? entry->getArray("accesses") : nullptr;
+		if (!accesses) {
+			std::cerr << "Malformed Spandex decisions for " << function.getName().str() << std::endl;
+			abort();
+		}
+		for (const llvm::json::Value& access_value : *accesses) {
+			const llvm::json::Object& access = ptr2ref<llvm::json::Object>(access_value.getAsObject());
+			auto index = access.getInteger("index");
+			if (!index || *index < 0 || size_t(*index) >= instructions.size()) {
+				continue;
+			}
+			const llvm::Instruction& instruction = instructions[*index];
+			if (auto decision = access.getString("decision")) {
+				std::cout << std::setw(60) << std::left << llvm_to_str(instruction) << decision->str() << std::endl;
+			}
+			const llvm::json::Object* hint = access.getObject("hint");
+			if (!hint) {
+				continue;
+			}
+			auto req_type = hint->getString("req");
+			auto word_mask = hint->getInteger("mask");
+			if (req_type && word_mask) {
+				uint64_t id = hints.size();
+				attach_hint(instruction, *req_type, uint64_t(*word_mask), id);
+				llvm::json::Object numbered = *hint;
+				numbered["id"] = int64_t(id);
+				numbered["instruction"] = llvm_to_str(instruction);
+				hints.push_back(std::move(numbered));
 			}
 		}
 	}
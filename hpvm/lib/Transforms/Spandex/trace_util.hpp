@@ -0,0 +1,139 @@
+#pragma once
+#include <unordered_set>
+#include <vector>
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "SupportHPVM/DFGraph.h"
+#include "llvm_util.hpp"
+// The dominator tree headers of BasicBlockUtils.h undefine it
+#undef DEBUG_TYPE
+#define DEBUG_TYPE "Spandex"
+
+class get_leaves_helper : public llvm::DFNodeVisitor {
+public:
+	std::vector<Ref<llvm::DFNode>> leaves;
+
+	virtual void visit(llvm::DFInternalNode *N) {
+		for (llvm::DFNode *child : ptr2ref<llvm::DFGraph>(N->getChildGraph())) {
+			ptr2ref<llvm::DFNode>(child).applyDFNodeVisitor(*this);
+		}
+	}
+	virtual void visit(llvm::DFLeafNode *N) {
+		if (!N->isDummyNode()) {
+			leaves.push_back(ptr2ref<llvm::DFNode>(N));
+		}
+	}
+};
+
+/*
+Leaf nodes under root, without entry and exit nodes, in depth-first order.
+Numbered across the roots of a module, they are the node IDs of traces.
+*/
+static std::vector<Ref<llvm::DFNode>> get_leaves(const llvm::DFInternalNode& root) {
+	get_leaves_helper glh;
+	// The visitor API is not const, although this visitor does not modify the graph
+	const_cast<llvm::DFInternalNode&>(root).applyDFNodeVisitor(glh);
+	return glh.leaves;
+}
+
+/*
+Functions of hpvm-rt called by instrumented leaves:
+int llvm_hpvm_trace_begin(unsigned node, uint64_t instance) and
+void llvm_hpvm_trace_record(unsigned node, uint64_t instance, unsigned instruction, unsigned kind, void* addr)
+*/
+struct TraceRuntime {
+	llvm::FunctionCallee begin;
+	llvm::FunctionCallee record;
+
+	explicit TraceRuntime(llvm::Module& module) {
+		llvm::LLVMContext& context = module.getContext();
+		llvm::Type* i32 = llvm::Type::getInt32Ty(context);
+		llvm::Type* i64 = llvm::Type::getInt64Ty(context);
+		llvm::Type* i8_ptr = llvm::Type::getInt8PtrTy(context);
+		begin = module.getOrInsertFunction("llvm_hpvm_trace_begin", i32, i32, i64);
+		record = module.getOrInsertFunction("llvm_hpvm_trace_record", llvm::Type::getVoidTy(context), i32, i64, i32, i32, i8_ptr);
+	}
+};
+
+/*
+Makes the function of a leaf node record its memory accesses. Its entry
+computes the linear instance ID x + X * (y + Y * z) from the HPVM query
+intrinsics, which DFG2LLVM_CPU lowers later, and asks the runtime whether the
+instance is sampled. Each access is then preceded by a call recording it when
+it is. Accesses are numbered as in memory_accesses, like the index of hints
+and profiles; atomics are recorded as stores. Returns the number of
+instrumented accesses.
+*/
+static size_t instrument_leaf(const llvm::DFNode& node, unsigned node_id, const TraceRuntime& runtime) {
+	llvm::Function& function = ptr2ref<llvm::Function>(node.getFuncPointer());
+	llvm::Module& module = ptr2ref<llvm::Module>(function.getParent());
+	// Found before any block is split, so that the indices match the analysis
+	const std::vector<Ref<llvm::Instruction>> accesses = memory_accesses(function);
+	if (accesses.empty()) {
+		return 0;
+	}
+
+	llvm::IRBuilder<> builder{&*function.getEntryBlock().getFirstInsertionPt()};
+	llvm::Value* handle = builder.CreateCall(llvm::Intrinsic::getDeclaration(&module, llvm::Intrinsic::hpvm_getNode));
+	static const llvm::Intrinsic::ID instance_ids[] = {
+		llvm::Intrinsic::hpvm_getNodeInstanceID_x,
+		llvm::Intrinsic::hpvm_getNodeInstanceID_y,
+		llvm::Intrinsic::hpvm_getNodeInstanceID_z,
+	};
+	static const llvm::Intrinsic::ID instance_counts[] = {
+		llvm::Intrinsic::hpvm_getNumNodeInstances_x,
+		llvm::Intrinsic::hpvm_getNumNodeInstances_y,
+		llvm::Intrinsic::hpvm_getNumNodeInstances_z,
+	};
+	llvm::Value* instance = builder.getInt64(0);
+	for (unsigned dim = node.getNumOfDim(); dim-- > 0;) {
+		llvm::Value* id = builder.CreateCall(llvm::Intrinsic::getDeclaration(&module, instance_ids[dim]), {handle});
+		llvm::Value* count = builder.CreateCall(llvm::Intrinsic::getDeclaration(&module, instance_counts[dim]), {handle});
+		instance = builder.CreateAdd(builder.CreateMul(instance, count), id);
+	}
+	llvm::Value* node_value = builder.getInt32(node_id);
+	llvm::Value* sampled = builder.CreateICmpNE(builder.CreateCall(runtime.begin, {node_value, instance}), builder.getInt32(0));
+
+	for (size_t index = 0; index < accesses.size(); ++index) {
+		auto& instruction = const_cast<llvm::Instruction&>(accesses[index].get());
+		auto target = get_pointer_target(instruction).unwrap();
+		auto& pointer = const_cast<llvm::Value&>(target.first.get());
+		llvm::Instruction* then = llvm::SplitBlockAndInsertIfThen(sampled, &instruction, /* Unreachable */ false);
+		llvm::IRBuilder<> record_builder{then};
+		record_builder.CreateCall(runtime.record, {
+			node_value,
+			instance,
+			record_builder.getInt32(index),
+			record_builder.getInt32(is_write(target.second) ? 1 : 0),
+			record_builder.CreatePointerBitCastOrAddrSpaceCast(&pointer, record_builder.getInt8PtrTy()),
+		});
+	}
+	return accesses.size();
+}
+
+/*
+Instruments the CPU leaves of the DFGs of a module (see instrument_leaf) and
+returns the function of each node ID. Leaves for other targets are numbered
+but not instrumented, since their code does not run on the host. A function
+shared by several nodes is instrumented for the first one.
+*/
+static std::vector<str> instrument_leaves(llvm::Module& module, const std::vector<llvm::DFInternalNode*>& roots) {
+	const TraceRuntime runtime{module};
+	std::vector<str> functions;
+	std::unordered_set<const llvm::Function*> instrumented;
+	for (const llvm::DFInternalNode* root : roots) {
+		for (const llvm::DFNode& node : get_leaves(ptr2ref<llvm::DFInternalNode>(root))) {
+			const llvm::Function& function = ptr2ref<llvm::Function>(node.getFuncPointer());
+			unsigned node_id = functions.size();
+			functions.push_back(function.getName().str());
+			if (node.getTargetHint() != hpvm::CPU_TARGET || !instrumented.insert(&function).second) {
+				continue;
+			}
+			size_t count = instrument_leaf(node, node_id, runtime);
+			LLVM_DEBUG(llvm::dbgs() << "Traced " << count << " accesses of node " << node_id << " " << node << "\n");
+		}
+	}
+	return functions;
+}
@@ -1,6 +1,9 @@
 #pragma once
 #include <string>
 #include <regex>
+#include <cassert>
+#include <unordered_map>
+#include <vector>
 #include <cxxabi.h>
 #include "enum.h"
 #pragma GCC diagnostic ignored "-Wpedantic"
@@ -190,3 +193,107 @@ struct curried_address_equality {
 private:
 	const T& a;
 };
+
+/*
+Number of distinct elements in any range of a fixed sequence, in O(log n) per
+query.
+
+Position p counts in [from, to) iff no earlier position in the range holds the
+same element, i.e. iff prev[p] < from, where prev[p] is the previous position
+of seq[p] (or -1). The counts are kept in a persistent segment tree over
+positions, whose version v holds the positions with prev[p] < v, so a query
+sums [from, to) in version from. Versions share their nodes, so memory is
+O(n log n).
+*/
+template <typename T, typename Hash = std::hash<T>>
+class DistinctInRange {
+public:
+	DistinctInRange() : roots(1, 0), nodes(1, Node{0, 0, 0}) { }
+
+	explicit DistinctInRange(const std::vector<T>& seq)
+		: length{seq.size()}
+		, nodes(1, Node{0, 0, 0})
+	{
+		// Positions sorted by prev[p] + 1, in [0, length)
+		std::unordered_map<T, size_t, Hash> last;
+		std::vector<size_t> key(length);
+		for (size_t p = 0; p < length; ++p) {
+			auto it = last.find(seq[p]);
+			key[p] = it == last.end() ? 0 : it->second + 1;
+			last[seq[p]] = p;
+		}
+		std::vector<size_t> key_begin(length + 1, 0);
+		for (size_t p = 0; p < length; ++p) {
+			key_begin[key[p] + 1]++;
+		}
+		for (size_t k = 0; k < length; ++k) {
+			key_begin[k + 1] += key_begin[k];
+		}
+		std::vector<size_t> by_key(length);
+		std::vector<size_t> next(key_begin.begin(), key_begin.end() - 1);
+		for (size_t p = 0; p < length; ++p) {
+			by_key[next[key[p]]++] = p;
+		}
+
+		roots.reserve(length + 1);
+		unsigned root = 0;
+		for (size_t v = 0; v <= length; ++v) {
+			if (v < length) {
+				for (size_t i = key_begin[v]; i < key_begin[v + 1]; ++i) {
+					root = insert(root, 0, length, by_key[i]);
+				}
+			}
+			roots.push_back(root);
+		}
+	}
+
+	size_t size() const { return length; }
+
+	// Distinct elements in seq[from, to)
+	size_t count(size_t from, size_t to) const {
+		assert(from <= to && to <= length);
+		if (from == to) {
+			return 0;
+		}
+		return query(roots[from], 0, length, from, to);
+	}
+
+private:
+	struct Node {
+		unsigned left;
+		unsigned right;
+		unsigned count;
+	};
+
+	// Copy of the subtree at node covering [lo, hi), with pos inserted.
+	// Node 0 is the shared empty subtree.
+	unsigned insert(unsigned node, size_t lo, size_t hi, size_t pos) {
+		Node copy = nodes[node];
+		copy.count++;
+		if (hi - lo > 1) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (pos < mid) {
+				copy.left = insert(copy.left, lo, mid, pos);
+			} else {
+				copy.right = insert(copy.right, mid, hi, pos);
+			}
+		}
+		nodes.push_back(copy);
+		return nodes.size() - 1;
+	}
+
+	size_t query(unsigned node, size_t lo, size_t hi, size_t from, size_t to) const {
+		if (node == 0 || to <= lo || hi <= from) {
+			return 0;
+		}
+		if (from <= lo && hi <= to) {
+			return nodes[node].count;
+		}
+		size_t mid = lo + (hi - lo) / 2;
+		return query(nodes[node].left, lo, mid, from, to) + query(nodes[node].right, mid, hi, from, to);
+	}
+
+	size_t length = 0;
+	std::vector<unsigned> roots;
+	std::vector<Node> nodes;
+};
@@ -0,0 +1,230 @@
+//===--------------------------- hpvm-rt-jit.cpp --------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Leaf node JIT of the HPVM runtime. The CPU backend embeds the bitcode of
+// each replicated leaf node in the program, and the runtime passes it here
+// along with the values of the scalar arguments and dimension limits the leaf
+// is about to be called with. The leaf is specialized for these values,
+// optimized for the host, and compiled once per distinct set of values.
+//
+// Unlike hpvm-rt.cpp this library is native code. It is loaded by the runtime
+// with dlopen when HPVM_JIT is set.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::orc;
+
+namespace {
+
+typedef std::pair<std::string, std::vector<uint64_t>> SpecializationKey;
+
+// State of the JIT, created on the first specialization request
+struct LeafJIT {
+  std::unique_ptr<LLJIT> J;
+  std::unique_ptr<TargetMachine> TM;
+  // Specialized versions, NULL for the ones that failed to compile so that
+  // they are not attempted again
+  std::map<SpecializationKey, void *> Versions;
+  unsigned NumVersions = 0;
+};
+
+std::mutex JITMutex;
+LeafJIT *TheJIT = nullptr;
+bool JITFailed = false;
+
+// Same rule as the CPU backend uses to pick the arguments to pass.
+bool isSpecializedArgTy(Type *Ty) {
+  if (Ty->isIntegerTy())
+    return Ty->getIntegerBitWidth() <= 64;
+  return Ty->isHalfTy() || Ty->isFloatTy() || Ty->isDoubleTy();
+}
+
+Constant *getSpecializedValue(Type *Ty, uint64_t V) {
+  if (Ty->isIntegerTy())
+    return ConstantInt::get(Ty, V);
+  unsigned Bits = Ty->getPrimitiveSizeInBits();
+  return ConstantFP::get(Ty->getContext(),
+                         APFloat(Ty->getFltSemantics(), APInt(Bits, V)));
+}
+
+LeafJIT *createJIT() {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  // Target the host CPU so that the vectorizer uses its full vector width
+  auto JTMB = JITTargetMachineBuilder::detectHost();
+  if (!JTMB) {
+    logAllUnhandledErrors(JTMB.takeError(), errs(), "HPVM JIT: ");
+    return nullptr;
+  }
+  JTMB->setCPU(sys::getHostCPUName());
+  JTMB->setCodeGenOptLevel(CodeGenOpt::Aggressive);
+
+  auto TM = JTMB->createTargetMachine();
+  if (!TM) {
+    logAllUnhandledErrors(TM.takeError(), errs(), "HPVM JIT: ");
+    return nullptr;
+  }
+  auto J = LLJITBuilder().setJITTargetMachineBuilder(std::move(*JTMB)).create();
+  if (!J) {
+    logAllUnhandledErrors(J.takeError(), errs(), "HPVM JIT: ");
+    return nullptr;
+  }
+
+  // Leaves may call functions of the program, including the runtime
+  auto Generator = DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*J)->getDataLayout().getGlobalPrefix());
+  if (!Generator) {
+    logAllUnhandledErrors(Generator.takeError(), errs(), "HPVM JIT: ");
+    return nullptr;
+  }
+  (*J)->getMainJITDylib().setGenerator(std::move(*Generator));
+
+  LeafJIT *JIT = new LeafJIT();
+  JIT->J = std::move(*J);
+  JIT->TM = std::move(*TM);
+  return JIT;
+}
+
+// Replace the scalar arguments and dimension limits of leaf function F by the
+// given values. Returns false if the values do not match the signature of F.
+bool specialize(Function *F, const uint64_t *Values, unsigned N) {
+  // The last 6 arguments are the instance ids and the dimension limits
+  if (F->arg_size() < 6)
+    return false;
+  unsigned NumInputs = F->arg_size() - 6;
+  unsigned k = 0;
+  for (unsigned i = 0; i < NumInputs; i++) {
+    Argument *A = F->arg_begin() + i;
+    if (!isSpecializedArgTy(A->getType()))
+      continue;
+    if (k == N)
+      return false;
+    A->replaceAllUsesWith(getSpecializedValue(A->getType(), Values[k++]));
+  }
+  if (k + 3 != N)
+    return false;
+  for (unsigned j = 0; j < 3; j++) {
+    Argument *A = F->arg_begin() + NumInputs + 3 + j;
+    A->replaceAllUsesWith(getSpecializedValue(A->getType(), Values[k++]));
+  }
+  return true;
+}
+
+void optimize(Module &M, TargetMachine *TM) {
+  PipelineTuningOptions PTO;
+  PTO.LoopUnrolling = true;
+  PTO.LoopVectorization = true;
+  PTO.SLPVectorization = true;
+  PassBuilder PB(TM, PTO);
+
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(PassBuilder::O3);
+  MPM.run(M, MAM);
+}
+
+// Compile the version of leaf Name in Bitcode specialized for Values. Returns
+// NULL on failure.
+void *compile(LeafJIT *JIT, const char *Name, const char *Bitcode,
+              uint64_t Size, const uint64_t *Values, unsigned N) {
+  auto Ctx = llvm::make_unique<LLVMContext>();
+  MemoryBufferRef Buffer(StringRef(Bitcode, Size), Name);
+  auto M = parseBitcodeFile(Buffer, *Ctx);
+  if (!M) {
+    logAllUnhandledErrors(M.takeError(), errs(), "HPVM JIT: ");
+    return nullptr;
+  }
+  Function *F = (*M)->getFunction(Name);
+  if (!F || F->isDeclaration() || !specialize(F, Values, N)) {
+    errs() << "HPVM JIT: cannot specialize " << Name << "\n";
+    return nullptr;
+  }
+
+  // Every version lives in the same JITDylib: only the specialized function
+  // is exported, under a name of its own
+  std::string VersionName =
+      (Twine(Name) + ".jit." + Twine(JIT->NumVersions++)).str();
+  F->setName(VersionName);
+  for (GlobalValue &GV : (*M)->global_values())
+    if (!GV.isDeclaration())
+      GV.setLinkage(&GV == F ? GlobalValue::ExternalLinkage
+                             : GlobalValue::InternalLinkage);
+
+  (*M)->setDataLayout(JIT->TM->createDataLayout());
+  (*M)->setTargetTriple(JIT->TM->getTargetTriple().str());
+  optimize(**M, JIT->TM.get());
+
+  ThreadSafeModule TSM(std::move(*M), std::move(Ctx));
+  if (Error Err = JIT->J->addIRModule(std::move(TSM))) {
+    logAllUnhandledErrors(std::move(Err), errs(), "HPVM JIT: ");
+    return nullptr;
+  }
+  auto Sym = JIT->J->lookup(VersionName);
+  if (!Sym) {
+    logAllUnhandledErrors(Sym.takeError(), errs(), "HPVM JIT: ");
+    return nullptr;
+  }
+  return (void *)Sym->getAddress();
+}
+
+} // namespace
+
+// Returns the version of leaf function Name specialized for the N values,
+// compiling it from Bitcode on the first request. Returns NULL when the leaf
+// cannot be specialized, in which case the generic version should run.
+extern "C" void *hpvm_jit_specialize(const char *Name, const char *Bitcode,
+                                     uint64_t Size, const uint64_t *Values,
+                                     unsigned N) {
+  std::lock_guard<std::mutex> Lock(JITMutex);
+  if (!TheJIT && !JITFailed) {
+    TheJIT = createJIT();
+    JITFailed = !TheJIT;
+  }
+  if (!TheJIT)
+    return nullptr;
+
+  SpecializationKey Key(Name, std::vector<uint64_t>(Values, Values + N));
+  auto It = TheJIT->Versions.find(Key);
+  if (It != TheJIT->Versions.end())
+    return It->second;
+  void *Version = compile(TheJIT, Name, Bitcode, Size, Values, N);
+  TheJIT->Versions[Key] = Version;
+  return Version;
+}
@@ -4,6 +4,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <dlfcn.h>
 #include <iostream>
 #include <map>
 #include <pthread.h>
@@ -14,7 +15,9 @@
 #if _POSIX_VERSION >= 200112L
 #include <sys/time.h>
 #endif
+#include "../../include/SupportHPVM/HPVMTrace.h"
 #include "hpvm-rt.h"
+#include "policy.h"
 
 //#define DEBUG_BUILD
 #ifndef DEBUG_BUILD
@@ -51,14 +54,110 @@ cl_context globalOCLContext;
 cl_device_id *clDevices;
 cl_command_queue globalCommandQue;
 
+// Forward declaration, the task graph holds its tasks
+struct DFTaskGraph_CPU;
+
+// A single child node invocation scheduled by the task graph API
+typedef struct DFTask_CPU {
+  void *(*Func)(void *);
+  void *arguments;
+  // Depth stack of the thread which created the task. Ancestor queries from
+  // inside the task are answered from this copy.
+  std::vector<DFGDepth> *ParentDStack;
+  std::vector<struct DFTask_CPU *> *Successors;
+  struct DFTaskGraph_CPU *Graph;
+  unsigned numPending;
+  bool submitted;
+  bool started;
+  bool done;
+  pthread_t threadID;
+} DFTask_CPU;
+
+typedef struct DFTaskGraph_CPU {
+  pthread_mutex_t mtx;
+  pthread_cond_t cv;
+  std::vector<DFTask_CPU *> *Tasks;
+  unsigned numDone;
+} DFTaskGraph_CPU;
+
 MemTracker MTracker;
-vector<DFGDepth> DStack;
+// Each thread (main thread, pipeline stage or task) keeps its own depth stack,
+// so that concurrently executing nodes do not interleave their entries
+thread_local vector<DFGDepth> DStack;
 // Mutex to prevent concurrent access by multiple thereads in pipeline
 pthread_mutex_t ocl_mtx;
 
 #define NUM_TESTS 1
 hpvm_TimerSet kernel_timer;
 
+// Invocation of the node version selected by the policy. Every thread keeps
+// a stack of them, as dispatched nodes may be nested.
+typedef struct {
+  const char *name;
+  int version;
+  hpvm_Timer timer;
+  // Time spent copying memory during the invocation
+  hpvm_Timestamp copyTime;
+  // Tracked buffers requested during the invocation
+  std::vector<void *> footprint;
+} PolicyInvocation;
+
+// Policy queried by the dispatch stubs of nodes with more than one version.
+// Selected from the HPVM_POLICY environment variable when the policy is
+// initialized.
+static Policy *policy = NULL;
+thread_local vector<PolicyInvocation> PolicyStack;
+
+// Buffer handed to the device part of a co-executed node. Output buffers keep
+// a snapshot of their host contents at launch, so that the bytes written by
+// the device can be told apart when merging them back.
+typedef struct {
+  void *ptr;
+  size_t size;
+  cl_mem d_ptr;
+  cl_command_queue clCommandQue;
+  void *snapshot;
+} CoExecBuffer;
+
+// One invocation of a node whose x dimension is split between the device and
+// the CPU. The device runs the first gpuUnits of the units of the x dimension,
+// the CPU version of the node runs the remaining ones.
+typedef struct {
+  const char *name;
+  // Fraction of the units given to the device
+  double ratio;
+  // Function running the GPU version of the node, and its packed arguments
+  void *(*Func)(void *);
+  void *arguments;
+  pthread_t threadID;
+  pthread_mutex_t mtx;
+  pthread_cond_t cv;
+  // Set once the device has its copy of the data and the kernel is enqueued
+  bool launched;
+  uint64_t units;
+  uint64_t gpuUnits;
+  uint64_t cpuLimit;
+  uint64_t cpuUnits;
+  hpvm_Timestamp start;
+  hpvm_Timestamp launchTime;
+  hpvm_Timestamp gpuEnd;
+  std::vector<CoExecBuffer> *Buffers;
+} DFCoExec_OCL;
+
+// Split of the x dimension kept for each co-executed node, along with the
+// throughput of each side in units per second
+typedef struct {
+  double ratio;
+  double cpuRate;
+  double gpuRate;
+} CoExecSplit;
+
+#define COEXEC_MIN_RATIO 0.05
+static std::map<std::string, CoExecSplit> CoExecSplits;
+// Co-executed invocation whose CPU or device part this thread runs
+thread_local DFCoExec_OCL *CoExecCPU = NULL;
+thread_local DFCoExec_OCL *CoExecGPU = NULL;
+
 static const char *getErrorString(cl_int error) {
   switch (error) {
   // run-time and JIT compiler errors
@@ -259,6 +358,29 @@ uint64_t llvm_hpvm_cpu_getDimInstance(unsigned level, unsigned dim) {
 
 /********************** Memory Tracking Routines **************************/
 
+static hpvm_Timestamp get_time();
+
+// Adds a buffer to the footprint of the innermost dispatched node invocation
+// of this thread. Must be called with ocl_mtx held.
+static void policyRecordAccess(void *ptr) {
+  if (PolicyStack.empty())
+    return;
+  std::vector<void *> &footprint = PolicyStack.back().footprint;
+  if (std::find(footprint.begin(), footprint.end(), ptr) == footprint.end())
+    footprint.push_back(ptr);
+}
+
+// Reports a copy between host and device to the policy. Must be called with
+// ocl_mtx held.
+static void policyRecordTransfer(size_t size, hpvm_Timestamp start,
+                                 hpvm_Timestamp end) {
+  if (policy == NULL)
+    return;
+  if (!PolicyStack.empty())
+    PolicyStack.back().copyTime += end - start;
+  policy->recordTransfer(size, (end - start) / 1e9);
+}
+
 void llvm_hpvm_track_mem(void *ptr, size_t size) {
   DEBUG(cout << "Start tracking memory: " << ptr << flush << "\n");
   MemTrackerEntry *MTE = MTracker.lookup(ptr);
@@ -286,9 +408,52 @@ void llvm_hpvm_untrack_mem(void *ptr) {
   DEBUG(MTracker.print());
 }
 
+// Number of units of the x dimension given to the device
+static uint64_t coexecGPUUnits(uint64_t units, double ratio) {
+  uint64_t gpuUnits = (uint64_t)(ratio * units + 0.5);
+  return (gpuUnits > units) ? units : gpuUnits;
+}
+
+static void coexecSignalLaunched(DFCoExec_OCL *CE);
+
+// Memory request from the device part of a co-executed node. The host copy
+// stays the valid one, since the CPU part keeps working on it: the device
+// gets a private copy, which is merged back when the invocation ends.
+static void *llvm_hpvm_coexec_request_mem(void *ptr, size_t size,
+                                          DFNodeContext_OCL *Context,
+                                          bool isInput, bool isOutput) {
+  llvm_hpvm_request_mem(ptr, size);
+
+  pthread_mutex_lock(&ocl_mtx);
+  DEBUG(cout << "[CoExec] Request memory: " << ptr << flush << "\n");
+  cl_int errcode;
+  cl_mem d_ptr = clCreateBuffer(Context->clOCLContext, CL_MEM_READ_WRITE, size,
+                                NULL, &errcode);
+  checkErr(errcode, CL_SUCCESS, "Failure to allocate memory on device");
+  // Outputs are copied as well, so that the bytes the device does not write
+  // keep their value
+  hpvm_Timestamp copyStart = get_time();
+  errcode = clEnqueueWriteBuffer(Context->clCommandQue, d_ptr, CL_TRUE, 0, size,
+                                 ptr, 0, NULL, NULL);
+  checkErr(errcode, CL_SUCCESS, "Failure to copy memory to device");
+  policyRecordTransfer(size, copyStart, get_time());
+
+  CoExecBuffer B = {ptr, size, d_ptr, Context->clCommandQue, NULL};
+  if (isOutput) {
+    B.snapshot = malloc(size);
+    memcpy(B.snapshot, ptr, size);
+  }
+  CoExecGPU->Buffers->push_back(B);
+  pthread_mutex_unlock(&ocl_mtx);
+  return d_ptr;
+}
+
 static void *llvm_hpvm_ocl_request_mem(void *ptr, size_t size,
                                        DFNodeContext_OCL *Context, bool isInput,
                                        bool isOutput) {
+  if (CoExecGPU != NULL)
+    return llvm_hpvm_coexec_request_mem(ptr, size, Context, isInput, isOutput);
+
   pthread_mutex_lock(&ocl_mtx);
   DEBUG(cout << "[OCL] Request memory: " << ptr
              << " for context: " << Context->clOCLContext << flush << "\n");
@@ -298,6 +463,7 @@ static void *llvm_hpvm_ocl_request_mem(void *ptr, size_t size,
     cout << "ERROR: Requesting memory not present in Table\n";
     exit(EXIT_FAILURE);
   }
+  policyRecordAccess(ptr);
   // If already on device
   if (MTE->getLocation() == MemTrackerEntry::DEVICE &&
       ((DFNodeContext_OCL *)MTE->getContext())->clOCLContext ==
@@ -331,9 +497,11 @@ static void *llvm_hpvm_ocl_request_mem(void *ptr, size_t size,
   DEBUG(cout << "\nMemory allocated on device: " << d_input << flush << "\n");
   if (isInput) {
     DEBUG(cout << "\tCopying ...");
+    hpvm_Timestamp copyStart = get_time();
     errcode = clEnqueueWriteBuffer(Context->clCommandQue, d_input, CL_TRUE, 0,
                                    size, MTE->getAddress(), 0, NULL, NULL);
     checkErr(errcode, CL_SUCCESS, "Failure to copy memory to device");
+    policyRecordTransfer(size, copyStart, get_time());
   }
 
   hpvm_SwitchToTimer(&kernel_timer, hpvm_TimerID_NONE);
@@ -358,6 +526,7 @@ void *llvm_hpvm_request_mem(void *ptr, size_t size) {
     pthread_mutex_unlock(&ocl_mtx);
     exit(EXIT_FAILURE);
   }
+  policyRecordAccess(ptr);
   // If already on host
   if (MTE->getLocation() == MemTrackerEntry::HOST) {
     DEBUG(cout << "\tMemory found on host at: " << MTE->getAddress() << flush
@@ -372,9 +541,11 @@ void *llvm_hpvm_request_mem(void *ptr, size_t size) {
   DEBUG(cout << "\tCopying ...");
   hpvm_SwitchToTimer(&kernel_timer, hpvm_TimerID_COPY);
   // pthread_mutex_lock(&ocl_mtx);
+  hpvm_Timestamp copyStart = get_time();
   cl_int errcode = clEnqueueReadBuffer(
       ((DFNodeContext_OCL *)MTE->getContext())->clCommandQue,
       (cl_mem)MTE->getAddress(), CL_TRUE, 0, size, ptr, 0, NULL, NULL);
+  policyRecordTransfer(size, copyStart, get_time());
   // pthread_mutex_unlock(&ocl_mtx);
   hpvm_SwitchToTimer(&kernel_timer, hpvm_TimerID_NONE);
   DEBUG(cout << " done\n");
@@ -1263,15 +1434,38 @@ void llvm_hpvm_bufferPush(void *bufferID, uint64_t element) {
   buffer->push(element);
 }
 
+// Arguments of a pipeline stage thread
+typedef struct {
+  void *(*Func)(void *);
+  void *arguments;
+  std::vector<DFGDepth> *ParentDStack;
+} DFThreadArgs_CPU;
+
+// Entry point of a pipeline stage thread. The depth stack is thread local, so
+// the stage starts from a copy of the stack of the thread that created it.
+static void *runThread(void *arg) {
+  DFThreadArgs_CPU *Args = (DFThreadArgs_CPU *)arg;
+  DStack = *(Args->ParentDStack);
+  void *(*Func)(void *) = Args->Func;
+  void *arguments = Args->arguments;
+  delete Args->ParentDStack;
+  delete Args;
+  return Func(arguments);
+}
+
 // Create a thread
 void llvm_hpvm_createThread(void *graphID, void *(*Func)(void *),
                             void *arguments) {
   DEBUG(cout << "Create Thread -- Graph: " << graphID << ", Func: " << Func
              << ", Args: " << arguments << flush << "\n");
   DFNodeContext_CPU *Ctx = (DFNodeContext_CPU *)graphID;
+  DFThreadArgs_CPU *Args = new DFThreadArgs_CPU;
+  Args->Func = Func;
+  Args->arguments = arguments;
+  Args->ParentDStack = new std::vector<DFGDepth>(DStack);
   int err;
   pthread_t threadID;
-  if ((err = pthread_create(&threadID, NULL, Func, arguments)) != 0)
+  if ((err = pthread_create(&threadID, NULL, runThread, Args)) != 0)
     cout << "Failed to create thread. Error code = " << err << flush << "\n";
 
   Ctx->threads->push_back(threadID);
@@ -1304,6 +1498,122 @@ void llvm_hpvm_cpu_wait(void *graphID) {
   DEBUG(cout << "\t... pthread Done!\n");
 }
 
+/************************** CPU Task Graph API ********************************/
+
+static void startTask(DFTask_CPU *Task);
+
+// Entry point of a task thread. Restores the depth stack of the creating
+// thread, runs the task and releases the tasks waiting on it.
+static void *runTask(void *arg) {
+  DFTask_CPU *Task = (DFTask_CPU *)arg;
+  DStack = *(Task->ParentDStack);
+  Task->Func(Task->arguments);
+  DStack.clear();
+
+  DFTaskGraph_CPU *Graph = Task->Graph;
+  pthread_mutex_lock(&Graph->mtx);
+  Task->done = true;
+  Graph->numDone++;
+  for (DFTask_CPU *Succ : *(Task->Successors)) {
+    Succ->numPending--;
+    if (Succ->numPending == 0 && Succ->submitted)
+      startTask(Succ);
+  }
+  pthread_cond_broadcast(&Graph->cv);
+  pthread_mutex_unlock(&Graph->mtx);
+  return NULL;
+}
+
+// Must be called with the graph mutex held
+static void startTask(DFTask_CPU *Task) {
+  assert(!Task->started && "Task started twice");
+  Task->started = true;
+  int err;
+  if ((err = pthread_create(&Task->threadID, NULL, runTask, Task)) != 0) {
+    cout << "Failed to create task thread. Error code = " << err << flush
+         << "\n";
+    exit(EXIT_FAILURE);
+  }
+}
+
+void *llvm_hpvm_cpu_taskgraph_create() {
+  DFTaskGraph_CPU *Graph = new DFTaskGraph_CPU;
+  pthread_mutex_init(&Graph->mtx, NULL);
+  pthread_cond_init(&Graph->cv, NULL);
+  Graph->Tasks = new std::vector<DFTask_CPU *>();
+  Graph->numDone = 0;
+  DEBUG(cout << "Create TaskGraph: " << Graph << flush << "\n");
+  return Graph;
+}
+
+void *llvm_hpvm_cpu_task_create(void *graphID, void *(*Func)(void *),
+                                void *arguments) {
+  DFTaskGraph_CPU *Graph = (DFTaskGraph_CPU *)graphID;
+  DFTask_CPU *Task = new DFTask_CPU;
+  Task->Func = Func;
+  Task->arguments = arguments;
+  Task->ParentDStack = new std::vector<DFGDepth>(DStack);
+  Task->Successors = new std::vector<DFTask_CPU *>();
+  Task->Graph = Graph;
+  Task->numPending = 0;
+  Task->submitted = false;
+  Task->started = false;
+  Task->done = false;
+  pthread_mutex_lock(&Graph->mtx);
+  Graph->Tasks->push_back(Task);
+  pthread_mutex_unlock(&Graph->mtx);
+  DEBUG(cout << "Create Task -- Graph: " << Graph << ", Task: " << Task
+             << ", Func: " << Func << ", Args: " << arguments << flush
+             << "\n");
+  return Task;
+}
+
+void llvm_hpvm_cpu_task_depends(void *taskID, void *depID) {
+  DFTask_CPU *Task = (DFTask_CPU *)taskID;
+  DFTask_CPU *Dep = (DFTask_CPU *)depID;
+  assert(Task->Graph == Dep->Graph && "Dependence across task graphs");
+  assert(!Task->submitted && "Adding dependence to a submitted task");
+  DEBUG(cout << "Task " << Task << " depends on " << Dep << flush << "\n");
+  pthread_mutex_lock(&Task->Graph->mtx);
+  // A finished dependence does not hold the task back
+  if (!Dep->done) {
+    Dep->Successors->push_back(Task);
+    Task->numPending++;
+  }
+  pthread_mutex_unlock(&Task->Graph->mtx);
+}
+
+void llvm_hpvm_cpu_task_submit(void *taskID) {
+  DFTask_CPU *Task = (DFTask_CPU *)taskID;
+  DEBUG(cout << "Submit Task: " << Task << flush << "\n");
+  pthread_mutex_lock(&Task->Graph->mtx);
+  Task->submitted = true;
+  if (Task->numPending == 0)
+    startTask(Task);
+  pthread_mutex_unlock(&Task->Graph->mtx);
+}
+
+void llvm_hpvm_cpu_taskgraph_wait(void *graphID) {
+  DFTaskGraph_CPU *Graph = (DFTaskGraph_CPU *)graphID;
+  DEBUG(cout << "Wait for TaskGraph: " << Graph << flush << "\n");
+  pthread_mutex_lock(&Graph->mtx);
+  while (Graph->numDone < Graph->Tasks->size())
+    pthread_cond_wait(&Graph->cv, &Graph->mtx);
+  pthread_mutex_unlock(&Graph->mtx);
+
+  for (DFTask_CPU *Task : *(Graph->Tasks)) {
+    pthread_join(Task->threadID, NULL);
+    delete Task->ParentDStack;
+    delete Task->Successors;
+    delete Task;
+  }
+  delete Graph->Tasks;
+  pthread_mutex_destroy(&Graph->mtx);
+  pthread_cond_destroy(&Graph->cv);
+  delete Graph;
+  DEBUG(cout << "\t... TaskGraph Done!\n");
+}
+
 // Returns the platform name.
 std::string getPlatformName(cl_platform_id pid) {
   cl_int status;
@@ -1617,6 +1927,31 @@ void *llvm_hpvm_ocl_executeNode(void *graphID, unsigned workDim,
     }
     DEBUG(cout << ")\n");
   }
+
+  if (CoExecGPU != NULL) {
+    // Co-execution: only the leading units of the x dimension run on the
+    // device. Work-group and global ids then keep their values, as no global
+    // offset is needed.
+    uint64_t unitSize = (localWorkSize == NULL) ? 1 : LocalWG[0];
+    CoExecGPU->units = GlobalWG[0] / unitSize;
+    CoExecGPU->gpuUnits = coexecGPUUnits(CoExecGPU->units, CoExecGPU->ratio);
+    GlobalWG[0] = CoExecGPU->gpuUnits * unitSize;
+    DEBUG(cout << "\tCo-execution: device runs " << CoExecGPU->gpuUnits
+               << " of " << CoExecGPU->units << " units\n");
+    if (GlobalWG[0] != 0) {
+      cl_int errcode = clEnqueueNDRangeKernel(
+          Context->clCommandQue, Context->clKernel, workDim, NULL, GlobalWG,
+          (localWorkSize == NULL) ? NULL : LocalWG, 0, NULL, NULL);
+      checkErr(errcode, CL_SUCCESS, "Failure to enqueue kernel");
+    }
+    pthread_mutex_unlock(&ocl_mtx);
+    // Let the CPU part start, and wait for the kernel without holding the
+    // runtime lock the CPU part needs
+    coexecSignalLaunched(CoExecGPU);
+    clFinish(Context->clCommandQue);
+    return NULL;
+  }
+
   clFinish(Context->clCommandQue);
   hpvm_SwitchToTimer(&kernel_timer, hpvm_TimerID_COMPUTATION);
   cl_int errcode = clEnqueueNDRangeKernel(
@@ -1745,6 +2080,182 @@ void llvm_hpvm_ocl_wait(void *graphID) {
   pthread_mutex_unlock(&ocl_mtx);
 }
 
+/****************************** Leaf JIT API **********************************/
+
+// Entry point of the optional leaf JIT library, built from hpvm-rt-jit.cpp
+typedef void *(*JITSpecializeFunc)(const char *, const char *, uint64_t,
+                                   const uint64_t *, unsigned);
+
+static pthread_mutex_t jit_mtx = PTHREAD_MUTEX_INITIALIZER;
+static bool JITLoaded = false;
+static JITSpecializeFunc JITSpecialize = NULL;
+
+// Returns the version of leaf function name specialized for the given values
+// of its scalar arguments and dimension limits, or NULL to run the generic
+// version. Specialization is enabled by setting HPVM_JIT, and is done by the
+// library named by HPVM_JIT_LIBRARY (libhpvm-rt-jit.so by default), which
+// compiles the embedded bitcode of the leaf for the host.
+void *llvm_hpvm_cpu_jit_lookup(const char *name, const char *bitcode,
+                               uint64_t size, const uint64_t *values,
+                               unsigned n) {
+  pthread_mutex_lock(&jit_mtx);
+  if (!JITLoaded) {
+    JITLoaded = true;
+    if (getenv("HPVM_JIT")) {
+      const char *lib = getenv("HPVM_JIT_LIBRARY");
+      void *handle = dlopen(lib ? lib : "libhpvm-rt-jit.so", RTLD_NOW);
+      if (handle)
+        JITSpecialize =
+            (JITSpecializeFunc)dlsym(handle, "hpvm_jit_specialize");
+      if (!JITSpecialize) {
+        // dlerror returns NULL if no error occurred since the last call
+        const char *E = dlerror();
+        cout << "Failed to load the leaf JIT, running generic leaves: "
+             << (E ? E : "unknown error") << "\n";
+      }
+    }
+  }
+  pthread_mutex_unlock(&jit_mtx);
+
+  if (!JITSpecialize)
+    return NULL;
+  void *func = JITSpecialize(name, bitcode, size, values, n);
+  DEBUG(cout << "Leaf " << name << " specialized version = " << func << "\n");
+  return func;
+}
+
+/**************************** Co-execution API *******************************/
+
+static void coexecSignalLaunched(DFCoExec_OCL *CE) {
+  pthread_mutex_lock(&CE->mtx);
+  if (!CE->launched) {
+    CE->launched = true;
+    CE->launchTime = get_time();
+  }
+  pthread_cond_broadcast(&CE->cv);
+  pthread_mutex_unlock(&CE->mtx);
+}
+
+static void *coexecRunDevicePart(void *data) {
+  DFCoExec_OCL *CE = (DFCoExec_OCL *)data;
+  CoExecGPU = CE;
+  CE->Func(CE->arguments);
+  CoExecGPU = NULL;
+  CE->gpuEnd = get_time();
+  // In case the GPU version returned without launching a kernel
+  coexecSignalLaunched(CE);
+  return NULL;
+}
+
+void llvm_hpvm_coexec_start(const char *name, void *(*Func)(void *),
+                            void *arguments) {
+  assert(CoExecCPU == NULL && "Nested co-execution is not supported!");
+  DFCoExec_OCL *CE = new DFCoExec_OCL();
+  CE->name = name;
+  CE->Func = Func;
+  CE->arguments = arguments;
+  CE->launched = false;
+  CE->units = 0;
+  CE->gpuUnits = 0;
+  CE->cpuLimit = 0;
+  CE->cpuUnits = 0;
+  CE->Buffers = new std::vector<CoExecBuffer>();
+  pthread_mutex_init(&CE->mtx, NULL);
+  pthread_cond_init(&CE->cv, NULL);
+
+  pthread_mutex_lock(&ocl_mtx);
+  auto it = CoExecSplits.find(name);
+  CE->ratio = (it == CoExecSplits.end()) ? 0.5 : it->second.ratio;
+  pthread_mutex_unlock(&ocl_mtx);
+  DEBUG(cout << "Co-execute node " << name << " with device ratio "
+             << CE->ratio << "\n");
+
+  CE->start = get_time();
+  pthread_create(&CE->threadID, NULL, coexecRunDevicePart, CE);
+
+  // The CPU part may only touch the data once the device has its own copy
+  pthread_mutex_lock(&CE->mtx);
+  while (!CE->launched)
+    pthread_cond_wait(&CE->cv, &CE->mtx);
+  pthread_mutex_unlock(&CE->mtx);
+  CoExecCPU = CE;
+}
+
+uint64_t llvm_hpvm_coexec_cpuBegin(uint64_t limit) {
+  if (CoExecCPU == NULL)
+    return 0;
+  uint64_t gpuUnits = coexecGPUUnits(limit, CoExecCPU->ratio);
+  CoExecCPU->cpuLimit = limit;
+  CoExecCPU->cpuUnits = limit - gpuUnits;
+  return gpuUnits;
+}
+
+void llvm_hpvm_coexec_end() {
+  DFCoExec_OCL *CE = CoExecCPU;
+  assert(CE != NULL && "No co-executed node to end!");
+  CoExecCPU = NULL;
+  hpvm_Timestamp cpuEnd = get_time();
+  pthread_join(CE->threadID, NULL);
+
+  if (CE->units != 0 && CE->cpuLimit != 0 && CE->units != CE->cpuLimit)
+    cout << "WARNING: Co-executed node " << CE->name
+         << " has different x dimensions on the device (" << CE->units
+         << ") and the CPU (" << CE->cpuLimit << ")\n";
+
+  pthread_mutex_lock(&ocl_mtx);
+  // Merge the bytes written by the device into the host copy. The two parts
+  // run disjoint node instances, so they never write the same bytes.
+  for (CoExecBuffer &B : *(CE->Buffers)) {
+    if (B.snapshot != NULL) {
+      char *d_copy = (char *)malloc(B.size);
+      hpvm_Timestamp copyStart = get_time();
+      cl_int errcode = clEnqueueReadBuffer(B.clCommandQue, B.d_ptr, CL_TRUE, 0,
+                                           B.size, d_copy, 0, NULL, NULL);
+      checkErr(errcode, CL_SUCCESS, "[coexec] Failure to read output");
+      policyRecordTransfer(B.size, copyStart, get_time());
+      char *h_copy = (char *)B.ptr;
+      char *snapshot = (char *)B.snapshot;
+      for (size_t i = 0; i < B.size; i++)
+        if (d_copy[i] != snapshot[i])
+          h_copy[i] = d_copy[i];
+      free(d_copy);
+      free(B.snapshot);
+    }
+    clReleaseMemObject(B.d_ptr);
+  }
+
+  // Move the split towards the ratio of the measured throughputs. The CPU
+  // part starts once the device part has launched.
+  auto it = CoExecSplits.find(CE->name);
+  if (it == CoExecSplits.end()) {
+    CoExecSplit S = {CE->ratio, 0.0, 0.0};
+    it = CoExecSplits.insert(std::make_pair(std::string(CE->name), S)).first;
+  }
+  CoExecSplit &S = it->second;
+  double cpuTime = (cpuEnd - CE->launchTime) / 1e9;
+  double gpuTime = (CE->gpuEnd - CE->start) / 1e9;
+  if (CE->cpuUnits != 0 && cpuTime > 0.0)
+    S.cpuRate = CE->cpuUnits / cpuTime;
+  if (CE->gpuUnits != 0 && gpuTime > 0.0)
+    S.gpuRate = CE->gpuUnits / gpuTime;
+  if (S.cpuRate > 0.0 && S.gpuRate > 0.0) {
+    double target = S.gpuRate / (S.cpuRate + S.gpuRate);
+    S.ratio = 0.5 * S.ratio + 0.5 * target;
+    S.ratio = std::max(COEXEC_MIN_RATIO,
+                       std::min(1.0 - COEXEC_MIN_RATIO, S.ratio));
+  }
+  DEBUG(cout << "Co-executed node " << CE->name << ": CPU " << cpuTime
+             << "s for " << CE->cpuUnits << " units, device " << gpuTime
+             << "s for " << CE->gpuUnits << " units, next ratio " << S.ratio
+             << "\n");
+  pthread_mutex_unlock(&ocl_mtx);
+
+  pthread_mutex_destroy(&CE->mtx);
+  pthread_cond_destroy(&CE->cv);
+  delete CE->Buffers;
+  delete CE;
+}
+
 void llvm_hpvm_switchToTimer(void **timerSet, enum hpvm_TimerID timer) {
   pthread_mutex_lock(&ocl_mtx);
   pthread_mutex_unlock(&ocl_mtx);
@@ -1767,3 +2278,207 @@ void *llvm_hpvm_initializeTimerSet() {
   pthread_mutex_unlock(&ocl_mtx);
   return TS;
 }
+
+/****************************** Policy API ************************************/
+
+static std::thread *deviceStatusThread = NULL;
+
+void llvm_hpvm_policy_init() {
+  pthread_mutex_lock(&ocl_mtx);
+  assert(policy == NULL && "Policy already initialized!");
+  const char *name = getenv("HPVM_POLICY");
+  std::string s = name ? name : "gpu";
+  if (s == "cpu") {
+    policy = new ConstPolicy(0);
+  } else if (s == "gpu") {
+    policy = new ConstPolicy(1);
+  } else if (s == "coexec") {
+    policy = new ConstPolicy(3);
+  } else if (s == "node") {
+    policy = new NodePolicy();
+  } else if (s == "iteration") {
+    policy = new IterationPolicy();
+  } else if (s == "adaptive") {
+    const char *alpha = getenv("HPVM_POLICY_ALPHA");
+    const char *epsilon = getenv("HPVM_POLICY_EPSILON");
+    policy = new AdaptivePolicy(&MTracker, alpha ? atof(alpha) : 0.3,
+                                epsilon ? atof(epsilon) : 0.05);
+  } else if (s == "device-status") {
+    initializeDeviceStatusIntervals();
+    if (!Intervals.empty())
+      deviceStatusThread = new std::thread(updateDeviceStatus);
+    policy = new DeviceStatusPolicy();
+  } else {
+    cout << "Unknown policy " << s << ". Using GPU policy instead.\n";
+    policy = new ConstPolicy(1);
+  }
+  DEBUG(cout << "Initialized policy: " << s << "\n");
+  pthread_mutex_unlock(&ocl_mtx);
+}
+
+int llvm_hpvm_policy_getVersion(const char *name, int64_t iteration,
+                                int coexec) {
+  pthread_mutex_lock(&ocl_mtx);
+  assert(policy != NULL && "Policy used before initialization!");
+  int version = coexec ? policy->getCoExecVersion(name, iteration)
+                       : policy->getVersion(name, iteration);
+  DEBUG(cout << "Node " << name << " iteration " << iteration << " -> version "
+             << version << "\n");
+  pthread_mutex_unlock(&ocl_mtx);
+
+  // Time the invocation until the matching llvm_hpvm_policy_endVersion
+  PolicyStack.push_back(PolicyInvocation());
+  PolicyInvocation &PI = PolicyStack.back();
+  PI.name = name;
+  PI.version = version;
+  PI.copyTime = 0;
+  hpvm_ResetTimer(&PI.timer);
+  hpvm_StartTimer(&PI.timer);
+  return version;
+}
+
+void llvm_hpvm_policy_endVersion() {
+  assert(!PolicyStack.empty() && "No node version to end!");
+  PolicyInvocation &PI = PolicyStack.back();
+  hpvm_StopTimer(&PI.timer);
+  double time = hpvm_GetElapsedTime(&PI.timer) - PI.copyTime / 1e9;
+  pthread_mutex_lock(&ocl_mtx);
+  DEBUG(cout << "Node " << PI.name << " version " << PI.version << " took "
+             << time << "s\n");
+  policy->update(PI.name, PI.version, time, PI.footprint);
+  pthread_mutex_unlock(&ocl_mtx);
+  PolicyStack.pop_back();
+}
+
+void llvm_hpvm_policy_clear() {
+  pthread_mutex_lock(&ocl_mtx);
+  if (deviceStatusThread) {
+    executionEnd = true;
+    deviceStatusThread->join();
+    delete deviceStatusThread;
+    deviceStatusThread = NULL;
+  }
+  delete policy;
+  policy = NULL;
+  pthread_mutex_unlock(&ocl_mtx);
+}
+
+/****************************** Trace API *************************************/
+
+typedef struct {
+  pthread_mutex_t mtx;
+  FILE *File;
+  hpvm::trace::FileWriter *Writer;
+  bool compress;
+} DFTrace;
+
+void *llvm_hpvm_trace_open(const char *path, int compress) {
+  FILE *File = fopen(path, "wb");
+  if (File == NULL) {
+    cout << "Failed to open trace " << path << "\n";
+    return NULL;
+  }
+  DFTrace *Trace = (DFTrace *)malloc(sizeof(DFTrace));
+  pthread_mutex_init(&Trace->mtx, NULL);
+  Trace->File = File;
+  Trace->Writer = new hpvm::trace::FileWriter(File, compress != 0);
+  Trace->compress = compress != 0;
+  DEBUG(cout << "Tracing memory accesses to " << path << "\n");
+  return Trace;
+}
+
+void llvm_hpvm_trace_access(void *trace, unsigned core, unsigned kind,
+                            uint64_t addr) {
+  DFTrace *Trace = (DFTrace *)trace;
+  pthread_mutex_lock(&Trace->mtx);
+  Trace->Writer->add(core, kind, addr);
+  pthread_mutex_unlock(&Trace->mtx);
+}
+
+void llvm_hpvm_trace_close(void *trace) {
+  DFTrace *Trace = (DFTrace *)trace;
+  pthread_mutex_lock(&Trace->mtx);
+  bool written = Trace->Writer->finish();
+  if (fclose(Trace->File) != 0 || !written)
+    cout << "Failed to write trace\n";
+  delete Trace->Writer;
+  pthread_mutex_unlock(&Trace->mtx);
+  pthread_mutex_destroy(&Trace->mtx);
+  free(Trace);
+}
+
+// Trace of the leaf nodes instrumented by -spandex-trace. It is opened on the
+// first instance, if HPVM_TRACE names its file, and closed at exit.
+static DFTrace *leafTrace = NULL;
+static pthread_once_t leafTraceOnce = PTHREAD_ONCE_INIT;
+// Only every leafTraceSample-th instance of a node is traced
+static uint64_t leafTraceSample = 1;
+// Only accesses to [leafTraceLow, leafTraceHigh) are traced
+static uint64_t leafTraceLow = 0;
+static uint64_t leafTraceHigh = UINT64_MAX;
+
+static void leafTraceClose() {
+  llvm_hpvm_trace_close(leafTrace);
+  leafTrace = NULL;
+}
+
+static void leafTraceInit() {
+  const char *path = getenv("HPVM_TRACE");
+  if (path == NULL)
+    return;
+  const char *compress = getenv("HPVM_TRACE_COMPRESS");
+  const char *sample = getenv("HPVM_TRACE_SAMPLE");
+  const char *range = getenv("HPVM_TRACE_RANGE");
+  if (sample != NULL && strtoull(sample, NULL, 0) > 0)
+    leafTraceSample = strtoull(sample, NULL, 0);
+  if (range != NULL) {
+    // <low>:<high>, in any base strtoull reads
+    char *end;
+    leafTraceLow = strtoull(range, &end, 0);
+    if (*end == ':')
+      leafTraceHigh = strtoull(end + 1, NULL, 0);
+  }
+  leafTrace = (DFTrace *)llvm_hpvm_trace_open(
+      path, compress != NULL && atoi(compress) != 0);
+  if (leafTrace != NULL)
+    atexit(leafTraceClose);
+}
+
+// Records of the instances run by one thread. The thread encodes them without
+// locking, and only takes the lock of the trace to write a full chunk.
+struct LeafTraceBuffer {
+  hpvm::trace::ChunkEncoder Encoder;
+  std::vector<uint8_t> Chunk;
+
+  void flush() {
+    if (Encoder.empty() || leafTrace == NULL)
+      return;
+    uint32_t numAccesses = Encoder.size();
+    Chunk.clear();
+    Encoder.finish(Chunk, leafTrace->compress);
+    pthread_mutex_lock(&leafTrace->mtx);
+    leafTrace->Writer->writeChunk(Chunk.data(), Chunk.size(), numAccesses);
+    pthread_mutex_unlock(&leafTrace->mtx);
+  }
+
+  // Threads flush what is left when they exit, before the trace is closed
+  ~LeafTraceBuffer() { flush(); }
+};
+
+static thread_local LeafTraceBuffer leafTraceBuffer;
+
+int llvm_hpvm_trace_begin(unsigned node, uint64_t instance) {
+  pthread_once(&leafTraceOnce, leafTraceInit);
+  return leafTrace != NULL && instance % leafTraceSample == 0;
+}
+
+void llvm_hpvm_trace_record(unsigned node, uint64_t instance,
+                            unsigned instruction, unsigned kind, void *addr) {
+  uint64_t address = (uint64_t)addr;
+  if (address < leafTraceLow || address >= leafTraceHigh)
+    return;
+  LeafTraceBuffer &B = leafTraceBuffer;
+  B.Encoder.addTagged(node, kind, address, instance, instruction);
+  if (B.Encoder.full())
+    B.flush();
+}
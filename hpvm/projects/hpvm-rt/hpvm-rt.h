@@ -149,6 +149,15 @@ void *llvm_hpvm_request_mem(void *, size_t);
 /*********************** OPENCL & PTHREAD API **************************/
 void *llvm_hpvm_cpu_launch(void *(void *), void *);
 void llvm_hpvm_cpu_wait(void *);
+
+// Task graph API used to run independent sibling nodes concurrently.
+// A task starts once all tasks it depends on have finished and it has been
+// submitted. Waiting on the graph joins every task and frees the graph.
+void *llvm_hpvm_cpu_taskgraph_create();
+void *llvm_hpvm_cpu_task_create(void *, void *(void *), void *);
+void llvm_hpvm_cpu_task_depends(void *, void *);
+void llvm_hpvm_cpu_task_submit(void *);
+void llvm_hpvm_cpu_taskgraph_wait(void *);
 void *llvm_hpvm_ocl_initContext(enum hpvm::Target);
 
 void *llvm_hpvm_cpu_argument_ptr(void *, size_t);
@@ -165,9 +174,49 @@ void *llvm_hpvm_ocl_executeNode(void *, unsigned, const size_t *,
 void *llvm_hpvm_ocl_launch(const char *, const char *);
 void llvm_hpvm_ocl_wait(void *);
 
+// Returns the version of a leaf node function specialized by the runtime JIT
+// for the given scalar arguments and dimension limits, or NULL.
+void *llvm_hpvm_cpu_jit_lookup(const char *, const char *, uint64_t,
+                               const uint64_t *, unsigned);
+
+// Co-execution API. Splits the x dimension of the kernel launched by the GPU
+// version of a node: the device runs the leading node instances while the CPU
+// version, started in between, runs the remaining ones.
+void llvm_hpvm_coexec_start(const char *, void *(void *), void *);
+uint64_t llvm_hpvm_coexec_cpuBegin(uint64_t);
+void llvm_hpvm_coexec_end();
+
 void llvm_hpvm_switchToTimer(void **timerSet, enum hpvm_TimerID);
 void llvm_hpvm_printTimerSet(void **timerSet, char *timerName = NULL);
 void *llvm_hpvm_initializeTimerSet();
+
+// Policy API used by the dispatch stubs of nodes with a CPU and a GPU
+// version. getVersion is told whether the node can be co-executed, and returns
+// 0 to run the CPU version, 3 to co-execute both versions when the node
+// supports it, any other value to run the GPU version. endVersion is called
+// once the selected version returns, so that the policy can learn from its
+// execution time.
+void llvm_hpvm_policy_init();
+int llvm_hpvm_policy_getVersion(const char *, int64_t, int);
+void llvm_hpvm_policy_endVersion();
+void llvm_hpvm_policy_clear();
+
+// Memory trace API. Writes the accesses of a program to a binary trace file
+// (SupportHPVM/HPVMTrace.h) replayed by spandex-sim. open returns NULL if the
+// file cannot be created; access may be called from any thread, with kind 0
+// for a load and 1 for a store.
+void *llvm_hpvm_trace_open(const char *, int);
+void llvm_hpvm_trace_access(void *, unsigned, unsigned, uint64_t);
+void llvm_hpvm_trace_close(void *);
+
+// Calls inserted in leaf nodes by -spandex-trace. begin is called at the start
+// of every node instance and returns whether its accesses are sampled; record
+// is then called before each of its accesses. Tracing is enabled by
+// HPVM_TRACE=<file>, and tuned by HPVM_TRACE_SAMPLE=<n> (trace one instance of
+// every n), HPVM_TRACE_RANGE=<low>:<high> (trace these addresses only) and
+// HPVM_TRACE_COMPRESS=1.
+int llvm_hpvm_trace_begin(unsigned, uint64_t);
+void llvm_hpvm_trace_record(unsigned, uint64_t, unsigned, unsigned, void *);
 }
 
 /*************************** Pipeline API ******************************/
@@ -2,12 +2,29 @@
 #define __POLICY__
 
 #include "device_abstraction.h"
+#include "hpvm-rt.h"
+#include <limits>
+#include <map>
+#include <random>
 #include <string>
+#include <vector>
 
 /************************* Policies *************************************/
 class Policy {
 public:
   virtual int getVersion(const char *, int64_t) = 0;
+  // Same, for a node that can also be co-executed on the CPU and the device
+  // (version 3). Policies that do not model co-execution pick as usual.
+  virtual int getCoExecVersion(const char *name, int64_t it) {
+    return getVersion(name, it);
+  }
+  // Called once an invocation of a node has finished, with the version that
+  // ran, its execution time in seconds (excluding memory copies) and the
+  // tracked buffers it requested. Only adaptive policies make use of it.
+  virtual void update(const char *, int, double, const std::vector<void *> &) {
+  }
+  // Called after every copy between host and device memory
+  virtual void recordTransfer(size_t, double) {}
   virtual ~Policy(){};
 };
 
@@ -96,4 +113,132 @@ public:
   }
 };
 
+/* ------------------------------------------------------------------------- */
+
+// Picks the version with the lowest predicted completion time for each node.
+// The prediction is an exponentially weighted average of the node's past
+// execution times on that device, plus the time needed to move the buffers the
+// node used last time to that device, according to where the MemTracker
+// currently has them. With probability epsilon a random version is picked
+// instead, so that the estimates of the versions not chosen do not go stale.
+// Co-execution is only considered for nodes whose dispatch stub offers it.
+class AdaptivePolicy : public Policy {
+private:
+  // CPU, GPU and co-execution on both
+  static const int NUM_VERSIONS = 3;
+  static const int COEXEC_VERSION = 3;
+
+  struct NodeEstimate {
+    double execTime[NUM_VERSIONS];
+    unsigned samples[NUM_VERSIONS];
+    std::vector<void *> footprint;
+
+    NodeEstimate() {
+      for (int v = 0; v < NUM_VERSIONS; v++) {
+        execTime[v] = 0.0;
+        samples[v] = 0;
+      }
+    }
+  };
+
+  MemTracker *MT;
+  // Weight of the newest sample in the averages
+  double alpha;
+  // Probability of exploring a random version
+  double epsilon;
+  std::map<std::string, NodeEstimate> Nodes;
+  // Host <-> device copy bandwidth in bytes per second
+  double bandwidth;
+  unsigned transferSamples;
+  std::mt19937 rng;
+
+  // Index of the estimate of a version, or -1 for versions this policy never
+  // picks
+  static int getVersionIndex(int version) {
+    if (version == 0 || version == 1)
+      return version;
+    return version == COEXEC_VERSION ? 2 : -1;
+  }
+
+  // Co-execution needs the buffers on the device, like the GPU version
+  double getTransferTime(const NodeEstimate &E, int v) {
+    if (transferSamples == 0)
+      return 0.0;
+    MemTrackerEntry::Location loc =
+        (v == 0) ? MemTrackerEntry::HOST : MemTrackerEntry::DEVICE;
+    size_t bytes = 0;
+    for (void *ptr : E.footprint) {
+      MemTrackerEntry *MTE = MT->lookup(ptr);
+      if (MTE != NULL && MTE->getLocation() != loc)
+        bytes += MTE->getSize();
+    }
+    return bytes / bandwidth;
+  }
+
+  // Picks among the first n estimates, and returns the matching version
+  int pickVersion(const char *name, int n) {
+    static const int Versions[NUM_VERSIONS] = {0, 1, COEXEC_VERSION};
+    NodeEstimate &E = Nodes[name];
+    // Every version is measured once before the estimates are compared
+    for (int v = 0; v < n; v++)
+      if (E.samples[v] == 0)
+        return Versions[v];
+
+    if (std::uniform_real_distribution<double>(0.0, 1.0)(rng) < epsilon)
+      return Versions[std::uniform_int_distribution<int>(0, n - 1)(rng)];
+
+    int best = 0;
+    double bestTime = std::numeric_limits<double>::max();
+    for (int v = 0; v < n; v++) {
+      double t = E.execTime[v] + getTransferTime(E, v);
+      if (t < bestTime) {
+        bestTime = t;
+        best = v;
+      }
+    }
+    return Versions[best];
+  }
+
+public:
+  AdaptivePolicy(MemTracker *MT, double alpha, double epsilon)
+      : MT(MT), alpha(alpha), epsilon(epsilon), bandwidth(0.0),
+        transferSamples(0), rng(0) {}
+
+  int getVersion(const char *name, int64_t it) override {
+    return pickVersion(name, NUM_VERSIONS - 1);
+  }
+
+  int getCoExecVersion(const char *name, int64_t it) override {
+    return pickVersion(name, NUM_VERSIONS);
+  }
+
+  void update(const char *name, int version, double time,
+              const std::vector<void *> &footprint) override {
+    // Each version keeps its own estimate. Versions this policy never picks
+    // can only come from another dispatch path and are not averaged in.
+    int v = getVersionIndex(version);
+    if (v < 0)
+      return;
+    NodeEstimate &E = Nodes[name];
+    if (E.samples[v] == 0)
+      E.execTime[v] = time;
+    else
+      E.execTime[v] = alpha * time + (1.0 - alpha) * E.execTime[v];
+    E.samples[v]++;
+    if (!footprint.empty())
+      E.footprint = footprint;
+  }
+
+  void recordTransfer(size_t bytes, double time) override {
+    if (bytes == 0 || time <= 0.0)
+      return;
+    double bw = bytes / time;
+    if (transferSamples == 0)
+      bandwidth = bw;
+    else
+      bandwidth = alpha * bw + (1.0 - alpha) * bandwidth;
+    transferSamples++;
+  }
+};
+
 #endif // __POLICY__
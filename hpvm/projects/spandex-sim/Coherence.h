@@ -0,0 +1,288 @@
+//===----------------------------- Coherence.h ----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Trace-driven cost model of the coherence protocols compared in the report:
+// MESI, Spandex, and Spandex with producer- or consumer-owned buffers. Every
+// access is charged a latency in cycles and the flits it routes on the NoC,
+// following the latency and traffic tables of the report.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef SPANDEX_SIM_COHERENCE_H
+#define SPANDEX_SIM_COHERENCE_H
+
+#include "Trace.h"
+
+#include <cassert>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace spandex_sim {
+
+// Cycles
+constexpr uint64_t L1Hit = 1;
+constexpr uint64_t RemoteL1Hit = 30;
+constexpr uint64_t L2Forward = 50;
+constexpr uint64_t BusForward = 45;
+
+// Entries
+constexpr size_t WriteCoalescingBuffer = 32;
+
+// Hops
+constexpr uint64_t L1ToL1Hops = 1;
+constexpr uint64_t L1ToL2Hops = 1;
+
+// Flits
+constexpr uint64_t WordSize = 1;
+constexpr uint64_t HeaderSize = 1;
+constexpr uint64_t AddressSize = 1;
+constexpr uint64_t LineSize = 8;
+constexpr uint64_t AckAddressSize = 1;
+
+// Bytes
+constexpr uint64_t LineBytes = 64;
+
+// Cost of the accesses of one core, in the columns of the CSV output
+struct Costs {
+  // Cycles
+  uint64_t Store = 0;
+  uint64_t Load = 0;
+  // Flits routed for stores and for loads
+  uint64_t StoreTraffic = 0;
+  uint64_t LoadTraffic = 0;
+
+  Costs &operator+=(const Costs &Other) {
+    Store += Other.Store;
+    Load += Other.Load;
+    StoreTraffic += Other.StoreTraffic;
+    LoadTraffic += Other.LoadTraffic;
+    return *this;
+  }
+};
+
+// Set of the Capacity most recently inserted keys, in O(1) per operation
+class LRUSet {
+public:
+  explicit LRUSet(size_t Capacity) : Capacity(Capacity) {}
+
+  // Makes Key the most recent one. Returns whether it was already present;
+  // otherwise the least recent key is evicted when the set is full.
+  bool insert(uint64_t Key) {
+    auto It = Where.find(Key);
+    if (It != Where.end()) {
+      Order.splice(Order.end(), Order, It->second);
+      return true;
+    }
+    if (Order.size() == Capacity) {
+      Where.erase(Order.front());
+      Order.pop_front();
+    }
+    Where.emplace(Key, Order.insert(Order.end(), Key));
+    return false;
+  }
+
+private:
+  size_t Capacity;
+  std::list<uint64_t> Order;
+  std::unordered_map<uint64_t, std::list<uint64_t>::iterator> Where;
+};
+
+// In the order of their names, which is the order of the output
+enum class Mode { MESI, Spandex, SpandexConsumerOwned, SpandexProducerOwned };
+constexpr Mode AllModes[] = {Mode::MESI, Mode::Spandex,
+                             Mode::SpandexConsumerOwned,
+                             Mode::SpandexProducerOwned};
+
+// Whether the costs of a mode can be split by line address. The coalescing
+// buffer of Spandex_consumer_owned is shared by all lines, so that mode is
+// replayed whole.
+inline bool isShardable(Mode M) { return M != Mode::SpandexConsumerOwned; }
+
+// Shard of the line of Addr when the lines are split between NumShards
+inline unsigned getShard(uint64_t Addr, unsigned NumShards) {
+  return (Addr / LineBytes) % NumShards;
+}
+
+inline const char *getModeName(Mode M) {
+  switch (M) {
+  case Mode::MESI:
+    return "MESI";
+  case Mode::Spandex:
+    return "Spandex";
+  case Mode::SpandexConsumerOwned:
+    return "Spandex_consumer_owned";
+  case Mode::SpandexProducerOwned:
+    return "Spandex_producer_owned";
+  }
+  return "";
+}
+
+enum class LineState : uint8_t { I, S, V, O, M };
+
+// State of every line in the private cache of every core. Lines a core has
+// not seen are I.
+class LineStates {
+public:
+  LineState get(uint64_t Line, uint32_t Core) const {
+    auto It = States.find(Line);
+    if (It == States.end() || Core >= It->second.size())
+      return LineState::I;
+    return It->second[Core];
+  }
+
+  void set(uint64_t Line, uint32_t Core, LineState State) {
+    std::vector<LineState> &Cores = States[Line];
+    if (Core >= Cores.size())
+      Cores.resize(Core + 1, LineState::I);
+    Cores[Core] = State;
+  }
+
+  // Sets the line to State in cores 0 to NumCores - 1
+  void setAll(uint64_t Line, uint32_t NumCores, LineState State) {
+    std::vector<LineState> &Cores = States[Line];
+    if (NumCores > Cores.size())
+      Cores.resize(NumCores, LineState::I);
+    std::fill(Cores.begin(), Cores.begin() + NumCores, State);
+  }
+
+private:
+  std::unordered_map<uint64_t, std::vector<LineState>> States;
+};
+
+// Replays the accesses of a trace in one mode. A simulator may be fed only the
+// accesses to the lines of one shard, as long as each comes with the number
+// of cores that had accessed memory by then in the whole trace. Since the
+// state of a line only depends on the accesses to it, the costs of the shards
+// of a shardable mode add up to the costs of the whole trace.
+class Simulator {
+public:
+  explicit Simulator(Mode M)
+      : M(M), CoalescingBuffer(WriteCoalescingBuffer) {}
+
+  // Replays the next access of the whole trace
+  void access(const Access &A) {
+    access(A, std::max<uint32_t>(NumSeen, A.Core + 1));
+  }
+
+  // Replays the next access of a shard, Seen cores having accessed memory up
+  // to and including it
+  void access(const Access &A, uint32_t Seen) {
+    // Invalidations and fills reach the cores that have accessed memory so
+    // far, which are the ones with a lower index
+    NumSeen = Seen;
+    if (A.Core >= CoreCosts.size())
+      CoreCosts.resize(A.Core + 1);
+    uint64_t Line = A.Addr & ~(LineBytes - 1);
+    Costs &C = CoreCosts[A.Core];
+    switch (M) {
+    case Mode::MESI:
+      accessInvalidating(A, Line, C, BusForward, LineState::M);
+      break;
+    case Mode::Spandex:
+      accessInvalidating(A, Line, C, L2Forward, LineState::O);
+      break;
+    case Mode::SpandexProducerOwned:
+      accessProducerOwned(A, Line, C);
+      break;
+    case Mode::SpandexConsumerOwned:
+      accessConsumerOwned(A, Line, C);
+      break;
+    }
+  }
+
+  // Costs by core index, up to the last core that accessed memory
+  const std::vector<Costs> &getCosts() const { return CoreCosts; }
+
+private:
+  // MESI and plain Spandex: a store takes the line in Owned, invalidating the
+  // other copies through the bus or the L2; a load misses to the owner and
+  // leaves every copy shared.
+  void accessInvalidating(const Access &A, uint64_t Line, Costs &C,
+                          uint64_t Forward, LineState Owned) {
+    LineState State = States.get(Line, A.Core);
+    if (A.Kind == AccessKind::Store) {
+      if (State == Owned) {
+        C.Store += L1Hit;
+        return;
+      }
+      C.Store += Forward;
+      C.StoreTraffic += 2 * L1ToL2Hops * (HeaderSize + AddressSize) +
+                        L1ToL1Hops * (HeaderSize + AckAddressSize);
+      States.setAll(Line, NumSeen, LineState::S);
+      States.set(Line, A.Core, Owned);
+    } else {
+      // The owner reads its own line as a hit
+      if (State != LineState::I) {
+        C.Load += L1Hit;
+        return;
+      }
+      C.Load += Forward;
+      C.LoadTraffic += 2 * L1ToL2Hops * (HeaderSize + AddressSize) +
+                       L1ToL1Hops * (HeaderSize + AckAddressSize + LineSize);
+      States.setAll(Line, NumSeen, LineState::S);
+    }
+  }
+
+  // The producer owns the buffer, so its stores hit; the consumer loads lines
+  // from it with owner prediction and keeps them valid
+  void accessProducerOwned(const Access &A, uint64_t Line, Costs &C) {
+    if (A.Kind == AccessKind::Store) {
+      C.Store += L1Hit;
+      return;
+    }
+    if (States.get(Line, A.Core) == LineState::V) {
+      C.Load += L1Hit;
+      return;
+    }
+    C.Load += RemoteL1Hit;
+    C.LoadTraffic += L1ToL1Hops * (HeaderSize + AddressSize) +
+                     L1ToL1Hops * (HeaderSize + AckAddressSize + LineSize);
+    States.set(Line, A.Core, LineState::V);
+  }
+
+  // The consumer owns the buffer, so its loads hit; the producer writes
+  // through to it with owner prediction, coalescing writes to recent lines
+  void accessConsumerOwned(const Access &A, uint64_t Line, Costs &C) {
+    if (A.Kind == AccessKind::Load) {
+      C.Load += L1Hit;
+      return;
+    }
+    if (CoalescingBuffer.insert(Line)) {
+      C.Store += L1Hit;
+      C.StoreTraffic += WordSize;
+      return;
+    }
+    C.Store += RemoteL1Hit;
+    C.StoreTraffic += L1ToL1Hops * (HeaderSize + AddressSize) +
+                      L1ToL1Hops * (HeaderSize + AckAddressSize + WordSize);
+  }
+
+  Mode M;
+  std::vector<Costs> CoreCosts;
+  LineStates States;
+  // One buffer for all cores, as in the original model
+  LRUSet CoalescingBuffer;
+  uint32_t NumSeen = 0;
+};
+
+// Costs of each core of T in mode M, by core index
+inline std::vector<Costs> simulate(const Trace &T, Mode M) {
+  Simulator Sim(M);
+  for (const Access &A : T.Accesses)
+    Sim.access(A);
+  std::vector<Costs> Result = Sim.getCosts();
+  Result.resize(T.Cores.size());
+  return Result;
+}
+
+} // namespace spandex_sim
+
+#endif // SPANDEX_SIM_COHERENCE_H
@@ -0,0 +1,444 @@
+//===------------------------------ Timing.h ------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Timing model of the coherence modes of Coherence.h. Each core is in order,
+// with a set-associative private L1 in front of a set-associative L2 shared by
+// all cores, a limited number of MSHRs and, in Spandex_consumer_owned, a
+// write-coalescing buffer whose entries accept stores for a time window.
+//
+// Loads block their core until the data arrives. Stores retire into an MSHR
+// and only stall their core when every MSHR is busy. Each core has its own
+// clock, and cores interact in the order of the trace: the state a request
+// leaves in the caches is visible to the next access of the trace, whatever
+// the clocks of the cores.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef SPANDEX_SIM_TIMING_H
+#define SPANDEX_SIM_TIMING_H
+
+#include "Coherence.h"
+
+#include <algorithm>
+#include <deque>
+
+namespace spandex_sim {
+
+struct CacheConfig {
+  // Bytes
+  uint64_t Size;
+  unsigned Assoc;
+};
+
+struct TimingConfig {
+  CacheConfig L1 = {32 * 1024, 8};
+  CacheConfig L2 = {1024 * 1024, 16};
+  // Outstanding misses and write-throughs of a core
+  unsigned MSHRs = 8;
+  size_t WCBEntries = WriteCoalescingBuffer;
+  // Cycles an entry of the write-coalescing buffer accepts stores
+  uint64_t WCBWindow = 64;
+  // Cycles to fetch a line missing in the L2
+  uint64_t MemoryLatency = 200;
+};
+
+// Cache of lines with LRU replacement in each set. A way in state I is free.
+class SetAssocCache {
+public:
+  struct Way {
+    uint64_t Line;
+    uint64_t LastUse;
+    LineState State;
+  };
+
+  explicit SetAssocCache(const CacheConfig &Config)
+      : Assoc(std::max(1u, Config.Assoc)),
+        NumSets(std::max<uint64_t>(1, Config.Size / (LineBytes * Assoc))),
+        Ways(NumSets * Assoc, Way{0, 0, LineState::I}) {}
+
+  // The way of Line, made the most recently used one, or null
+  Way *find(uint64_t Line) {
+    Way *W = lookup(Line);
+    if (W)
+      W->LastUse = ++Uses;
+    return W;
+  }
+
+  LineState getState(uint64_t Line) {
+    Way *W = lookup(Line);
+    return W ? W->State : LineState::I;
+  }
+
+  void setState(uint64_t Line, LineState State) {
+    if (Way *W = lookup(Line))
+      W->State = State;
+  }
+
+  // Puts Line in a free way of its set, or else in place of the least
+  // recently used one. Returns the way it replaced, in state I if none.
+  Way insert(uint64_t Line, LineState State) {
+    Way *Set = getSet(Line);
+    Way *Victim = Set;
+    for (unsigned I = 0; I < Assoc; ++I) {
+      if (Set[I].State == LineState::I) {
+        Victim = &Set[I];
+        break;
+      }
+      if (Set[I].LastUse < Victim->LastUse)
+        Victim = &Set[I];
+    }
+    Way Evicted = *Victim;
+    *Victim = Way{Line, ++Uses, State};
+    return Evicted;
+  }
+
+private:
+  Way *getSet(uint64_t Line) {
+    return &Ways[(Line / LineBytes) % NumSets * Assoc];
+  }
+
+  Way *lookup(uint64_t Line) {
+    Way *Set = getSet(Line);
+    for (unsigned I = 0; I < Assoc; ++I)
+      if (Set[I].State != LineState::I && Set[I].Line == Line)
+        return &Set[I];
+    return nullptr;
+  }
+
+  unsigned Assoc;
+  uint64_t NumSets;
+  std::vector<Way> Ways;
+  uint64_t Uses = 0;
+};
+
+// What the accesses of one core cost in the timing model
+struct CoreStats {
+  // Clock of the core once its last request completes, the estimated runtime
+  uint64_t Cycles = 0;
+  // Cycles the core waited for the data of loads
+  uint64_t LoadStall = 0;
+  // Cycles the core waited for a free MSHR
+  uint64_t MSHRStall = 0;
+  uint64_t Loads = 0;
+  uint64_t Stores = 0;
+  // Including the write-throughs of Spandex_consumer_owned
+  uint64_t L1Misses = 0;
+  uint64_t L2Misses = 0;
+  // Stores merged into an open entry of the write-coalescing buffer
+  uint64_t Coalesced = 0;
+  // Flits
+  uint64_t Traffic = 0;
+
+  CoreStats &operator+=(const CoreStats &Other) {
+    Cycles = std::max(Cycles, Other.Cycles);
+    LoadStall += Other.LoadStall;
+    MSHRStall += Other.MSHRStall;
+    Loads += Other.Loads;
+    Stores += Other.Stores;
+    L1Misses += Other.L1Misses;
+    L2Misses += Other.L2Misses;
+    Coalesced += Other.Coalesced;
+    Traffic += Other.Traffic;
+    return *this;
+  }
+};
+
+// Replays the accesses of a trace in one mode with the timing model
+class TimingSimulator {
+public:
+  TimingSimulator(Mode M, const TimingConfig &Config)
+      : M(M), Config(Config), L2(Config.L2) {}
+
+  void access(const Access &A) {
+    while (A.Core >= Cores.size())
+      Cores.emplace_back(Config.L1);
+    uint64_t Line = A.Addr & ~(LineBytes - 1);
+    if (A.Kind == AccessKind::Load)
+      load(A.Core, Line);
+    else
+      store(A.Core, Line);
+  }
+
+  // Drains the write-coalescing buffers and MSHRs, and returns the stats of
+  // each core by index
+  std::vector<CoreStats> finish() {
+    std::vector<CoreStats> Result;
+    for (uint32_t Core = 0; Core < Cores.size(); ++Core) {
+      CoreState &C = Cores[Core];
+      while (!C.WCB.empty())
+        flushWCB(Core);
+      uint64_t Done = C.Clock;
+      for (const MSHR &Entry : C.MSHRs)
+        Done = std::max(Done, Entry.Done);
+      C.Stats.Cycles = Done;
+      Result.push_back(C.Stats);
+    }
+    return Result;
+  }
+
+private:
+  struct MSHR {
+    uint64_t Line;
+    uint64_t Done;
+  };
+
+  struct WCBEntry {
+    uint64_t Line;
+    uint64_t Opened;
+    uint64_t Words;
+  };
+
+  struct CoreState {
+    explicit CoreState(const CacheConfig &L1) : L1(L1) {}
+
+    SetAssocCache L1;
+    uint64_t Clock = 0;
+    std::vector<MSHR> MSHRs;
+    // In the order the entries were opened
+    std::deque<WCBEntry> WCB;
+    CoreStats Stats;
+  };
+
+  // Latency and flits of a request, and the state it leaves the line in
+  struct Fill {
+    uint64_t Latency;
+    uint64_t Flits;
+    LineState State;
+  };
+
+  // Cycles of a request the L2 serves or forwards
+  uint64_t getForward() const {
+    return M == Mode::MESI ? BusForward : L2Forward;
+  }
+
+  // Another core holding Line in M or O, or -1
+  int64_t findOwner(uint32_t Core, uint64_t Line) {
+    for (uint32_t Other = 0; Other < Cores.size(); ++Other) {
+      LineState State = Cores[Other].L1.getState(Line);
+      if (Other != Core && (State == LineState::M || State == LineState::O))
+        return Other;
+    }
+    return -1;
+  }
+
+  // Cycles the L2 adds to a request for the data of Line
+  uint64_t accessL2(CoreState &C, uint64_t Line) {
+    if (L2.find(Line))
+      return 0;
+    ++C.Stats.L2Misses;
+    L2.insert(Line, LineState::S);
+    return Config.MemoryLatency;
+  }
+
+  // Request for the data of Line by a load
+  Fill fetchForLoad(uint32_t Core, uint64_t Line) {
+    CoreState &C = Cores[Core];
+    int64_t Owner = findOwner(Core, Line);
+    // Request to the L2, forwarded to the owner, which sends the data
+    const uint64_t Forwarded = 2 * L1ToL2Hops * (HeaderSize + AddressSize) +
+                               L1ToL1Hops *
+                                   (HeaderSize + AckAddressSize + LineSize);
+    // Request to the L2, which sends the data
+    const uint64_t Served = L1ToL2Hops * (HeaderSize + AddressSize) +
+                            L1ToL2Hops *
+                                (HeaderSize + AckAddressSize + LineSize);
+    switch (M) {
+    case Mode::MESI:
+    case Mode::Spandex:
+      if (Owner >= 0) {
+        // The MESI owner writes back and shares the line, the Spandex owner
+        // keeps it
+        if (M == Mode::MESI)
+          Cores[Owner].L1.setState(Line, LineState::S);
+        return {getForward(), Forwarded, LineState::S};
+      }
+      return {getForward() + accessL2(C, Line), Served, LineState::S};
+    case Mode::SpandexProducerOwned:
+      // Owner prediction sends the request straight to the producer
+      if (Owner >= 0)
+        return {RemoteL1Hit,
+                L1ToL1Hops * (HeaderSize + AddressSize) +
+                    L1ToL1Hops * (HeaderSize + AckAddressSize + LineSize),
+                LineState::V};
+      return {L2Forward + accessL2(C, Line), Served, LineState::V};
+    case Mode::SpandexConsumerOwned:
+      // The consumer takes ownership of what it loads
+      if (Owner >= 0) {
+        Cores[Owner].L1.setState(Line, LineState::I);
+        return {L2Forward, Forwarded, LineState::O};
+      }
+      return {L2Forward + accessL2(C, Line), Served, LineState::O};
+    }
+    return {0, 0, LineState::I};
+  }
+
+  // Request for the ownership of Line by a store of MESI, Spandex or
+  // Spandex_producer_owned
+  Fill fetchForStore(uint32_t Core, uint64_t Line) {
+    CoreState &C = Cores[Core];
+    int64_t Owner = findOwner(Core, Line);
+    uint64_t Flits = 2 * L1ToL2Hops * (HeaderSize + AddressSize) +
+                     L1ToL1Hops * (HeaderSize + AckAddressSize);
+    if (M == Mode::SpandexProducerOwned) {
+      // Valid copies of consumers self-invalidate, only the previous owner
+      // gives the line up
+      if (Owner >= 0)
+        Cores[Owner].L1.setState(Line, LineState::I);
+      return {L2Forward, Flits, LineState::O};
+    }
+    // Every other copy is invalidated and acknowledges it
+    for (uint32_t Other = 0; Other < Cores.size(); ++Other) {
+      if (Other == Core || Cores[Other].L1.getState(Line) == LineState::I)
+        continue;
+      Cores[Other].L1.setState(Line, LineState::I);
+      Flits += L1ToL1Hops * (HeaderSize + AddressSize) +
+               L1ToL1Hops * (HeaderSize + AckAddressSize);
+    }
+    LineState Owned = M == Mode::MESI ? LineState::M : LineState::O;
+    if (Owner >= 0)
+      return {getForward(), Flits + LineSize, Owned};
+    if (C.L1.getState(Line) != LineState::I)
+      return {getForward(), Flits, Owned};
+    return {getForward() + accessL2(C, Line), Flits + LineSize, Owned};
+  }
+
+  // Pending MSHR of Line, or null
+  MSHR *findMSHR(CoreState &C, uint64_t Line) {
+    for (MSHR &Entry : C.MSHRs)
+      if (Entry.Line == Line && Entry.Done > C.Clock)
+        return &Entry;
+    return nullptr;
+  }
+
+  // Takes an MSHR for Latency cycles from now, waiting for one to free up if
+  // all are busy. Returns when the request completes.
+  uint64_t allocateMSHR(CoreState &C, uint64_t Line, uint64_t Latency) {
+    auto Completed = [&](const MSHR &Entry) { return Entry.Done <= C.Clock; };
+    C.MSHRs.erase(std::remove_if(C.MSHRs.begin(), C.MSHRs.end(), Completed),
+                  C.MSHRs.end());
+    if (C.MSHRs.size() >= std::max(1u, Config.MSHRs)) {
+      uint64_t Free = C.MSHRs.front().Done;
+      for (const MSHR &Entry : C.MSHRs)
+        Free = std::min(Free, Entry.Done);
+      C.Stats.MSHRStall += Free - C.Clock;
+      C.Clock = Free;
+      C.MSHRs.erase(std::remove_if(C.MSHRs.begin(), C.MSHRs.end(), Completed),
+                    C.MSHRs.end());
+    }
+    C.MSHRs.push_back({Line, C.Clock + Latency});
+    return C.Clock + Latency;
+  }
+
+  // Puts Line in the L1 of C, writing back the line it replaces if it owned it
+  void fillL1(CoreState &C, uint64_t Line, LineState State) {
+    SetAssocCache::Way Evicted = C.L1.insert(Line, State);
+    if (Evicted.State == LineState::M || Evicted.State == LineState::O) {
+      C.Stats.Traffic += L1ToL2Hops * (HeaderSize + AddressSize + LineSize);
+      if (!L2.find(Evicted.Line))
+        L2.insert(Evicted.Line, LineState::S);
+    }
+  }
+
+  void load(uint32_t Core, uint64_t Line) {
+    CoreState &C = Cores[Core];
+    ++C.Stats.Loads;
+    // The line is in the L1 from the time it was requested, but its data is
+    // only there once the request completes
+    if (MSHR *Pending = findMSHR(C, Line)) {
+      C.Stats.LoadStall += Pending->Done - C.Clock;
+      C.Clock = Pending->Done + L1Hit;
+      return;
+    }
+    if (C.L1.find(Line)) {
+      C.Clock += L1Hit;
+      return;
+    }
+    ++C.Stats.L1Misses;
+    Fill F = fetchForLoad(Core, Line);
+    uint64_t Done = allocateMSHR(C, Line, F.Latency);
+    fillL1(C, Line, F.State);
+    C.Stats.Traffic += F.Flits;
+    C.Stats.LoadStall += Done - C.Clock;
+    C.Clock = Done;
+  }
+
+  void store(uint32_t Core, uint64_t Line) {
+    CoreState &C = Cores[Core];
+    ++C.Stats.Stores;
+    LineState State = C.L1.getState(Line);
+    if (State == LineState::M || State == LineState::O) {
+      C.L1.find(Line);
+      C.Clock += L1Hit;
+      return;
+    }
+    if (M == Mode::SpandexConsumerOwned) {
+      storeThrough(Core, Line);
+      return;
+    }
+    // A store to a line already requested merges into its MSHR
+    if (findMSHR(C, Line)) {
+      C.Clock += L1Hit;
+      return;
+    }
+    ++C.Stats.L1Misses;
+    Fill F = fetchForStore(Core, Line);
+    allocateMSHR(C, Line, F.Latency);
+    if (C.L1.find(Line))
+      C.L1.setState(Line, F.State);
+    else
+      fillL1(C, Line, F.State);
+    C.Stats.Traffic += F.Flits;
+    C.Clock += L1Hit;
+  }
+
+  // Store of Spandex_consumer_owned, written through to the owner by the
+  // write-coalescing buffer
+  void storeThrough(uint32_t Core, uint64_t Line) {
+    CoreState &C = Cores[Core];
+    while (!C.WCB.empty() &&
+           C.Clock - C.WCB.front().Opened > Config.WCBWindow)
+      flushWCB(Core);
+    for (WCBEntry &Entry : C.WCB)
+      if (Entry.Line == Line) {
+        ++Entry.Words;
+        ++C.Stats.Coalesced;
+        C.Clock += L1Hit;
+        return;
+      }
+    if (C.WCB.size() >= std::max<size_t>(1, Config.WCBEntries))
+      flushWCB(Core);
+    C.WCB.push_back({Line, C.Clock, 1});
+    C.Clock += L1Hit;
+  }
+
+  // Writes the oldest entry of the write-coalescing buffer of Core through
+  void flushWCB(uint32_t Core) {
+    CoreState &C = Cores[Core];
+    WCBEntry Entry = C.WCB.front();
+    C.WCB.pop_front();
+    ++C.Stats.L1Misses;
+    // Owner prediction sends the words straight to the consumer
+    bool Owned = findOwner(Core, Entry.Line) >= 0;
+    uint64_t Latency = Owned ? RemoteL1Hit : L2Forward;
+    allocateMSHR(C, Entry.Line, Latency);
+    C.Stats.Traffic +=
+        (Owned ? L1ToL1Hops : L1ToL2Hops) *
+        (HeaderSize + AddressSize + Entry.Words * WordSize + HeaderSize +
+         AckAddressSize);
+  }
+
+  Mode M;
+  TimingConfig Config;
+  SetAssocCache L2;
+  std::vector<CoreState> Cores;
+};
+
+} // namespace spandex_sim
+
+#endif // SPANDEX_SIM_TIMING_H
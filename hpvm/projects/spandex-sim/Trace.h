@@ -0,0 +1,268 @@
+//===------------------------------- Trace.h ------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Memory traces replayed by spandex-sim. A trace is a sequence of loads and
+// stores, each by one core to one byte address. Text traces are parsed into
+// memory; binary traces (SupportHPVM/HPVMTrace.h) are decoded one chunk at a
+// time from the mapped file, so they are never held in memory whole.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef SPANDEX_SIM_TRACE_H
+#define SPANDEX_SIM_TRACE_H
+
+#include "SupportHPVM/HPVMTrace.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace spandex_sim {
+
+enum class AccessKind : uint8_t { Load, Store };
+
+struct Access {
+  // Dense index of the core, see CoreMap
+  uint32_t Core;
+  AccessKind Kind;
+  uint64_t Addr;
+};
+
+// Dense indices of the cores of a trace, in order of first appearance. A core
+// is named by its text in a text trace and by its number in decimal in a
+// binary one, so both forms of a trace name their cores the same way.
+class CoreMap {
+public:
+  uint32_t getId(llvm::StringRef Name) {
+    auto Inserted = Ids.try_emplace(Name, Names.size());
+    if (Inserted.second)
+      Names.push_back(Name.str());
+    return Inserted.first->second;
+  }
+
+  uint32_t getId(uint32_t Number) {
+    if (Number < ByNumber.size() && ByNumber[Number])
+      return ByNumber[Number] - 1;
+    uint32_t Id = getId(std::to_string(Number));
+    // Core numbers are small, larger ones only take the slow path
+    if (Number < (1u << 16)) {
+      if (Number >= ByNumber.size())
+        ByNumber.resize(Number + 1, 0);
+      ByNumber[Number] = Id + 1;
+    }
+    return Id;
+  }
+
+  size_t size() const { return Names.size(); }
+  const std::vector<std::string> &getNames() const { return Names; }
+
+private:
+  std::vector<std::string> Names;
+  llvm::StringMap<uint32_t> Ids;
+  // Id plus one of each core number, 0 if not seen yet
+  std::vector<uint32_t> ByNumber;
+};
+
+struct Trace {
+  std::vector<Access> Accesses;
+  CoreMap Cores;
+};
+
+// Appends the accesses of the text trace in Text to T. Only lines of the form
+//   s_ <core> <load|store> <addr> [...]
+// are accesses, where addr is hexadecimal with an optional 0x prefix; any
+// further fields (such as the static access of the profile format) and all
+// other lines are ignored. Returns false and sets Error on a malformed access.
+inline bool parseTextTrace(llvm::StringRef Text, Trace &T, std::string &Error) {
+  size_t LineNo = 0;
+  while (!Text.empty()) {
+    llvm::StringRef Line;
+    std::tie(Line, Text) = Text.split('\n');
+    ++LineNo;
+    if (!Line.startswith("s_"))
+      continue;
+    llvm::SmallVector<llvm::StringRef, 6> Fields;
+    Line.split(Fields, ' ', -1, /*KeepEmpty=*/false);
+    if (Fields.size() < 4) {
+      Error = "line " + std::to_string(LineNo) + ": expected 's_ <core> "
+              "<load|store> <addr>'";
+      return false;
+    }
+    AccessKind Kind;
+    if (Fields[2] == "load")
+      Kind = AccessKind::Load;
+    else if (Fields[2] == "store")
+      Kind = AccessKind::Store;
+    else {
+      Error = "line " + std::to_string(LineNo) + ": unknown access '" +
+              Fields[2].str() + "'";
+      return false;
+    }
+    llvm::StringRef AddrText = Fields[3].trim();
+    AddrText.consume_front("0x") || AddrText.consume_front("0X");
+    uint64_t Addr = 0;
+    if (!AddrText.empty() && AddrText.getAsInteger(16, Addr)) {
+      Error = "line " + std::to_string(LineNo) + ": bad address '" +
+              Fields[3].str() + "'";
+      return false;
+    }
+    T.Accesses.push_back({T.Cores.getId(Fields[1]), Kind, Addr});
+  }
+  return true;
+}
+
+inline bool isBinaryTrace(llvm::StringRef Data) {
+  return Data.startswith(llvm::StringRef(hpvm::trace::FileMagic,
+                                         sizeof(hpvm::trace::FileMagic)));
+}
+
+// Binary trace in a buffer, usually a mapped file
+class BinaryTrace {
+public:
+  // Locates the chunks of the trace in Buffer. Returns false and sets Error if
+  // it is not a binary trace of a known version or its index is corrupt.
+  bool open(std::unique_ptr<llvm::MemoryBuffer> Buffer, std::string &Error) {
+    using namespace hpvm::trace;
+    this->Buffer = std::move(Buffer);
+    const uint8_t *Begin = getBegin();
+    size_t Size = this->Buffer->getBufferSize();
+    if (Size < FileHeaderSize || !isBinaryTrace(this->Buffer->getBuffer())) {
+      Error = "not a binary trace";
+      return false;
+    }
+    if (get32(Begin + 8) != FormatVersion) {
+      Error = "unknown trace version " + std::to_string(get32(Begin + 8));
+      return false;
+    }
+    Chunks.clear();
+    const uint8_t *Footer = Begin + Size - FooterSize;
+    if (Size >= FileHeaderSize + FooterSize &&
+        !memcmp(Footer + 16, FooterMagic, sizeof(FooterMagic))) {
+      uint64_t IndexOffset = get64(Footer);
+      uint64_t NumChunks = get64(Footer + 8);
+      if (IndexOffset > Size - FooterSize ||
+          (Size - FooterSize - IndexOffset) / IndexEntrySize != NumChunks) {
+        Error = "corrupt trace index";
+        return false;
+      }
+      for (uint64_t I = 0; I < NumChunks; ++I) {
+        const uint8_t *Entry = Begin + IndexOffset + I * IndexEntrySize;
+        Chunks.push_back({get64(Entry), get64(Entry + 8)});
+        if (!getChunk(Chunks.back().Offset, IndexOffset)) {
+          Error = "corrupt trace index";
+          return false;
+        }
+      }
+      End = IndexOffset;
+      return true;
+    }
+    // The writer did not finish, keep the chunks that were written whole
+    uint64_t Offset = FileHeaderSize, FirstAccess = 0;
+    while (const uint8_t *Header = getChunk(Offset, Size)) {
+      ChunkHeader H = getChunkHeader(Header);
+      Chunks.push_back({Offset, FirstAccess});
+      Offset += ChunkHeaderSize + H.StoredSize;
+      FirstAccess += H.NumAccesses;
+    }
+    End = Offset;
+    return true;
+  }
+
+  const std::vector<hpvm::trace::IndexEntry> &getChunks() const {
+    return Chunks;
+  }
+
+  // Calls Callback on the records of chunks [First, Last) in order. Returns
+  // false and sets Error on a corrupt chunk.
+  template <class F>
+  bool forEachRecord(size_t First, size_t Last, F Callback,
+                     std::string &Error) const {
+    using namespace hpvm::trace;
+    std::vector<uint8_t> Raw;
+    for (size_t I = First; I < Last; ++I) {
+      const uint8_t *Header = getChunk(Chunks[I].Offset, End);
+      ChunkHeader H = getChunkHeader(Header);
+      const uint8_t *Payload = Header + ChunkHeaderSize;
+      if (H.Codec == CodecLZ) {
+        Raw.resize(H.RawSize);
+        if (!lzDecompress(Payload, H.StoredSize, Raw.data(), H.RawSize)) {
+          Error = "corrupt compressed chunk " + std::to_string(I);
+          return false;
+        }
+        Payload = Raw.data();
+      }
+      if (!decodeChunk(Payload, H.RawSize, H.NumAccesses, Callback)) {
+        Error = "corrupt chunk " + std::to_string(I);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <class F>
+  bool forEachRecord(F Callback, std::string &Error) const {
+    return forEachRecord(0, Chunks.size(), Callback, Error);
+  }
+
+  // Calls Callback on the accesses of chunks [First, Last) in order, with
+  // cores numbered by Cores. Returns false and sets Error on a corrupt chunk.
+  template <class F>
+  bool forEachAccess(size_t First, size_t Last, CoreMap &Cores, F Callback,
+                     std::string &Error) const {
+    using namespace hpvm::trace;
+    auto OnRecord = [&](const Record &R) {
+      Callback(Access{Cores.getId(R.Core),
+                      R.Kind == Store ? AccessKind::Store : AccessKind::Load,
+                      R.Addr});
+    };
+    return forEachRecord(First, Last, OnRecord, Error);
+  }
+
+  template <class F>
+  bool forEachAccess(CoreMap &Cores, F Callback, std::string &Error) const {
+    return forEachAccess(0, Chunks.size(), Cores, Callback, Error);
+  }
+
+private:
+  const uint8_t *getBegin() const {
+    return reinterpret_cast<const uint8_t *>(Buffer->getBufferStart());
+  }
+
+  // Header of the chunk at Offset if the chunk lies whole before Limit and
+  // has a known codec, otherwise null
+  const uint8_t *getChunk(uint64_t Offset, uint64_t Limit) const {
+    using namespace hpvm::trace;
+    if (Offset < FileHeaderSize || Offset > Limit ||
+        Limit - Offset < ChunkHeaderSize)
+      return nullptr;
+    const uint8_t *Header = getBegin() + Offset;
+    ChunkHeader H = getChunkHeader(Header);
+    bool Raw = H.Codec == CodecNone && H.StoredSize == H.RawSize;
+    if ((!Raw && H.Codec != CodecLZ) || H.RawSize > MaxChunkSize ||
+        Limit - Offset - ChunkHeaderSize < H.StoredSize)
+      return nullptr;
+    return Header;
+  }
+
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  std::vector<hpvm::trace::IndexEntry> Chunks;
+  // End of the last chunk
+  uint64_t End = 0;
+};
+
+} // namespace spandex_sim
+
+#endif // SPANDEX_SIM_TRACE_H
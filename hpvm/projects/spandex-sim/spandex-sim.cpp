@@ -0,0 +1,538 @@
+//===--------------------------- spandex-sim.cpp --------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Replays a memory trace of an HPVM program in every coherence mode of
+// Coherence.h and prints the cost of each core as CSV rows of
+//   program,mode,core,store,load,store traffic,load traffic
+// sorted by mode and then by core name. The trace is text or binary, see
+// Trace.h. It is decoded once, and every mode replays it on its own threads:
+// -shards splits the lines of a mode between several threads without changing
+// the result.
+//
+// With -timing, the trace is replayed with the timing model of Timing.h
+// instead, and the rows are
+//   program,mode,core,cycles,load stall,MSHR stall,loads,stores,L1 misses,
+//   L2 misses,coalesced stores,traffic
+// followed for each mode by a row of core (all) whose cycles are those of the
+// slowest core, the estimated runtime of the program. The caches are
+// set-associative (-l1-size, -l1-assoc, -l2-size, -l2-assoc), each core has
+// -mshrs MSHRs, and consumer-owned stores go through a write-coalescing buffer
+// of -wcb-entries lines whose entries stay open for -wcb-window cycles. Cores
+// run in order: loads block, and stores only stall when the MSHRs are full.
+//
+// With -print-accesses, the trace is printed as text instead. The records
+// that -spandex-trace tags with their node instance and access then end in the
+// function of their node (from -trace-nodes) and the index of their access,
+// which is the input of scripts/spandex_profile.py.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Coherence.h"
+#include "Timing.h"
+#include "Trace.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace llvm;
+using namespace spandex_sim;
+
+static cl::opt<std::string> InputFilename(cl::Positional,
+                                          cl::desc("<trace>"),
+                                          cl::init("-"));
+
+static cl::opt<std::string>
+    ProgramName("name",
+                cl::desc("Program name in the first column. The header row is "
+                         "printed only when it is empty."),
+                cl::init(""));
+
+static cl::opt<unsigned>
+    NumShards("shards",
+              cl::desc("Split the lines of each mode between this many "
+                       "threads (0 for one per hardware thread)"),
+              cl::init(1));
+
+static cl::opt<bool>
+    Timing("timing",
+           cl::desc("Estimate the runtime of each mode with set-associative "
+                    "caches, MSHRs and a write-coalescing buffer"),
+           cl::init(false));
+
+static cl::OptionCategory TimingCategory("Timing model options",
+                                         "Used with -timing");
+
+static cl::opt<unsigned> L1Size("l1-size", cl::desc("Bytes of each L1"),
+                                cl::init(TimingConfig().L1.Size),
+                                cl::cat(TimingCategory));
+
+static cl::opt<unsigned> L1Assoc("l1-assoc", cl::desc("Ways of each L1"),
+                                 cl::init(TimingConfig().L1.Assoc),
+                                 cl::cat(TimingCategory));
+
+static cl::opt<unsigned> L2Size("l2-size", cl::desc("Bytes of the L2"),
+                                cl::init(TimingConfig().L2.Size),
+                                cl::cat(TimingCategory));
+
+static cl::opt<unsigned> L2Assoc("l2-assoc", cl::desc("Ways of the L2"),
+                                 cl::init(TimingConfig().L2.Assoc),
+                                 cl::cat(TimingCategory));
+
+static cl::opt<unsigned> MSHRs("mshrs", cl::desc("MSHRs of each core"),
+                               cl::init(TimingConfig().MSHRs),
+                               cl::cat(TimingCategory));
+
+static cl::opt<unsigned>
+    WCBEntries("wcb-entries",
+               cl::desc("Lines in the write-coalescing buffer of each core"),
+               cl::init(TimingConfig().WCBEntries), cl::cat(TimingCategory));
+
+static cl::opt<unsigned>
+    WCBWindow("wcb-window",
+              cl::desc("Cycles an entry of the write-coalescing buffer "
+                       "accepts stores"),
+              cl::init(TimingConfig().WCBWindow), cl::cat(TimingCategory));
+
+static cl::opt<unsigned>
+    MemoryLatency("memory-latency",
+                  cl::desc("Cycles to fetch a line missing in the L2"),
+                  cl::init(TimingConfig().MemoryLatency),
+                  cl::cat(TimingCategory));
+
+static cl::opt<std::string>
+    BinaryOutput("write-binary",
+                 cl::desc("Write the trace in binary form to <file> instead "
+                          "of simulating it"),
+                 cl::value_desc("file"));
+
+static cl::opt<bool>
+    Compress("compress",
+             cl::desc("Compress the chunks written by -write-binary"),
+             cl::init(false));
+
+static cl::opt<bool>
+    PrintAccesses("print-accesses",
+                  cl::desc("Print the accesses of the trace as text lines "
+                           "instead of simulating it"),
+                  cl::init(false));
+
+static cl::opt<std::string>
+    TraceNodes("trace-nodes",
+               cl::desc("With -print-accesses, end the lines of tagged "
+                        "records with the function of their node, read from "
+                        "the JSON written by -spandex-trace-nodes, and the "
+                        "index of their access"),
+               cl::value_desc("file"));
+
+// An access with the number of cores that had accessed memory by then in the
+// whole trace, which a shard cannot count from its own accesses
+struct ShardAccess {
+  Access A;
+  uint32_t NumSeen;
+};
+
+// Batches of accesses from the decoding thread to one replay thread. Only a
+// few batches wait at a time, so a large trace is not decoded far ahead of
+// its slowest replay.
+class AccessQueue {
+public:
+  void push(std::vector<ShardAccess> &&Batch) {
+    std::unique_lock<std::mutex> Guard(Lock);
+    Changed.wait(Guard, [this] { return Batches.size() < MaxBatches; });
+    Batches.push_back(std::move(Batch));
+    Changed.notify_all();
+  }
+
+  // Returns false once the queue is closed and empty
+  bool pop(std::vector<ShardAccess> &Batch) {
+    std::unique_lock<std::mutex> Guard(Lock);
+    Changed.wait(Guard, [this] { return !Batches.empty() || Closed; });
+    if (Batches.empty())
+      return false;
+    Batch = std::move(Batches.front());
+    Batches.pop_front();
+    Changed.notify_all();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Closed = true;
+    Changed.notify_all();
+  }
+
+private:
+  static constexpr size_t MaxBatches = 8;
+  std::mutex Lock;
+  std::condition_variable Changed;
+  std::deque<std::vector<ShardAccess>> Batches;
+  bool Closed = false;
+};
+
+// Replay of the lines of one shard of a mode, on its own thread. With a
+// timing model, TimingSim replays them in place of Sim.
+struct Job {
+  Job(size_t ModeIndex, const TimingConfig *Timing)
+      : ModeIndex(ModeIndex), Sim(AllModes[ModeIndex]) {
+    if (Timing)
+      TimingSim =
+          std::make_unique<TimingSimulator>(AllModes[ModeIndex], *Timing);
+    Thread = std::thread([this] {
+      std::vector<ShardAccess> Batch;
+      while (Queue.pop(Batch))
+        for (const ShardAccess &S : Batch) {
+          if (TimingSim)
+            TimingSim->access(S.A);
+          else
+            Sim.access(S.A, S.NumSeen);
+        }
+      if (TimingSim)
+        Stats = TimingSim->finish();
+    });
+  }
+
+  size_t ModeIndex;
+  Simulator Sim;
+  std::unique_ptr<TimingSimulator> TimingSim;
+  std::vector<CoreStats> Stats;
+  AccessQueue Queue;
+  // Accesses not yet pushed to Queue
+  std::vector<ShardAccess> Pending;
+  std::thread Thread;
+};
+
+// Costs of each mode by core index, or with a timing model its stats
+struct Results {
+  std::vector<std::vector<Costs>> ModeCosts;
+  std::vector<std::vector<CoreStats>> ModeStats;
+};
+
+// Hands each access of a trace, as it is decoded, to the job of its mode and
+// shard. The shards of a mode own the lines getShard maps to them, and a mode
+// that is not shardable has a single job that gets every access. So does
+// every mode of a timing model, whose core clocks span lines.
+class Dispatcher {
+public:
+  Dispatcher(unsigned Shards, const TimingConfig *Timing)
+      : Shards(Timing ? 1 : Shards) {
+    for (size_t I = 0; I < array_lengthof(AllModes); ++I) {
+      FirstJob.push_back(Jobs.size());
+      unsigned ModeShards = isShardable(AllModes[I]) ? this->Shards : 1;
+      for (unsigned Shard = 0; Shard < ModeShards; ++Shard)
+        Jobs.push_back(std::make_unique<Job>(I, Timing));
+    }
+  }
+
+  void access(const Access &A) {
+    NumSeen = std::max<uint32_t>(NumSeen, A.Core + 1);
+    unsigned Shard = getShard(A.Addr, Shards);
+    for (size_t I = 0; I < array_lengthof(AllModes); ++I)
+      add(*Jobs[FirstJob[I] + (isShardable(AllModes[I]) ? Shard : 0)],
+          {A, NumSeen});
+  }
+
+  // Waits for every job and returns the results of each mode by core index.
+  // Shards charge disjoint lines, so their costs add up.
+  Results finish(size_t NumCores) {
+    for (std::unique_ptr<Job> &J : Jobs) {
+      if (!J->Pending.empty())
+        J->Queue.push(std::move(J->Pending));
+      J->Queue.close();
+    }
+    Results R;
+    R.ModeCosts.assign(array_lengthof(AllModes), std::vector<Costs>(NumCores));
+    R.ModeStats.assign(array_lengthof(AllModes),
+                       std::vector<CoreStats>(NumCores));
+    for (std::unique_ptr<Job> &J : Jobs) {
+      J->Thread.join();
+      const std::vector<Costs> &CoreCosts = J->Sim.getCosts();
+      for (size_t Core = 0; Core < CoreCosts.size(); ++Core)
+        R.ModeCosts[J->ModeIndex][Core] += CoreCosts[Core];
+      for (size_t Core = 0; Core < J->Stats.size(); ++Core)
+        R.ModeStats[J->ModeIndex][Core] += J->Stats[Core];
+    }
+    return R;
+  }
+
+private:
+  static constexpr size_t BatchSize = 4096;
+
+  void add(Job &J, const ShardAccess &S) {
+    J.Pending.push_back(S);
+    if (J.Pending.size() < BatchSize)
+      return;
+    J.Queue.push(std::move(J.Pending));
+    J.Pending.clear();
+    J.Pending.reserve(BatchSize);
+  }
+
+  unsigned Shards;
+  std::vector<std::unique_ptr<Job>> Jobs;
+  // Index in Jobs of shard 0 of each mode
+  std::vector<size_t> FirstJob;
+  uint32_t NumSeen = 0;
+};
+
+// Writes Field as a CSV field, quoting it only when it needs to be
+static void writeField(raw_ostream &OS, StringRef Field) {
+  if (Field.find_first_of(",\"\r\n") == StringRef::npos) {
+    OS << Field;
+    return;
+  }
+  OS << '"';
+  for (char C : Field) {
+    if (C == '"')
+      OS << '"';
+    OS << C;
+  }
+  OS << '"';
+}
+
+static bool writeBinary(const Trace &T, StringRef Filename,
+                        std::string &Error) {
+  FILE *File = fopen(Filename.str().c_str(), "wb");
+  if (!File) {
+    Error = "cannot open " + Filename.str();
+    return false;
+  }
+  hpvm::trace::FileWriter Writer(File, Compress);
+  for (const Access &A : T.Accesses) {
+    // Binary traces number their cores, so the names must be numbers
+    uint32_t Number;
+    if (StringRef(T.Cores.getNames()[A.Core]).getAsInteger(10, Number)) {
+      Error = "core '" + T.Cores.getNames()[A.Core] + "' is not a number";
+      fclose(File);
+      return false;
+    }
+    Writer.add(Number,
+               A.Kind == AccessKind::Store ? hpvm::trace::Store
+                                           : hpvm::trace::Load,
+               A.Addr);
+  }
+  bool Written = Writer.finish();
+  if (fclose(File) || !Written) {
+    Error = "cannot write " + Filename.str();
+    return false;
+  }
+  return true;
+}
+
+// Reads the function of each node ID from {"nodes": ["f", ...]}
+static bool readTraceNodes(StringRef Filename, std::vector<std::string> &Nodes,
+                           std::string &Error) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      MemoryBuffer::getFile(Filename);
+  if (!Buffer) {
+    Error = Filename.str() + ": " + Buffer.getError().message();
+    return false;
+  }
+  Expected<json::Value> Value = json::parse((*Buffer)->getBuffer());
+  if (!Value) {
+    Error = Filename.str() + ": " + toString(Value.takeError());
+    return false;
+  }
+  const json::Object *Root = Value->getAsObject();
+  const json::Array *Array = Root ? Root->getArray("nodes") : nullptr;
+  if (!Array) {
+    Error = Filename.str() + ": expected {\"nodes\": [...]}";
+    return false;
+  }
+  for (const json::Value &Node : *Array) {
+    auto Function = Node.getAsString();
+    if (!Function) {
+      Error = Filename.str() + ": node " + std::to_string(Nodes.size()) +
+              " is not a function name";
+      return false;
+    }
+    Nodes.push_back(Function->str());
+  }
+  return true;
+}
+
+// Prints an access as a line of a text trace
+static void printAccess(raw_ostream &OS, StringRef Core, AccessKind Kind,
+                        uint64_t Addr) {
+  OS << "s_ " << Core << (Kind == AccessKind::Store ? " store 0x" : " load 0x");
+  OS.write_hex(Addr);
+}
+
+// Prints the records of a binary trace as the lines
+//   s_ <node> <load|store> <addr> <function> <index>
+// of the profile format, or without the last two fields for untagged records
+// or when there are no Nodes
+static bool printRecords(const BinaryTrace &B,
+                         const std::vector<std::string> &Nodes,
+                         std::string &Error) {
+  raw_ostream &OS = outs();
+  uint32_t UnknownNode = 0;
+  bool Unknown = false;
+  bool Decoded = B.forEachRecord(
+      [&](const hpvm::trace::Record &R) {
+        printAccess(OS, std::to_string(R.Core),
+                    R.Kind == hpvm::trace::Store ? AccessKind::Store
+                                                 : AccessKind::Load,
+                    R.Addr);
+        if (R.Tagged && !Nodes.empty()) {
+          if (R.Core < Nodes.size()) {
+            OS << ' ' << Nodes[R.Core] << ' ' << R.Instruction;
+          } else if (!Unknown) {
+            Unknown = true;
+            UnknownNode = R.Core;
+          }
+        }
+        OS << '\n';
+      },
+      Error);
+  if (Decoded && Unknown)
+    Error = "node " + std::to_string(UnknownNode) + " is not in " + TraceNodes;
+  return Decoded && !Unknown;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Spandex coherence simulator\n");
+
+  // Without a null terminator, large files are mapped rather than read
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFileOrSTDIN(
+      InputFilename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    errs() << argv[0] << ": " << InputFilename << ": "
+           << Buffer.getError().message() << "\n";
+    return 1;
+  }
+
+  unsigned Shards = NumShards;
+  if (Shards == 0)
+    Shards = std::max(1u, std::thread::hardware_concurrency());
+  TimingConfig Config;
+  Config.L1 = {L1Size, L1Assoc};
+  Config.L2 = {L2Size, L2Assoc};
+  Config.MSHRs = MSHRs;
+  Config.WCBEntries = WCBEntries;
+  Config.WCBWindow = WCBWindow;
+  Config.MemoryLatency = MemoryLatency;
+  const TimingConfig *TimingModel = Timing ? &Config : nullptr;
+  Results R;
+  std::vector<std::string> CoreNames;
+  std::string Error;
+  std::vector<std::string> Nodes;
+  if (!TraceNodes.empty() && !readTraceNodes(TraceNodes, Nodes, Error)) {
+    errs() << argv[0] << ": " << Error << "\n";
+    return 1;
+  }
+  if (isBinaryTrace((*Buffer)->getBuffer())) {
+    if (!BinaryOutput.empty()) {
+      errs() << argv[0] << ": " << InputFilename << ": already binary\n";
+      return 1;
+    }
+    BinaryTrace B;
+    if (!B.open(std::move(*Buffer), Error)) {
+      errs() << argv[0] << ": " << InputFilename << ": " << Error << "\n";
+      return 1;
+    }
+    if (PrintAccesses) {
+      if (!printRecords(B, Nodes, Error)) {
+        errs() << argv[0] << ": " << InputFilename << ": " << Error << "\n";
+        return 1;
+      }
+      return 0;
+    }
+    CoreMap Cores;
+    Dispatcher D(Shards, TimingModel);
+    bool Decoded =
+        B.forEachAccess(Cores, [&](const Access &A) { D.access(A); }, Error);
+    R = D.finish(Cores.size());
+    if (!Decoded) {
+      errs() << argv[0] << ": " << InputFilename << ": " << Error << "\n";
+      return 1;
+    }
+    CoreNames = Cores.getNames();
+  } else {
+    Trace T;
+    if (!parseTextTrace((*Buffer)->getBuffer(), T, Error)) {
+      errs() << argv[0] << ": " << InputFilename << ": " << Error << "\n";
+      return 1;
+    }
+    if (!BinaryOutput.empty()) {
+      if (!writeBinary(T, BinaryOutput, Error)) {
+        errs() << argv[0] << ": " << Error << "\n";
+        return 1;
+      }
+      return 0;
+    }
+    if (PrintAccesses) {
+      for (const Access &A : T.Accesses) {
+        printAccess(outs(), T.Cores.getNames()[A.Core], A.Kind, A.Addr);
+        outs() << '\n';
+      }
+      return 0;
+    }
+    Dispatcher D(Shards, TimingModel);
+    for (const Access &A : T.Accesses)
+      D.access(A);
+    R = D.finish(T.Cores.size());
+    CoreNames = T.Cores.getNames();
+  }
+
+  std::vector<uint32_t> Cores(CoreNames.size());
+  for (uint32_t Core = 0; Core < Cores.size(); ++Core)
+    Cores[Core] = Core;
+  std::sort(Cores.begin(), Cores.end(), [&](uint32_t A, uint32_t B) {
+    return CoreNames[A] < CoreNames[B];
+  });
+
+  // Rows end in CRLF, as RFC 4180 has them
+  raw_ostream &OS = outs();
+  if (Timing) {
+    if (ProgramName.empty())
+      OS << "program,mode,core,cycles,load_stall,mshr_stall,loads,stores,"
+            "l1_misses,l2_misses,coalesced,traffic\r\n";
+    auto WriteRow = [&](Mode M, StringRef Core, const CoreStats &S) {
+      writeField(OS, ProgramName);
+      OS << ',' << getModeName(M) << ',';
+      writeField(OS, Core);
+      OS << ',' << S.Cycles << ',' << S.LoadStall << ',' << S.MSHRStall << ','
+         << S.Loads << ',' << S.Stores << ',' << S.L1Misses << ','
+         << S.L2Misses << ',' << S.Coalesced << ',' << S.Traffic << "\r\n";
+    };
+    for (size_t I = 0; I < array_lengthof(AllModes); ++I) {
+      CoreStats Total;
+      for (uint32_t Core : Cores) {
+        WriteRow(AllModes[I], CoreNames[Core], R.ModeStats[I][Core]);
+        Total += R.ModeStats[I][Core];
+      }
+      WriteRow(AllModes[I], "(all)", Total);
+    }
+    return 0;
+  }
+
+  if (ProgramName.empty())
+    OS << "program,mode,core,store,load,traffic,(header)\r\n";
+  for (size_t I = 0; I < array_lengthof(AllModes); ++I) {
+    for (uint32_t Core : Cores) {
+      const Costs &C = R.ModeCosts[I][Core];
+      writeField(OS, ProgramName);
+      OS << ',' << getModeName(AllModes[I]) << ',';
+      writeField(OS, CoreNames[Core]);
+      OS << ',' << C.Store << ',' << C.Load << ',' << C.StoreTraffic << ','
+         << C.LoadTraffic << "\r\n";
+    }
+  }
+  return 0;
+}
@@ -29,9 +29,9 @@ wait
 # for test_name in ${test_names}
 # do
 # 	TIMEFORMAT="process ${test_name} %R"
-# 	time pypy "${proj_root}/scripts/data_processing.py" \
+# 	time "${LLVM_BUILD_DIR}/bin/spandex-sim" \
 # 		 --name "${test_name}" \
-# 		 < "${test_root}/${test_name}/output" \
+# 		 "${test_root}/${test_name}/output" \
 # 		 > "${test_root}/${test_name}/results.csv" \
 # 		&
 # done
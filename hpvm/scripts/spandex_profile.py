@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+'''Builds a Spandex profile (-spandex-profile) from a memory trace.
+
+Reads trace lines `s_ <core> <load|store> <addr> <function> <index>` from
+stdin, where <function> and <index> identify the static access as in the
+hint table of the Spandex pass. Lines without them are skipped.
+
+spandex-sim prints the binary trace of a program instrumented by
+-spandex-trace in this form, from the node functions of -spandex-trace-nodes:
+
+    spandex-sim -print-accesses -trace-nodes=nodes.json trace.bin \
+        | spandex_profile.py > profile.json
+'''
+import sys
+import json
+import click
+from collections import defaultdict
+
+
+def median(values):
+    values = sorted(values)
+    return values[len(values) // 2] if values else None
+
+
+def profile(accesses, word_size):
+    # Per core: number of accesses so far, and when it last touched each word
+    clock = defaultdict(int)
+    last_touch = defaultdict(dict)
+    last_writer = {}
+    sharers = defaultdict(set)
+
+    counts = defaultdict(int)
+    reuse_distances = defaultdict(list)
+    remote = defaultdict(int)
+    words = defaultdict(set)
+    for core, access, addr, key in accesses:
+        word = addr & ~(word_size - 1)
+        counts[key] += 1
+        words[key].add(word)
+        sharers[word].add(core)
+        if word in last_touch[core]:
+            reuse_distances[key].append(clock[core] - last_touch[core][word])
+        if last_writer.get(word, core) != core:
+            remote[key] += 1
+        if access != 'load':
+            last_writer[word] = core
+        last_touch[core][word] = clock[core]
+        clock[core] += 1
+
+    return [
+        {
+            'function': function,
+            'index': index,
+            'count': counts[function, index],
+            'reuse_distance': median(reuse_distances[function, index]),
+            'sharers': len(set().union(*(sharers[word] for word in words[function, index]))),
+            'remote': remote[function, index] / counts[function, index],
+        }
+        for function, index in sorted(counts)
+    ]
+
+
+@click.command()
+@click.option('--word-size', default=8, help='Size of a word in bytes')
+def main(word_size):
+    accesses = [
+        (core, access, int(addr, 16), (function, int(index)))
+        for _, core, access, addr, function, index in (
+                line.split()
+                for line in sys.stdin
+                if line.startswith('s_') and len(line.split()) == 6
+        )
+    ]
+    json.dump({'profile': profile(accesses, word_size)}, sys.stdout, indent=2)
+    sys.stdout.write('\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Generate a synthetic HPVM program to time the Spandex pass on.
+
+The program has a single internal node holding NODES replicated leaves, which
+share BUFFERS buffers round-robin. SHAPE selects how the leaves are connected:
+
+  chain    leaf k feeds leaf k+1
+  fanout   leaf 0 feeds every other leaf
+  diamond  WIDTH leaves per layer, each fed by two leaves of the layer before
+"""
+
+import argparse
+import sys
+
+
+def edges(shape, nodes, width):
+    """Yield (src, dst, dst_input) edges, dst_input being inSize or dep."""
+    if shape == "chain":
+        for k in range(1, nodes):
+            yield k - 1, k, "inSize"
+    elif shape == "fanout":
+        for k in range(1, nodes):
+            yield 0, k, "inSize"
+    elif shape == "diamond":
+        for k in range(width, nodes):
+            layer, j = divmod(k, width)
+            prev = (layer - 1) * width
+            yield prev + j, k, "inSize"
+            if width > 1:
+                yield prev + (j + 1) % width, k, "dep"
+    else:
+        raise ValueError("unknown shape " + shape)
+
+
+def generate(shape, nodes, width, buffers, out):
+    w = out.write
+    w("// Generated by gen_dfg.py --shape {} --nodes {} --width {} "
+      "--buffers {}\n".format(shape, nodes, width, buffers))
+    w("#include <stdlib.h>\n#include <hpvm.h>\n\n")
+
+    for k in range(nodes):
+        w("void leaf_{k}(long* in, size_t inSize, long* out, size_t outSize, "
+          "size_t dep) {{\n".format(k=k))
+        w("\t__hpvm__hint(hpvm::CPU_TARGET);\n")
+        w("\t__hpvm__attributes(1, in, 1, out);\n")
+        w("\tlong i = __hpvm__getNodeInstanceID_x(__hpvm__getNode());\n")
+        w("\tout[i] = in[i] + {};\n".format(k))
+        w("\t__hpvm__return(1, outSize);\n}\n\n")
+
+    # Leaf k reads buffer k and writes buffer k+1, modulo the buffer count
+    params = ", ".join("long* b{0}, size_t b{0}Size".format(b)
+                       for b in range(buffers))
+    w("void root({}, size_t length) {{\n".format(params))
+    w("\t__hpvm__hint(hpvm::CPU_TARGET);\n")
+    bufs = ", ".join("b{}".format(b) for b in range(buffers))
+    w("\t__hpvm__attributes({n}, {b}, {n}, {b});\n".format(n=buffers, b=bufs))
+    for k in range(nodes):
+        w("\tvoid* n{k} = __hpvm__createNodeND(1, leaf_{k}, length);\n"
+          .format(k=k))
+
+    fed = {}
+    for src, dst, port in edges(shape, nodes, width):
+        fed.setdefault(dst, set()).add(port)
+        w("\t__hpvm__edge(n{}, n{}, HPVM_ONE_TO_ONE, 0, {}, "
+          "HPVM_NONSTREAMING);\n".format(src, dst, 1 if port == "inSize" else 4))
+
+    for k in range(nodes):
+        src, dst = k % buffers, (k + 1) % buffers
+        w("\t__hpvm__bindIn(n{}, {}, 0, HPVM_NONSTREAMING);\n"
+          .format(k, 2 * src))
+        if "inSize" not in fed.get(k, ()):
+            w("\t__hpvm__bindIn(n{}, {}, 1, HPVM_NONSTREAMING);\n"
+              .format(k, 2 * src + 1))
+        w("\t__hpvm__bindIn(n{}, {}, 2, HPVM_NONSTREAMING);\n"
+          .format(k, 2 * dst))
+        w("\t__hpvm__bindIn(n{}, {}, 3, HPVM_NONSTREAMING);\n"
+          .format(k, 2 * dst + 1))
+        if "dep" not in fed.get(k, ()):
+            w("\t__hpvm__bindIn(n{}, {}, 4, HPVM_NONSTREAMING);\n"
+              .format(k, 2 * buffers))
+    w("\t__hpvm__bindOut(n{}, 0, 0, HPVM_NONSTREAMING);\n}}\n\n"
+      .format(nodes - 1))
+
+    w("struct __attribute__((__packed__)) InStruct {\n")
+    for b in range(buffers):
+        w("\tlong* b{0}; size_t b{0}Size;\n".format(b))
+    w("\tsize_t length;\n\tsize_t outSize;\n};\n\n")
+
+    w("int main(int argc, char *argv[]) {\n")
+    w("\t__hpvm__init();\n\n")
+    w("\tconst size_t length = 1024;\n")
+    w("\tstruct InStruct args;\n")
+    for b in range(buffers):
+        w("\targs.b{0} = (long*) calloc(length, sizeof(long));\n".format(b))
+        w("\targs.b{0}Size = length * sizeof(long);\n".format(b))
+        w("\tllvm_hpvm_track_mem(args.b{0}, args.b{0}Size);\n".format(b))
+    w("\targs.length = length;\n\n")
+    w("\tvoid *root_n = __hpvm__launch(HPVM_NONSTREAMING, root, "
+      "reinterpret_cast<void*>(&args));\n")
+    w("\t__hpvm__wait(root_n);\n\n")
+    for b in range(buffers):
+        w("\tllvm_hpvm_untrack_mem(args.b{0});\n".format(b))
+        w("\tfree(args.b{0});\n".format(b))
+    w("\n\t__hpvm__cleanup();\n\treturn 0;\n}\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+            formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--shape", default="chain",
+                        choices=["chain", "fanout", "diamond"])
+    parser.add_argument("--nodes", type=int, default=64)
+    parser.add_argument("--width", type=int, default=8)
+    parser.add_argument("--buffers", type=int, default=4)
+    parser.add_argument("-o", "--output", default="-")
+    args = parser.parse_args()
+    if args.nodes < 1 or args.width < 1 or args.buffers < 1:
+        parser.error("--nodes, --width and --buffers must be positive")
+
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    with out:
+        generate(args.shape, args.nodes, args.width, args.buffers, out)
+
+
+if __name__ == "__main__":
+    main()
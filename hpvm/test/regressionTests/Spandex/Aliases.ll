@@ -0,0 +1,147 @@
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -S < %s | FileCheck %s
+; ModuleID = 'Aliases.ll'
+source_filename = "Aliases.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.Root = type { i64*, i64*, i64* }
+%struct.out.Producer = type <{ i64 }>
+%struct.out.Consumer = type <{ i64 }>
+%emptyStruct = type <{}>
+
+; Root binds each of its buffers to two pointer arguments of Consumer, which
+; reads the first word through one and the second word through the other, on
+; the GPU:
+; - A to %X and %Y, which may alias, so they are joined into one class. The
+;   load through %X shares its block conflicts with the one through %Y, and asks
+;   for both words.
+; - B to %N1 and %N2, which are noalias, so they stay apart.
+; - C to %R1 and %R2, which Consumer only reads, so they stay apart.
+; Only the load through %X has the word of another argument in its mask.
+
+; CHECK-LABEL: define dso_local %struct.out.Consumer @Consumer(
+; CHECK: %x = load i64, i64* %X, align 8, !spandex.req [[V:![0-9]+]], !spandex.mask [[THREE:![0-9]+]], !spandex.id !{{[0-9]+}}
+; CHECK: %y = load i64, i64* %Y.1, align 8, !spandex.req [[V]], !spandex.mask [[TWO:![0-9]+]], !spandex.id !{{[0-9]+}}
+; CHECK: %n1 = load i64, i64* %N1, align 8, !spandex.req [[V]], !spandex.mask [[ONE:![0-9]+]], !spandex.id !{{[0-9]+}}
+; CHECK: %n2 = load i64, i64* %N2.1, align 8, !spandex.req [[V]], !spandex.mask [[TWO]], !spandex.id !{{[0-9]+}}
+; CHECK: %r1 = load i64, i64* %R1, align 8, !spandex.req [[V]], !spandex.mask [[ONE]], !spandex.id !{{[0-9]+}}
+; CHECK: %r2 = load i64, i64* %R2.1, align 8, !spandex.req [[V]], !spandex.mask [[TWO]], !spandex.id !{{[0-9]+}}
+; CHECK-DAG: [[V]] = !{!"V"}
+; CHECK-DAG: [[ONE]] = !{i64 1}
+; CHECK-DAG: [[TWO]] = !{i64 2}
+; CHECK-DAG: [[THREE]] = !{i64 3}
+
+; Function Attrs: nounwind uwtable
+define dso_local i32 @main() local_unnamed_addr #0 {
+entry:
+  %A = alloca [2 x i64], align 8
+  %B = alloca [2 x i64], align 8
+  %C = alloca [2 x i64], align 8
+  %RootArgs = alloca %struct.Root, align 8
+  %A.0 = getelementptr inbounds [2 x i64], [2 x i64]* %A, i64 0, i64 0
+  %B.0 = getelementptr inbounds [2 x i64], [2 x i64]* %B, i64 0, i64 0
+  %C.0 = getelementptr inbounds [2 x i64], [2 x i64]* %C, i64 0, i64 0
+  %inputA = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 0
+  store i64* %A.0, i64** %inputA, align 8
+  %inputB = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 1
+  store i64* %B.0, i64** %inputB, align 8
+  %inputC = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 2
+  store i64* %C.0, i64** %inputC, align 8
+  call void @llvm.hpvm.init()
+  %0 = bitcast %struct.Root* %RootArgs to i8*
+  %graphID = call i8* @llvm.hpvm.launch(i8* bitcast (%emptyStruct (i64*, i64*, i64*)* @Root to i8*), i8* %0, i1 false)
+  call void @llvm.hpvm.wait(i8* %graphID)
+  call void @llvm.hpvm.cleanup()
+  ret i32 0
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Producer @Producer(i64* out %A, i64* out %B, i64* out %C) #0 {
+entry:
+  store i64 1, i64* %A, align 8
+  %A.1 = getelementptr inbounds i64, i64* %A, i64 1
+  store i64 2, i64* %A.1, align 8
+  store i64 3, i64* %B, align 8
+  %B.1 = getelementptr inbounds i64, i64* %B, i64 1
+  store i64 4, i64* %B.1, align 8
+  store i64 5, i64* %C, align 8
+  %C.1 = getelementptr inbounds i64, i64* %C, i64 1
+  store i64 6, i64* %C.1, align 8
+  %returnStruct = insertvalue %struct.out.Producer undef, i64 0, 0
+  ret %struct.out.Producer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Consumer @Consumer(i64* in out %X, i64* in out %Y, i64* noalias in out %N1, i64* noalias in out %N2, i64* in %R1, i64* in %R2, i64 %n) #0 {
+entry:
+  %x = load i64, i64* %X, align 8
+  %Y.1 = getelementptr inbounds i64, i64* %Y, i64 1
+  %y = load i64, i64* %Y.1, align 8
+  %n1 = load i64, i64* %N1, align 8
+  %N2.1 = getelementptr inbounds i64, i64* %N2, i64 1
+  %n2 = load i64, i64* %N2.1, align 8
+  %r1 = load i64, i64* %R1, align 8
+  %R2.1 = getelementptr inbounds i64, i64* %R2, i64 1
+  %r2 = load i64, i64* %R2.1, align 8
+  %xy = add i64 %x, %y
+  %n12 = add i64 %n1, %n2
+  %r12 = add i64 %r1, %r2
+  %xyn = add i64 %xy, %n12
+  %result = add i64 %xyn, %r12
+  %returnStruct = insertvalue %struct.out.Consumer undef, i64 %result, 0
+  ret %struct.out.Consumer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %emptyStruct @Root(i64* %A, i64* %B, i64* %C) #0 {
+entry:
+  %Producer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Producer (i64*, i64*, i64*)* @Producer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 0, i32 0, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 1, i32 1, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 2, i32 2, i1 false)
+  %Consumer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Consumer (i64*, i64*, i64*, i64*, i64*, i64*, i64)* @Consumer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 0, i32 0, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 0, i32 1, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 1, i32 2, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 1, i32 3, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 2, i32 4, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 2, i32 5, i1 false)
+  %edge = call i8* @llvm.hpvm.createEdge(i8* %Producer.node, i8* %Consumer.node, i1 true, i32 0, i32 6, i1 false)
+  ret %emptyStruct undef
+}
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createNode(i8*) #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createEdge(i8*, i8*, i1, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.bind.input(i8*, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.init() #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.launch(i8*, i8*, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.wait(i8*) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.cleanup() #1
+
+attributes #0 = { nounwind uwtable }
+attributes #1 = { nounwind }
+
+!hpvm_hint_cpu = !{!0, !1}
+!hpvm_hint_gpu = !{!2}
+!hpvm_hint_spir = !{}
+!hpvm_hint_cudnn = !{}
+!hpvm_hint_promise = !{}
+!hpvm_hint_cpu_gpu = !{}
+!hpvm_hint_cpu_spir = !{}
+
+!0 = !{%struct.out.Producer (i64*, i64*, i64*)* @Producer}
+!1 = !{%emptyStruct (i64*, i64*, i64*)* @Root}
+!2 = !{%struct.out.Consumer (i64*, i64*, i64*, i64*, i64*, i64*, i64)* @Consumer}
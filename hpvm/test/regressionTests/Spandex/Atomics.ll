@@ -0,0 +1,111 @@
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -disable-output < %s | FileCheck %s
+; ModuleID = 'Atomics.ll'
+source_filename = "Atomics.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.Root = type { i64*, i64 }
+%struct.out.Producer = type <{ i64 }>
+%struct.out.Consumer = type <{ i64 }>
+%emptyStruct = type <{}>
+
+; Like ProducerConsumer.ll, with an atomic add and a compare-and-swap in place
+; of the stores, and an HPVM atomic add on a third word. The intrinsic is only
+; lowered to atomicrmw by the backends, so the pass sees the call. Atomics read
+; their word as well, so they get the data along with the write-through.
+
+; CHECK: %0 = atomicrmw add i64* %A, i64 1 seq_cst{{ *}}WTfwd_data[00000001] for (i64* %A)[0*512 + 0]
+; CHECK-NEXT: %1 = cmpxchg i64* %arrayidx1, i64 0, i64 2 seq_cst seq_cst{{ *}}WTfwd_data[00000010] for (i64* %A)[0*512 + 64]
+; CHECK-NEXT: %2 = call i32 @llvm.hpvm.atomic.add(i8* %A2, i32 3){{ *}}WTfwd_data[00000100] for (i64* %A)[0*512 + 128]
+; CHECK-NEXT: %0 = load i64, i64* %arrayidx1, align 8{{ +}}V{{ +}}[00000010] for (i64* %A)[0*512 + 64]
+
+; Function Attrs: nounwind uwtable
+define dso_local i32 @main() local_unnamed_addr #0 {
+entry:
+  %A = alloca [3 x i64], align 8
+  %RootArgs = alloca %struct.Root, align 8
+  %A.0 = getelementptr inbounds [3 x i64], [3 x i64]* %A, i64 0, i64 0
+  %input = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 0
+  store i64* %A.0, i64** %input, align 8
+  %Asize = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 1
+  store i64 24, i64* %Asize, align 8
+  call void @llvm.hpvm.init()
+  %0 = bitcast %struct.Root* %RootArgs to i8*
+  %graphID = call i8* @llvm.hpvm.launch(i8* bitcast (%emptyStruct (i64*, i64)* @Root to i8*), i8* %0, i1 false)
+  call void @llvm.hpvm.wait(i8* %graphID)
+  call void @llvm.hpvm.cleanup()
+  ret i32 0
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Producer @Producer(i64* out %A, i64 %Asize) #0 {
+entry:
+  %0 = atomicrmw add i64* %A, i64 1 seq_cst
+  %arrayidx1 = getelementptr inbounds i64, i64* %A, i64 1
+  %1 = cmpxchg i64* %arrayidx1, i64 0, i64 2 seq_cst seq_cst
+  %arrayidx2 = getelementptr inbounds i64, i64* %A, i64 2
+  %A2 = bitcast i64* %arrayidx2 to i8*
+  %2 = call i32 @llvm.hpvm.atomic.add(i8* %A2, i32 3)
+  %returnStruct = insertvalue %struct.out.Producer undef, i64 %Asize, 0
+  ret %struct.out.Producer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Consumer @Consumer(i64* in %A, i64 %Asize) #0 {
+entry:
+  %arrayidx1 = getelementptr inbounds i64, i64* %A, i64 1
+  %0 = load i64, i64* %arrayidx1, align 8
+  %returnStruct = insertvalue %struct.out.Consumer undef, i64 %0, 0
+  ret %struct.out.Consumer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %emptyStruct @Root(i64* %A, i64 %Asize) #0 {
+entry:
+  %Producer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Producer (i64*, i64)* @Producer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 0, i32 0, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 1, i32 1, i1 false)
+  %Consumer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Consumer (i64*, i64)* @Consumer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 0, i32 0, i1 false)
+  %edge = call i8* @llvm.hpvm.createEdge(i8* %Producer.node, i8* %Consumer.node, i1 true, i32 0, i32 1, i1 false)
+  ret %emptyStruct undef
+}
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createNode(i8*) #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createEdge(i8*, i8*, i1, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.bind.input(i8*, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare i32 @llvm.hpvm.atomic.add(i8*, i32) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.init() #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.launch(i8*, i8*, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.wait(i8*) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.cleanup() #1
+
+attributes #0 = { nounwind uwtable }
+attributes #1 = { nounwind }
+
+!hpvm_hint_cpu = !{!0, !1}
+!hpvm_hint_gpu = !{!2}
+!hpvm_hint_spir = !{}
+!hpvm_hint_cudnn = !{}
+!hpvm_hint_promise = !{}
+!hpvm_hint_cpu_gpu = !{}
+!hpvm_hint_cpu_spir = !{}
+
+!0 = !{%struct.out.Producer (i64*, i64)* @Producer}
+!1 = !{%emptyStruct (i64*, i64)* @Root}
+!2 = !{%struct.out.Consumer (i64*, i64)* @Consumer}
@@ -0,0 +1,167 @@
+; RUN: rm -rf %t.dir
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-cache-dir=%t.dir -S < %s | FileCheck %s
+; RUN: sed -i -e 's/"req":"WTfwd"/"req":"WTo"/g' -e 's/"req":"V"/"req":"Vo"/g' %t.dir/*.json
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-cache-dir=%t.dir -S < %s | FileCheck --check-prefix=CACHED %s
+; RUN: sed -e 's/@Consumer2(\(.*\)) #0/@Consumer2(\1) #2/' %s > %t.ll
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-cache-dir=%t.dir -S < %t.ll | FileCheck --check-prefix=EDITED %s
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-cache-dir=%t.dir -spandex-sparse-density=0.5 -S < %s | FileCheck %s
+; ModuleID = 'CacheDir.ll'
+source_filename = "CacheDir.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.Root = type { i64*, i64*, i64 }
+%struct.out.Producer = type <{ i64 }>
+%struct.out.Consumer = type <{ i64 }>
+%struct.out.Consumer2 = type <{ i64 }>
+%emptyStruct = type <{}>
+
+; Producer writes A for Consumer and B for Consumer2, both on the GPU. The
+; first run decides every port and fills the cache.
+
+; CHECK-LABEL: define dso_local %struct.out.Consumer2 @Consumer2(
+; CHECK: %0 = load i64, i64* %B, align 8, !spandex.req [[V:![0-9]+]], !spandex.mask [[ONE:![0-9]+]]
+; CHECK-LABEL: define dso_local %struct.out.Producer @Producer(
+; CHECK: store i64 1, i64* %A, align 8, !spandex.req [[WTFWD:![0-9]+]], !spandex.mask [[ONE]]
+; CHECK: store i64 2, i64* %B, align 8, !spandex.req [[WTFWD]], !spandex.mask [[ONE]]
+; CHECK-LABEL: define dso_local %struct.out.Consumer @Consumer(
+; CHECK: %0 = load i64, i64* %A, align 8, !spandex.req [[V]], !spandex.mask [[ONE]]
+; CHECK-DAG: [[V]] = !{!"V"}
+; CHECK-DAG: [[WTFWD]] = !{!"WTfwd"}
+; CHECK-DAG: [[ONE]] = !{i64 1}
+
+; Decisions edited in the cache show up in the next run on the same module, so
+; it did not decide them again.
+
+; CACHED-LABEL: define dso_local %struct.out.Consumer2 @Consumer2(
+; CACHED: %0 = load i64, i64* %B, align 8, !spandex.req [[VO:![0-9]+]], !spandex.mask [[ONE:![0-9]+]]
+; CACHED-LABEL: define dso_local %struct.out.Producer @Producer(
+; CACHED: store i64 1, i64* %A, align 8, !spandex.req [[WTO:![0-9]+]], !spandex.mask [[ONE]]
+; CACHED: store i64 2, i64* %B, align 8, !spandex.req [[WTO]], !spandex.mask [[ONE]]
+; CACHED-LABEL: define dso_local %struct.out.Consumer @Consumer(
+; CACHED: %0 = load i64, i64* %A, align 8, !spandex.req [[VO]], !spandex.mask [[ONE]]
+; CACHED-DAG: [[VO]] = !{!"Vo"}
+; CACHED-DAG: [[WTO]] = !{!"WTo"}
+; CACHED-DAG: [[ONE]] = !{i64 1}
+
+; Giving Consumer2 attributes of its own moves the attribute group of every
+; other function from #0 to #1, as Consumer2 comes first. Keys do not depend on
+; these numbers, so the ports of A still hit, and only the ports of B, whose
+; traces reach Consumer2, are decided again.
+
+; EDITED-LABEL: define dso_local %struct.out.Consumer2 @Consumer2(i64* in %B, i64 %n) #0 {
+; EDITED: %0 = load i64, i64* %B, align 8, !spandex.req [[V:![0-9]+]], !spandex.mask [[ONE:![0-9]+]]
+; EDITED-LABEL: define dso_local %struct.out.Producer @Producer(i64* out %A, i64* out %B, i64 %n) #1 {
+; EDITED: store i64 1, i64* %A, align 8, !spandex.req [[WTO:![0-9]+]], !spandex.mask [[ONE]]
+; EDITED: store i64 2, i64* %B, align 8, !spandex.req [[WTFWD:![0-9]+]], !spandex.mask [[ONE]]
+; EDITED-LABEL: define dso_local %struct.out.Consumer @Consumer(i64* in %A, i64 %n) #1 {
+; EDITED: %0 = load i64, i64* %A, align 8, !spandex.req [[VO:![0-9]+]], !spandex.mask [[ONE]]
+; EDITED-DAG: [[V]] = !{!"V"}
+; EDITED-DAG: [[VO]] = !{!"Vo"}
+; EDITED-DAG: [[WTO]] = !{!"WTo"}
+; EDITED-DAG: [[WTFWD]] = !{!"WTfwd"}
+; EDITED-DAG: [[ONE]] = !{i64 1}
+
+; Runs with other options have other keys and miss.
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Consumer2 @Consumer2(i64* in %B, i64 %n) #0 {
+entry:
+  %0 = load i64, i64* %B, align 8
+  %returnStruct = insertvalue %struct.out.Consumer2 undef, i64 %0, 0
+  ret %struct.out.Consumer2 %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local i32 @main() local_unnamed_addr #0 {
+entry:
+  %A = alloca [1 x i64], align 8
+  %B = alloca [1 x i64], align 8
+  %RootArgs = alloca %struct.Root, align 8
+  %A.0 = getelementptr inbounds [1 x i64], [1 x i64]* %A, i64 0, i64 0
+  %inputA = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 0
+  store i64* %A.0, i64** %inputA, align 8
+  %B.0 = getelementptr inbounds [1 x i64], [1 x i64]* %B, i64 0, i64 0
+  %inputB = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 1
+  store i64* %B.0, i64** %inputB, align 8
+  %n = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 2
+  store i64 1, i64* %n, align 8
+  call void @llvm.hpvm.init()
+  %0 = bitcast %struct.Root* %RootArgs to i8*
+  %graphID = call i8* @llvm.hpvm.launch(i8* bitcast (%emptyStruct (i64*, i64*, i64)* @Root to i8*), i8* %0, i1 false)
+  call void @llvm.hpvm.wait(i8* %graphID)
+  call void @llvm.hpvm.cleanup()
+  ret i32 0
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Producer @Producer(i64* out %A, i64* out %B, i64 %n) #0 {
+entry:
+  store i64 1, i64* %A, align 8
+  store i64 2, i64* %B, align 8
+  %returnStruct = insertvalue %struct.out.Producer undef, i64 %n, 0
+  ret %struct.out.Producer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Consumer @Consumer(i64* in %A, i64 %n) #0 {
+entry:
+  %0 = load i64, i64* %A, align 8
+  %returnStruct = insertvalue %struct.out.Consumer undef, i64 %0, 0
+  ret %struct.out.Consumer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %emptyStruct @Root(i64* %A, i64* %B, i64 %n) #0 {
+entry:
+  %Producer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Producer (i64*, i64*, i64)* @Producer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 0, i32 0, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 1, i32 1, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 2, i32 2, i1 false)
+  %Consumer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Consumer (i64*, i64)* @Consumer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 0, i32 0, i1 false)
+  %Consumer2.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Consumer2 (i64*, i64)* @Consumer2 to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Consumer2.node, i32 1, i32 0, i1 false)
+  %edge = call i8* @llvm.hpvm.createEdge(i8* %Producer.node, i8* %Consumer.node, i1 true, i32 0, i32 1, i1 false)
+  %edge2 = call i8* @llvm.hpvm.createEdge(i8* %Producer.node, i8* %Consumer2.node, i1 true, i32 0, i32 1, i1 false)
+  ret %emptyStruct undef
+}
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createNode(i8*) #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createEdge(i8*, i8*, i1, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.bind.input(i8*, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.init() #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.launch(i8*, i8*, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.wait(i8*) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.cleanup() #1
+
+attributes #0 = { nounwind uwtable }
+attributes #1 = { nounwind }
+; Only used once Consumer2 is edited to refer to it
+attributes #2 = { noinline nounwind uwtable }
+
+!hpvm_hint_cpu = !{!0, !1}
+!hpvm_hint_gpu = !{!2, !3}
+!hpvm_hint_spir = !{}
+!hpvm_hint_cudnn = !{}
+!hpvm_hint_promise = !{}
+!hpvm_hint_cpu_gpu = !{}
+!hpvm_hint_cpu_spir = !{}
+
+!0 = !{%struct.out.Producer (i64*, i64*, i64)* @Producer}
+!1 = !{%emptyStruct (i64*, i64*, i64)* @Root}
+!2 = !{%struct.out.Consumer (i64*, i64)* @Consumer}
+!3 = !{%struct.out.Consumer2 (i64*, i64)* @Consumer2}
@@ -0,0 +1,123 @@
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -disable-output < %s | FileCheck %s
+; ModuleID = 'Diamond.ll'
+source_filename = "Diamond.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.Root = type { i64*, i64 }
+%struct.out.A = type <{ i64 }>
+%struct.out.B = type <{ i64 }>
+%struct.out.D = type <{ i64 }>
+%emptyStruct = type <{}>
+
+; A diamond DFG: A -> B -> D and A -> D, all on one CPU core. A writes the
+; first word of X, B reads it and writes the second, and D reads both. D is
+; reached from A along two paths, but its accesses are only counted once in
+; the trace of A, after the ones of B (see DiamondTraces.test). The order of
+; the nodes is not fixed, so the decisions are matched in any order.
+
+; CHECK-DAG: store i64 1, i64* %X, align 8{{ +}}WTfwd[00000001] for (i64* %X)[0*512 + 0]
+; CHECK-DAG: %b0 = load i64, i64* %X, align 8{{ +}}S{{ +}}[11111111] for (i64* %X)[0*512 + 0]
+; CHECK-DAG: store i64 %b0, i64* %b.arrayidx1, align 8{{ +}}WTfwd[00000010] for (i64* %X)[0*512 + 64]
+; CHECK-DAG: %d0 = load i64, i64* %X, align 8{{ +}}S{{ +}}[11111111] for (i64* %X)[0*512 + 0]
+; CHECK-DAG: %d1 = load i64, i64* %d.arrayidx1, align 8{{ +}}S{{ +}}[11111111] for (i64* %X)[0*512 + 64]
+
+; Function Attrs: nounwind uwtable
+define dso_local i32 @main() local_unnamed_addr #0 {
+entry:
+  %X = alloca [2 x i64], align 8
+  %RootArgs = alloca %struct.Root, align 8
+  %X.0 = getelementptr inbounds [2 x i64], [2 x i64]* %X, i64 0, i64 0
+  %input = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 0
+  store i64* %X.0, i64** %input, align 8
+  %Xsize = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 1
+  store i64 16, i64* %Xsize, align 8
+  call void @llvm.hpvm.init()
+  %0 = bitcast %struct.Root* %RootArgs to i8*
+  %graphID = call i8* @llvm.hpvm.launch(i8* bitcast (%emptyStruct (i64*, i64)* @Root to i8*), i8* %0, i1 false)
+  call void @llvm.hpvm.wait(i8* %graphID)
+  call void @llvm.hpvm.cleanup()
+  ret i32 0
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.A @A(i64* out %X, i64 %Xsize) #0 {
+entry:
+  store i64 1, i64* %X, align 8
+  %returnStruct = insertvalue %struct.out.A undef, i64 %Xsize, 0
+  ret %struct.out.A %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.B @B(i64* in out %X, i64 %Xsize) #0 {
+entry:
+  %b0 = load i64, i64* %X, align 8
+  %b.arrayidx1 = getelementptr inbounds i64, i64* %X, i64 1
+  store i64 %b0, i64* %b.arrayidx1, align 8
+  %returnStruct = insertvalue %struct.out.B undef, i64 %Xsize, 0
+  ret %struct.out.B %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.D @D(i64* in %X, i64 %fromA, i64 %fromB) #0 {
+entry:
+  %d0 = load i64, i64* %X, align 8
+  %d.arrayidx1 = getelementptr inbounds i64, i64* %X, i64 1
+  %d1 = load i64, i64* %d.arrayidx1, align 8
+  %sum = add i64 %d0, %d1
+  %returnStruct = insertvalue %struct.out.D undef, i64 %sum, 0
+  ret %struct.out.D %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %emptyStruct @Root(i64* %X, i64 %Xsize) #0 {
+entry:
+  %A.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.A (i64*, i64)* @A to i8*))
+  call void @llvm.hpvm.bind.input(i8* %A.node, i32 0, i32 0, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %A.node, i32 1, i32 1, i1 false)
+  %B.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.B (i64*, i64)* @B to i8*))
+  call void @llvm.hpvm.bind.input(i8* %B.node, i32 0, i32 0, i1 false)
+  %D.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.D (i64*, i64, i64)* @D to i8*))
+  call void @llvm.hpvm.bind.input(i8* %D.node, i32 0, i32 0, i1 false)
+  %AD = call i8* @llvm.hpvm.createEdge(i8* %A.node, i8* %D.node, i1 true, i32 0, i32 1, i1 false)
+  %AB = call i8* @llvm.hpvm.createEdge(i8* %A.node, i8* %B.node, i1 true, i32 0, i32 1, i1 false)
+  %BD = call i8* @llvm.hpvm.createEdge(i8* %B.node, i8* %D.node, i1 true, i32 0, i32 2, i1 false)
+  ret %emptyStruct undef
+}
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createNode(i8*) #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createEdge(i8*, i8*, i1, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.bind.input(i8*, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.init() #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.launch(i8*, i8*, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.wait(i8*) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.cleanup() #1
+
+attributes #0 = { nounwind uwtable }
+attributes #1 = { nounwind }
+
+!hpvm_hint_cpu = !{!0, !1, !2, !3}
+!hpvm_hint_gpu = !{}
+!hpvm_hint_spir = !{}
+!hpvm_hint_cudnn = !{}
+!hpvm_hint_promise = !{}
+!hpvm_hint_cpu_gpu = !{}
+!hpvm_hint_cpu_spir = !{}
+
+!0 = !{%struct.out.A (i64*, i64)* @A}
+!1 = !{%struct.out.B (i64*, i64)* @B}
+!2 = !{%struct.out.D (i64*, i64, i64)* @D}
+!3 = !{%emptyStruct (i64*, i64)* @Root}
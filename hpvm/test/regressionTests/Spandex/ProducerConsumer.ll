@@ -0,0 +1,177 @@
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -disable-output < %s | FileCheck %s
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-hints=%t.json -S < %s -o %t.ll
+; RUN: FileCheck --check-prefix=IR %s < %t.ll
+; RUN: FileCheck --check-prefix=HINTS %s < %t.json
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-cache-size=536870912 -disable-output < %s | FileCheck %s
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-hw=%S/Inputs/hardware.json -disable-output < %s | FileCheck --check-prefix=HW %s
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-profile=%S/Inputs/profile.json -disable-output < %s | FileCheck --check-prefix=PROFILE %s
+; RUN: not --crash opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-line-size=8192 -disable-output < %s 2>&1 | FileCheck --check-prefix=OVERFLOW %s
+; RUN: not --crash opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-hw=%S/Inputs/hardware-overflow.json -disable-output < %s 2>&1 | FileCheck --check-prefix=OVERFLOW %s
+; ModuleID = 'ProducerConsumer.ll'
+source_filename = "ProducerConsumer.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.Root = type { i64*, i64 }
+%struct.out.Producer = type <{ i64 }>
+%struct.out.Consumer = type <{ i64 }>
+%emptyStruct = type <{}>
+
+; Producer runs on the CPU and writes the first two words of A, the last of
+; which Consumer then reads on the GPU. The stores are written through to the
+; LLC for the GPU, and the load only asks for the word it reads.
+
+; CHECK: store i64 1, i64* %A, align 8{{ +}}WTfwd[00000001] for (i64* %A)[0*512 + 0]
+; CHECK-NEXT: store i64 2, i64* %arrayidx1, align 8{{ +}}WTfwd[00000010] for (i64* %A)[0*512 + 64]
+; CHECK-NEXT: %0 = load i64, i64* %arrayidx1, align 8{{ +}}V{{ +}}[00000010] for (i64* %A)[0*512 + 64]
+
+; Sizes are kept in bits, which does not overflow for caches of 512 MiB, so
+; these decisions also hold with -spandex-cache-size=536870912.
+
+; On hardware read from a file with 32-byte lines of four words:
+
+; HW: store i64 1, i64* %A, align 8{{ +}}WTfwd[0001] for (i64* %A)[0*256 + 0]
+; HW-NEXT: store i64 2, i64* %arrayidx1, align 8{{ +}}WTfwd[0010] for (i64* %A)[0*256 + 64]
+; HW-NEXT: %0 = load i64, i64* %arrayidx1, align 8{{ +}}V{{ +}}[0010] for (i64* %A)[0*256 + 64]
+
+; With a profile in which the first store and the load mostly find their word
+; last written by another core, they predict the owner. The second store was
+; never run, so it is decided statically as before.
+
+; PROFILE: store i64 1, i64* %A, align 8{{ +}}WTo{{ +}}[00000001] for (i64* %A)[0*512 + 0]
+; PROFILE-NEXT: store i64 2, i64* %arrayidx1, align 8{{ +}}WTfwd[00000010] for (i64* %A)[0*512 + 64]
+; PROFILE-NEXT: %0 = load i64, i64* %arrayidx1, align 8{{ +}}Vo{{ +}}[00000010] for (i64* %A)[0*512 + 64]
+
+; Lines too large to count their bits are rejected, whether they come from the
+; options or from the file.
+
+; OVERFLOW: Line size must be between 1 and 8191 bytes
+
+; The same decisions are attached to the accesses, numbered in the order they
+; are printed. Metadata nodes are uniqued, so a hint ID and a mask with the
+; same value are the same node.
+
+; IR-LABEL: define dso_local %struct.out.Producer @Producer(
+; IR: store i64 1, i64* %A, align 8, !spandex.req [[WTFWD:![0-9]+]], !spandex.mask [[ONE:![0-9]+]], !spandex.id [[ZERO:![0-9]+]]
+; IR: store i64 2, i64* %arrayidx1, align 8, !spandex.req [[WTFWD]], !spandex.mask [[TWO:![0-9]+]], !spandex.id [[ONE]]
+; IR-LABEL: define dso_local %struct.out.Consumer @Consumer(
+; IR: %0 = load i64, i64* %arrayidx1, align 8, !spandex.req [[V:![0-9]+]], !spandex.mask [[TWO]], !spandex.id [[TWO]]
+; IR-DAG: [[WTFWD]] = !{!"WTfwd"}
+; IR-DAG: [[V]] = !{!"V"}
+; IR-DAG: [[ZERO]] = !{i64 0}
+; IR-DAG: [[ONE]] = !{i64 1}
+; IR-DAG: [[TWO]] = !{i64 2}
+
+; HINTS: "block_size": 512,
+; HINTS-NEXT: "hints": [
+; HINTS-NEXT: {
+; HINTS-NEXT: "argument": 0,
+; HINTS-NEXT: "function": "Producer",
+; HINTS-NEXT: "id": 0,
+; HINTS-NEXT: "index": 0,
+; HINTS-NEXT: "instruction": " store i64 1, i64* %A, align 8",
+; HINTS-NEXT: "kind": "store",
+; HINTS-NEXT: "mask": 1,
+; HINTS-NEXT: "offset": 0,
+; HINTS-NEXT: "req": "WTfwd"
+; HINTS-NEXT: },
+; HINTS: "function": "Producer",
+; HINTS-NEXT: "id": 1,
+; HINTS-NEXT: "index": 1,
+; HINTS: "mask": 2,
+; HINTS-NEXT: "offset": 64,
+; HINTS-NEXT: "req": "WTfwd"
+; HINTS: "function": "Consumer",
+; HINTS-NEXT: "id": 2,
+; HINTS-NEXT: "index": 0,
+; HINTS-NEXT: "instruction": " %0 = load i64, i64* %arrayidx1, align 8",
+; HINTS-NEXT: "kind": "load",
+; HINTS-NEXT: "mask": 2,
+; HINTS-NEXT: "offset": 64,
+; HINTS-NEXT: "req": "V"
+; HINTS: "word_size": 64
+
+; Function Attrs: nounwind uwtable
+define dso_local i32 @main() local_unnamed_addr #0 {
+entry:
+  %A = alloca [2 x i64], align 8
+  %RootArgs = alloca %struct.Root, align 8
+  %A.0 = getelementptr inbounds [2 x i64], [2 x i64]* %A, i64 0, i64 0
+  %input = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 0
+  store i64* %A.0, i64** %input, align 8
+  %Asize = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 1
+  store i64 16, i64* %Asize, align 8
+  call void @llvm.hpvm.init()
+  %0 = bitcast %struct.Root* %RootArgs to i8*
+  %graphID = call i8* @llvm.hpvm.launch(i8* bitcast (%emptyStruct (i64*, i64)* @Root to i8*), i8* %0, i1 false)
+  call void @llvm.hpvm.wait(i8* %graphID)
+  call void @llvm.hpvm.cleanup()
+  ret i32 0
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Producer @Producer(i64* out %A, i64 %Asize) #0 {
+entry:
+  store i64 1, i64* %A, align 8
+  %arrayidx1 = getelementptr inbounds i64, i64* %A, i64 1
+  store i64 2, i64* %arrayidx1, align 8
+  %returnStruct = insertvalue %struct.out.Producer undef, i64 %Asize, 0
+  ret %struct.out.Producer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Consumer @Consumer(i64* in %A, i64 %Asize) #0 {
+entry:
+  %arrayidx1 = getelementptr inbounds i64, i64* %A, i64 1
+  %0 = load i64, i64* %arrayidx1, align 8
+  %returnStruct = insertvalue %struct.out.Consumer undef, i64 %0, 0
+  ret %struct.out.Consumer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %emptyStruct @Root(i64* %A, i64 %Asize) #0 {
+entry:
+  %Producer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Producer (i64*, i64)* @Producer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 0, i32 0, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 1, i32 1, i1 false)
+  %Consumer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Consumer (i64*, i64)* @Consumer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 0, i32 0, i1 false)
+  %edge = call i8* @llvm.hpvm.createEdge(i8* %Producer.node, i8* %Consumer.node, i1 true, i32 0, i32 1, i1 false)
+  ret %emptyStruct undef
+}
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createNode(i8*) #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createEdge(i8*, i8*, i1, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.bind.input(i8*, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.init() #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.launch(i8*, i8*, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.wait(i8*) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.cleanup() #1
+
+attributes #0 = { nounwind uwtable }
+attributes #1 = { nounwind }
+
+!hpvm_hint_cpu = !{!0, !1}
+!hpvm_hint_gpu = !{!2}
+!hpvm_hint_spir = !{}
+!hpvm_hint_cudnn = !{}
+!hpvm_hint_promise = !{}
+!hpvm_hint_cpu_gpu = !{}
+!hpvm_hint_cpu_spir = !{}
+
+!0 = !{%struct.out.Producer (i64*, i64)* @Producer}
+!1 = !{%emptyStruct (i64*, i64)* @Root}
+!2 = !{%struct.out.Consumer (i64*, i64)* @Consumer}
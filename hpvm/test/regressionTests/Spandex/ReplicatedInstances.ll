@@ -0,0 +1,152 @@
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-cores=4 -spandex-distribution=block -disable-output < %s | FileCheck --check-prefix=BLOCK %s
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-cores=4 -spandex-distribution=cyclic -disable-output < %s | FileCheck --check-prefix=CYCLIC %s
+; ModuleID = 'ReplicatedInstances.ll'
+source_filename = "ReplicatedInstances.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.Root = type { i64*, i64*, i64 }
+%struct.out.Producer = type <{ i64 }>
+%struct.out.Small = type <{ i64 }>
+%struct.out.Large = type <{ i64 }>
+%emptyStruct = type <{}>
+
+; Small and Large are replicated over 16 and 32 instances on the CPU, and
+; instance x increments word x of its buffer, so instances are 8 bytes apart
+; and eight of them share a 64-byte line. On one core the load would keep the
+; line in S, as the instance reads it and no other core writes it.
+;
+; With 4 cores and the block distribution, Small runs 4 instances per core, so
+; the line of instance 0 is also written on core 1. The load is false-shared:
+; it is demoted to V, and its mask only has the word of its own instance.
+; Large runs 8 instances per core, which fill the line, so the load is not
+; false-shared and keeps the whole line in S.
+
+; BLOCK-DAG: %0 = load i64, i64* %arrayidx, align 8{{ +}}V{{ +}}[00000001] for (i64* %A)[0*512 + 0]
+; BLOCK-DAG: %0 = load i64, i64* %arrayidx, align 8{{ +}}S{{ +}}[11111111] for (i64* %B)[0*512 + 0]
+
+; With the cyclic distribution, neighbouring instances of both nodes run on
+; different cores, so both loads are false-shared.
+
+; CYCLIC-DAG: %0 = load i64, i64* %arrayidx, align 8{{ +}}V{{ +}}[00000001] for (i64* %A)[0*512 + 0]
+; CYCLIC-DAG: %0 = load i64, i64* %arrayidx, align 8{{ +}}V{{ +}}[00000001] for (i64* %B)[0*512 + 0]
+
+; Function Attrs: nounwind uwtable
+define dso_local i32 @main() local_unnamed_addr #0 {
+entry:
+  %A = alloca [16 x i64], align 8
+  %B = alloca [32 x i64], align 8
+  %RootArgs = alloca %struct.Root, align 8
+  %A.0 = getelementptr inbounds [16 x i64], [16 x i64]* %A, i64 0, i64 0
+  %inputA = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 0
+  store i64* %A.0, i64** %inputA, align 8
+  %B.0 = getelementptr inbounds [32 x i64], [32 x i64]* %B, i64 0, i64 0
+  %inputB = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 1
+  store i64* %B.0, i64** %inputB, align 8
+  %n = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 2
+  store i64 1, i64* %n, align 8
+  call void @llvm.hpvm.init()
+  %0 = bitcast %struct.Root* %RootArgs to i8*
+  %graphID = call i8* @llvm.hpvm.launch(i8* bitcast (%emptyStruct (i64*, i64*, i64)* @Root to i8*), i8* %0, i1 false)
+  call void @llvm.hpvm.wait(i8* %graphID)
+  call void @llvm.hpvm.cleanup()
+  ret i32 0
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Producer @Producer(i64* out %A, i64* out %B, i64 %n) #0 {
+entry:
+  store i64 1, i64* %A, align 8
+  store i64 2, i64* %B, align 8
+  %returnStruct = insertvalue %struct.out.Producer undef, i64 %n, 0
+  ret %struct.out.Producer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Small @Small(i64* in out %A, i64 %n) #0 {
+entry:
+  %node = call i8* @llvm.hpvm.getNode()
+  %x = call i64 @llvm.hpvm.getNodeInstanceID.x(i8* %node)
+  %arrayidx = getelementptr inbounds i64, i64* %A, i64 %x
+  %0 = load i64, i64* %arrayidx, align 8
+  %inc = add nsw i64 %0, %n
+  store i64 %inc, i64* %arrayidx, align 8
+  %returnStruct = insertvalue %struct.out.Small undef, i64 %n, 0
+  ret %struct.out.Small %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Large @Large(i64* in out %B, i64 %n) #0 {
+entry:
+  %node = call i8* @llvm.hpvm.getNode()
+  %x = call i64 @llvm.hpvm.getNodeInstanceID.x(i8* %node)
+  %arrayidx = getelementptr inbounds i64, i64* %B, i64 %x
+  %0 = load i64, i64* %arrayidx, align 8
+  %inc = add nsw i64 %0, %n
+  store i64 %inc, i64* %arrayidx, align 8
+  %returnStruct = insertvalue %struct.out.Large undef, i64 %n, 0
+  ret %struct.out.Large %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %emptyStruct @Root(i64* %A, i64* %B, i64 %n) #0 {
+entry:
+  %Producer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Producer (i64*, i64*, i64)* @Producer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 0, i32 0, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 1, i32 1, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 2, i32 2, i1 false)
+  %Small.node = call i8* @llvm.hpvm.createNode1D(i8* bitcast (%struct.out.Small (i64*, i64)* @Small to i8*), i64 16)
+  call void @llvm.hpvm.bind.input(i8* %Small.node, i32 0, i32 0, i1 false)
+  %Large.node = call i8* @llvm.hpvm.createNode1D(i8* bitcast (%struct.out.Large (i64*, i64)* @Large to i8*), i64 32)
+  call void @llvm.hpvm.bind.input(i8* %Large.node, i32 1, i32 0, i1 false)
+  %edgeSmall = call i8* @llvm.hpvm.createEdge(i8* %Producer.node, i8* %Small.node, i1 true, i32 0, i32 1, i1 false)
+  %edgeLarge = call i8* @llvm.hpvm.createEdge(i8* %Producer.node, i8* %Large.node, i1 true, i32 0, i32 1, i1 false)
+  ret %emptyStruct undef
+}
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createNode(i8*) #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createNode1D(i8*, i64) #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createEdge(i8*, i8*, i1, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.bind.input(i8*, i32, i32, i1) #1
+
+; Function Attrs: nounwind readnone
+declare i8* @llvm.hpvm.getNode() #2
+
+; Function Attrs: nounwind readnone
+declare i64 @llvm.hpvm.getNodeInstanceID.x(i8*) #2
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.init() #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.launch(i8*, i8*, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.wait(i8*) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.cleanup() #1
+
+attributes #0 = { nounwind uwtable }
+attributes #1 = { nounwind }
+attributes #2 = { nounwind readnone }
+
+!hpvm_hint_cpu = !{!0, !1, !2, !3}
+!hpvm_hint_gpu = !{}
+!hpvm_hint_spir = !{}
+!hpvm_hint_cudnn = !{}
+!hpvm_hint_promise = !{}
+!hpvm_hint_cpu_gpu = !{}
+!hpvm_hint_cpu_spir = !{}
+
+!0 = !{%struct.out.Producer (i64*, i64*, i64)* @Producer}
+!1 = !{%struct.out.Small (i64*, i64)* @Small}
+!2 = !{%struct.out.Large (i64*, i64)* @Large}
+!3 = !{%emptyStruct (i64*, i64*, i64)* @Root}
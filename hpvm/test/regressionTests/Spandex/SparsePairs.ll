@@ -0,0 +1,131 @@
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex -spandex-owner-pred -disable-output < %s | FileCheck %s
+; ModuleID = 'SparsePairs.ll'
+source_filename = "SparsePairs.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.Root = type { i64*, i64* }
+%struct.out.Producer = type <{ i64 }>
+%struct.out.Consumer = type <{ i64 }>
+%emptyStruct = type <{}>
+
+; Producer writes one of the eight words of A and all of B on the CPU, and
+; Consumer reads all of A and one word of B on the GPU. With owner prediction,
+; the sparse side of each pair gives up ownership to the other: Consumer owns A,
+; which Producer writes through to, and Producer owns B, which Consumer loads
+; from with owner prediction.
+
+; CHECK-DAG: store i64 1, i64* %A, align 8{{ +}}WTo{{ +}}[00000001] for (i64* %A)[0*512 + 0]
+; CHECK-DAG: %0 = load i64, i64* %arrayidx, align 8{{ +}}O_data[11111111] for (i64* %A)[0*512 + 0]
+; CHECK-DAG: store i64 %i, i64* %arrayidx, align 8{{ +}}O{{ +}}[00000001] for (i64* %B)[0*512 + 0]
+; CHECK-DAG: %1 = load i64, i64* %B, align 8{{ +}}Vo{{ +}}[00000001] for (i64* %B)[0*512 + 0]
+
+; Function Attrs: nounwind uwtable
+define dso_local i32 @main() local_unnamed_addr #0 {
+entry:
+  %A = alloca [8 x i64], align 8
+  %B = alloca [8 x i64], align 8
+  %RootArgs = alloca %struct.Root, align 8
+  %A.0 = getelementptr inbounds [8 x i64], [8 x i64]* %A, i64 0, i64 0
+  %B.0 = getelementptr inbounds [8 x i64], [8 x i64]* %B, i64 0, i64 0
+  %inputA = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 0
+  store i64* %A.0, i64** %inputA, align 8
+  %inputB = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 1
+  store i64* %B.0, i64** %inputB, align 8
+  call void @llvm.hpvm.init()
+  %0 = bitcast %struct.Root* %RootArgs to i8*
+  %graphID = call i8* @llvm.hpvm.launch(i8* bitcast (%emptyStruct (i64*, i64*)* @Root to i8*), i8* %0, i1 false)
+  call void @llvm.hpvm.wait(i8* %graphID)
+  call void @llvm.hpvm.cleanup()
+  ret i32 0
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Producer @Producer(i64* out %A, i64* out %B) #0 {
+entry:
+  store i64 1, i64* %A, align 8
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.body ]
+  %arrayidx = getelementptr inbounds i64, i64* %B, i64 %i
+  store i64 %i, i64* %arrayidx, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond = icmp eq i64 %i.next, 8
+  br i1 %exitcond, label %for.end, label %for.body
+
+for.end:
+  %returnStruct = insertvalue %struct.out.Producer undef, i64 8, 0
+  ret %struct.out.Producer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Consumer @Consumer(i64* in %A, i64* in %B, i64 %n) #0 {
+entry:
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.body ]
+  %sum = phi i64 [ 0, %entry ], [ %sum.next, %for.body ]
+  %arrayidx = getelementptr inbounds i64, i64* %A, i64 %i
+  %0 = load i64, i64* %arrayidx, align 8
+  %sum.next = add i64 %sum, %0
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond = icmp eq i64 %i.next, 8
+  br i1 %exitcond, label %for.end, label %for.body
+
+for.end:
+  %1 = load i64, i64* %B, align 8
+  %result = add i64 %sum.next, %1
+  %returnStruct = insertvalue %struct.out.Consumer undef, i64 %result, 0
+  ret %struct.out.Consumer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %emptyStruct @Root(i64* %A, i64* %B) #0 {
+entry:
+  %Producer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Producer (i64*, i64*)* @Producer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 0, i32 0, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 1, i32 1, i1 false)
+  %Consumer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Consumer (i64*, i64*, i64)* @Consumer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 0, i32 0, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 1, i32 1, i1 false)
+  %edge = call i8* @llvm.hpvm.createEdge(i8* %Producer.node, i8* %Consumer.node, i1 true, i32 0, i32 2, i1 false)
+  ret %emptyStruct undef
+}
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createNode(i8*) #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createEdge(i8*, i8*, i1, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.bind.input(i8*, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.init() #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.launch(i8*, i8*, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.wait(i8*) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.cleanup() #1
+
+attributes #0 = { nounwind uwtable }
+attributes #1 = { nounwind }
+
+!hpvm_hint_cpu = !{!0, !1}
+!hpvm_hint_gpu = !{!2}
+!hpvm_hint_spir = !{}
+!hpvm_hint_cudnn = !{}
+!hpvm_hint_promise = !{}
+!hpvm_hint_cpu_gpu = !{}
+!hpvm_hint_cpu_spir = !{}
+
+!0 = !{%struct.out.Producer (i64*, i64*)* @Producer}
+!1 = !{%emptyStruct (i64*, i64*)* @Root}
+!2 = !{%struct.out.Consumer (i64*, i64*, i64)* @Consumer}
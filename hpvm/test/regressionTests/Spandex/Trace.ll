@@ -0,0 +1,189 @@
+; RUN: opt -load LLVMBuildDFG.so -load Spandex.so -spandex-trace -spandex-trace-nodes=%t.json -S < %s | FileCheck %s
+; RUN: FileCheck --check-prefix=NODES %s < %t.json
+; ModuleID = 'Trace.ll'
+source_filename = "Trace.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.Root = type { i64*, i64 }
+%struct.out.Producer = type <{ i64 }>
+%struct.out.Scale = type <{ i64 }>
+%struct.out.Consumer = type <{ i64 }>
+%emptyStruct = type <{}>
+
+; Producer and Scale run on the CPU, and Consumer on the GPU. The leaves are
+; numbered 0, 1 and 2 in the order Root creates them.
+
+; NODES: "nodes": [
+; NODES-NEXT: "Producer",
+; NODES-NEXT: "Scale",
+; NODES-NEXT: "Consumer"
+; NODES-NEXT: ]
+
+; Producer has a single instance, 0. Each of its accesses is recorded when the
+; runtime samples the instance.
+
+; CHECK-LABEL: define dso_local %struct.out.Producer @Producer(
+; CHECK: [[BEGIN:%[0-9]+]] = call i32 @llvm_hpvm_trace_begin(i32 0, i64 0)
+; CHECK-NEXT: [[SAMPLED:%[0-9]+]] = icmp ne i32 [[BEGIN]], 0
+; CHECK-NEXT: br i1 [[SAMPLED]], label %{{[0-9]+}}, label %{{[0-9]+}}
+; CHECK: [[A:%[0-9]+]] = bitcast i64* %A to i8*
+; CHECK-NEXT: call void @llvm_hpvm_trace_record(i32 0, i64 0, i32 0, i32 1, i8* [[A]])
+; CHECK: store i64 1, i64* %A, align 8
+; CHECK: br i1 [[SAMPLED]], label %{{[0-9]+}}, label %{{[0-9]+}}
+; CHECK: [[A1:%[0-9]+]] = bitcast i64* %arrayidx1 to i8*
+; CHECK-NEXT: call void @llvm_hpvm_trace_record(i32 0, i64 0, i32 1, i32 1, i8* [[A1]])
+; CHECK: store i64 2, i64* %arrayidx1, align 8
+
+; Scale is replicated over 4 x 2 instances. Its instance is x + X * y, with
+; X = 4. Its accesses are numbered in reverse post-order, as in the hint table
+; and profiles, so the load of %read is access 0 although %write comes first.
+
+; CHECK-LABEL: define dso_local %struct.out.Scale @Scale(
+; CHECK: [[NODE:%[0-9]+]] = call i8* @llvm.hpvm.getNode()
+; CHECK-NEXT: [[Y:%[0-9]+]] = call i64 @llvm.hpvm.getNodeInstanceID.y(i8* [[NODE]])
+; CHECK-NEXT: [[NUMY:%[0-9]+]] = call i64 @llvm.hpvm.getNumNodeInstances.y(i8* [[NODE]])
+; CHECK-NEXT: [[ZEROY:%[0-9]+]] = mul i64 0, [[NUMY]]
+; CHECK-NEXT: [[INSTANCEY:%[0-9]+]] = add i64 [[ZEROY]], [[Y]]
+; CHECK-NEXT: [[X:%[0-9]+]] = call i64 @llvm.hpvm.getNodeInstanceID.x(i8* [[NODE]])
+; CHECK-NEXT: [[NUMX:%[0-9]+]] = call i64 @llvm.hpvm.getNumNodeInstances.x(i8* [[NODE]])
+; CHECK-NEXT: [[ROWX:%[0-9]+]] = mul i64 [[INSTANCEY]], [[NUMX]]
+; CHECK-NEXT: [[INSTANCE:%[0-9]+]] = add i64 [[ROWX]], [[X]]
+; CHECK-NEXT: [[BEGIN:%[0-9]+]] = call i32 @llvm_hpvm_trace_begin(i32 1, i64 [[INSTANCE]])
+; CHECK-NEXT: [[SAMPLED:%[0-9]+]] = icmp ne i32 [[BEGIN]], 0
+; CHECK: write:
+; CHECK-NEXT: br i1 [[SAMPLED]], label %{{[0-9]+}}, label %{{[0-9]+}}
+; CHECK: [[STORED:%[0-9]+]] = bitcast i64* %arrayidx to i8*
+; CHECK-NEXT: call void @llvm_hpvm_trace_record(i32 1, i64 [[INSTANCE]], i32 1, i32 1, i8* [[STORED]])
+; CHECK: store i64 %new, i64* %arrayidx, align 8
+; CHECK: read:
+; CHECK-NEXT: br i1 [[SAMPLED]], label %{{[0-9]+}}, label %{{[0-9]+}}
+; CHECK: [[LOADED:%[0-9]+]] = bitcast i64* %arrayidx to i8*
+; CHECK-NEXT: call void @llvm_hpvm_trace_record(i32 1, i64 [[INSTANCE]], i32 0, i32 0, i8* [[LOADED]])
+; CHECK: %old = load i64, i64* %arrayidx, align 8
+
+; The code of Consumer does not run on the host, so it is left alone.
+
+; CHECK-LABEL: define dso_local %struct.out.Consumer @Consumer(
+; CHECK-NOT: llvm_hpvm_trace
+; CHECK: ret %struct.out.Consumer
+
+; CHECK-DAG: declare i32 @llvm_hpvm_trace_begin(i32, i64)
+; CHECK-DAG: declare void @llvm_hpvm_trace_record(i32, i64, i32, i32, i8*)
+
+; Function Attrs: nounwind uwtable
+define dso_local i32 @main() local_unnamed_addr #0 {
+entry:
+  %A = alloca [8 x i64], align 8
+  %RootArgs = alloca %struct.Root, align 8
+  %A.0 = getelementptr inbounds [8 x i64], [8 x i64]* %A, i64 0, i64 0
+  %input = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 0
+  store i64* %A.0, i64** %input, align 8
+  %n = getelementptr inbounds %struct.Root, %struct.Root* %RootArgs, i64 0, i32 1
+  store i64 2, i64* %n, align 8
+  call void @llvm.hpvm.init()
+  %0 = bitcast %struct.Root* %RootArgs to i8*
+  %graphID = call i8* @llvm.hpvm.launch(i8* bitcast (%emptyStruct (i64*, i64)* @Root to i8*), i8* %0, i1 false)
+  call void @llvm.hpvm.wait(i8* %graphID)
+  call void @llvm.hpvm.cleanup()
+  ret i32 0
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Producer @Producer(i64* out %A, i64 %n) #0 {
+entry:
+  store i64 1, i64* %A, align 8
+  %arrayidx1 = getelementptr inbounds i64, i64* %A, i64 1
+  store i64 2, i64* %arrayidx1, align 8
+  %returnStruct = insertvalue %struct.out.Producer undef, i64 %n, 0
+  ret %struct.out.Producer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Scale @Scale(i64* in out %A, i64 %n) #0 {
+entry:
+  %node = call i8* @llvm.hpvm.getNode()
+  %x = call i64 @llvm.hpvm.getNodeInstanceID.x(i8* %node)
+  %arrayidx = getelementptr inbounds i64, i64* %A, i64 %x
+  br label %read
+
+write:
+  store i64 %new, i64* %arrayidx, align 8
+  %returnStruct = insertvalue %struct.out.Scale undef, i64 %n, 0
+  ret %struct.out.Scale %returnStruct
+
+read:
+  %old = load i64, i64* %arrayidx, align 8
+  %new = mul nsw i64 %old, %n
+  br label %write
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %struct.out.Consumer @Consumer(i64* in %A, i64 %n) #0 {
+entry:
+  %0 = load i64, i64* %A, align 8
+  %returnStruct = insertvalue %struct.out.Consumer undef, i64 %0, 0
+  ret %struct.out.Consumer %returnStruct
+}
+
+; Function Attrs: nounwind uwtable
+define dso_local %emptyStruct @Root(i64* %A, i64 %n) #0 {
+entry:
+  %Producer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Producer (i64*, i64)* @Producer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 0, i32 0, i1 false)
+  call void @llvm.hpvm.bind.input(i8* %Producer.node, i32 1, i32 1, i1 false)
+  %Scale.node = call i8* @llvm.hpvm.createNode2D(i8* bitcast (%struct.out.Scale (i64*, i64)* @Scale to i8*), i64 4, i64 2)
+  call void @llvm.hpvm.bind.input(i8* %Scale.node, i32 0, i32 0, i1 false)
+  %Consumer.node = call i8* @llvm.hpvm.createNode(i8* bitcast (%struct.out.Consumer (i64*, i64)* @Consumer to i8*))
+  call void @llvm.hpvm.bind.input(i8* %Consumer.node, i32 0, i32 0, i1 false)
+  %edge = call i8* @llvm.hpvm.createEdge(i8* %Producer.node, i8* %Scale.node, i1 true, i32 0, i32 1, i1 false)
+  %edge2 = call i8* @llvm.hpvm.createEdge(i8* %Scale.node, i8* %Consumer.node, i1 true, i32 0, i32 1, i1 false)
+  ret %emptyStruct undef
+}
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createNode(i8*) #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createNode2D(i8*, i64, i64) #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.createEdge(i8*, i8*, i1, i32, i32, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.bind.input(i8*, i32, i32, i1) #1
+
+; Function Attrs: nounwind readnone
+declare i8* @llvm.hpvm.getNode() #2
+
+; Function Attrs: nounwind readnone
+declare i64 @llvm.hpvm.getNodeInstanceID.x(i8*) #2
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.init() #1
+
+; Function Attrs: nounwind
+declare i8* @llvm.hpvm.launch(i8*, i8*, i1) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.wait(i8*) #1
+
+; Function Attrs: nounwind
+declare void @llvm.hpvm.cleanup() #1
+
+attributes #0 = { nounwind uwtable }
+attributes #1 = { nounwind }
+attributes #2 = { nounwind readnone }
+
+!hpvm_hint_cpu = !{!0, !1, !3}
+!hpvm_hint_gpu = !{!2}
+!hpvm_hint_spir = !{}
+!hpvm_hint_cudnn = !{}
+!hpvm_hint_promise = !{}
+!hpvm_hint_cpu_gpu = !{}
+!hpvm_hint_cpu_spir = !{}
+
+!0 = !{%struct.out.Producer (i64*, i64)* @Producer}
+!1 = !{%struct.out.Scale (i64*, i64)* @Scale}
+!2 = !{%struct.out.Consumer (i64*, i64)* @Consumer}
+!3 = !{%emptyStruct (i64*, i64)* @Root}